@@ -16,6 +16,7 @@
           <interface>
             <target><xsl:value-of select="attr[@name='target']/string/@value" /></target>
             <clientInterface><xsl:value-of select="attr[@name='clientInterface']/string/@value" /></clientInterface>
+            <numOfCores><xsl:value-of select="attr[@name='numOfCores']/int/@value" /></numOfCores>
           </interface>
         </xsl:for-each>
       </interfaces>
@@ -574,7 +574,7 @@ rec {
     in
     {
       build = map (mappingItem: { derivation = mappingItem.service; target = mappingItem.target; }) serviceActivationMapping;
-      interfaces = map (target: { target = getTargetProperty targetProperty target; clientInterface = target.clientInterface; } ) targets;
+      interfaces = map (target: { target = getTargetProperty targetProperty target; clientInterface = target.clientInterface; numOfCores = target.numOfCores; } ) targets;
     }
   ;
   
@@ -43,7 +43,7 @@ in
         wantedBy = [ "multi-user.target" ];
         after = [ "dbus.service" ];
         
-        path = [ config.nix.package cfg.package cfg.dysnomia ];
+        path = [ config.nix.package cfg.package cfg.dysnomia pkgs.openssh ]; # ssh is used to copy closures from peers
         environment = {
           HOME = "/root";
         }
@@ -18,10 +18,136 @@
  */
 
 #include "build.h"
+#include <stdlib.h>
 #include <distributedderivation.h>
 #include <derivationmapping.h>
 #include <interfaces.h>
 #include <client-interface.h>
+#include <copy-closure.h>
+#include <closure-cache.h>
+#include <concurrencylimit.h>
+#include <package-management.h>
+#include "realisequeue.h"
+
+static void print_paths(gchar **paths)
+{
+    unsigned int i;
+    
+    for(i = 0; paths[i] != NULL; i++)
+        g_print(" %s", paths[i]);
+    
+    g_print("\n");
+}
+
+static GHashTable *create_path_table(gchar **paths)
+{
+    GHashTable *path_table = g_hash_table_new(g_str_hash, g_str_equal);
+    unsigned int i;
+    
+    for(i = 0; paths[i] != NULL; i++)
+        g_hash_table_insert(path_table, paths[i], paths[i]);
+    
+    return path_table;
+}
+
+static gchar **collect_outputs(const GPtrArray *derivation_array)
+{
+    GPtrArray *outputs_array = g_ptr_array_new();
+    unsigned int i;
+    
+    for(i = 0; i < derivation_array->len; i++)
+    {
+        DerivationItem *item = g_ptr_array_index(derivation_array, i);
+        
+        if(item->outputs != NULL)
+        {
+            unsigned int j;
+            
+            for(j = 0; item->outputs[j] != NULL; j++)
+                g_ptr_array_add(outputs_array, item->outputs[j]);
+        }
+    }
+    
+    g_ptr_array_add(outputs_array, NULL);
+    return (gchar**)g_ptr_array_free(outputs_array, FALSE);
+}
+
+static int outputs_are_valid(const DerivationItem *item, GHashTable *invalid_paths_table)
+{
+    unsigned int i;
+    
+    /* If the outputs are unknown, we must assume that the derivation has to be built */
+    if(item->outputs == NULL)
+        return FALSE;
+    
+    for(i = 0; item->outputs[i] != NULL; i++)
+    {
+        if(g_hash_table_lookup(invalid_paths_table, item->outputs[i]) != NULL)
+            return FALSE;
+    }
+    
+    return TRUE;
+}
+
+/* Output query infrastructure */
+
+static ProcReact_Future query_outputs(void *data, DerivationItem *item, Interface *interface)
+{
+    gchar *derivation[] = { item->derivation, NULL };
+    return pkgmgmt_query_outputs(derivation, 2);
+}
+
+static void complete_query_outputs(void *data, DerivationItem *item, ProcReact_Future *future, ProcReact_Status status)
+{
+    if(status == PROCREACT_STATUS_OK && future->result != NULL)
+        item->outputs = future->result;
+    else
+        g_printerr("[coordinator]: Cannot query the outputs of: %s, assuming it must be built\n", item->derivation);
+}
+
+static void query_derivation_outputs(const GPtrArray *derivation_array, const GPtrArray *interface_array, const unsigned int max_concurrent_transfers)
+{
+    ProcReact_FutureIterator iterator = create_derivation_future_iterator(derivation_array, interface_array, query_outputs, complete_query_outputs, NULL);
+    
+    /* Failures are not fatal -- derivations with unknown outputs are simply built */
+    procreact_fork_buffer_and_wait_in_parallel_limit(&iterator, max_concurrent_transfers);
+    destroy_derivation_future_iterator(&iterator);
+}
+
+static GPtrArray *filter_locally_valid_derivations(const GPtrArray *derivation_array)
+{
+    GPtrArray *pending_derivation_array = g_ptr_array_new();
+    gchar **outputs = collect_outputs(derivation_array);
+    ProcReact_Future future = pkgmgmt_print_invalid_packages(outputs, 2);
+    ProcReact_Status status;
+    char **invalid_paths = procreact_future_get(&future, &status);
+    GHashTable *invalid_paths_table = NULL;
+    unsigned int i;
+    
+    if(status == PROCREACT_STATUS_OK && invalid_paths != NULL)
+        invalid_paths_table = create_path_table(invalid_paths);
+    else
+        g_printerr("[coordinator]: Cannot check which build results are present, building all derivations\n");
+    
+    for(i = 0; i < derivation_array->len; i++)
+    {
+        DerivationItem *item = g_ptr_array_index(derivation_array, i);
+        
+        if(invalid_paths_table != NULL && outputs_are_valid(item, invalid_paths_table))
+            g_print("[coordinator]: Skipping derivation: %s, its build results are already present\n", item->derivation);
+        else
+            g_ptr_array_add(pending_derivation_array, item);
+    }
+    
+    if(invalid_paths_table != NULL)
+        g_hash_table_destroy(invalid_paths_table);
+    
+    /* Cleanup */
+    procreact_free_string_array(invalid_paths);
+    g_free(outputs);
+    
+    return pending_derivation_array;
+}
 
 /* Distribute store derivations infrastructure */
 
@@ -38,87 +164,366 @@ static void complete_copy_derivation_item_to(void *data, DerivationItem *item, P
         g_printerr("[target: %s]: Cannot receive intra-dependency closure of store derivation: %s\n", item->target, item->derivation);
 }
 
-static int distribute_derivations(const GPtrArray *derivation_array, const GPtrArray *interface_array, const unsigned int max_concurrent_transfers)
+/* Target validity check infrastructure */
+
+static gchar **collect_outputs_of_target(const GPtrArray *derivation_array, const gchar *target)
 {
-    int success;
-    ProcReact_PidIterator iterator = create_derivation_pid_iterator(derivation_array, interface_array, copy_derivation_item_to, complete_copy_derivation_item_to, NULL);
+    GPtrArray *target_derivation_array = g_ptr_array_new();
+    gchar **outputs;
+    unsigned int i;
     
-    g_print("[coordinator]: Distributing store derivation files...\n");
-    
-    procreact_fork_and_wait_in_parallel_limit(&iterator, max_concurrent_transfers);
-    success = derivation_iterator_has_succeeded(iterator.data);
+    for(i = 0; i < derivation_array->len; i++)
+    {
+        DerivationItem *item = g_ptr_array_index(derivation_array, i);
+        
+        if(g_strcmp0(item->target, target) == 0)
+            g_ptr_array_add(target_derivation_array, item);
+    }
     
-    destroy_derivation_pid_iterator(&iterator);
-    return success;
+    outputs = collect_outputs(target_derivation_array);
+    g_ptr_array_free(target_derivation_array, TRUE);
+    return outputs;
 }
 
-/* Realisation infrastructure */
+static int has_known_outputs(const DerivationItem *item)
+{
+    return (item->outputs != NULL);
+}
 
-static ProcReact_Future realise_derivation_item(void *data, DerivationItem *item, Interface *interface)
+static GPtrArray *select_target_representatives(const GPtrArray *derivation_array, int (*accept_item) (const DerivationItem *item))
 {
-    g_print("[target: %s]: Realising derivation: %s\n", item->target, item->derivation);
-    return exec_realise(interface->clientInterface, item->target, item->derivation);
+    GPtrArray *representative_array = g_ptr_array_new();
+    GHashTable *visited_targets_table = g_hash_table_new(g_str_hash, g_str_equal);
+    unsigned int i;
+    
+    /* Select the first accepted derivation of each target, so that each target is queried only once */
+    for(i = 0; i < derivation_array->len; i++)
+    {
+        DerivationItem *item = g_ptr_array_index(derivation_array, i);
+        
+        if(accept_item(item) && g_hash_table_lookup(visited_targets_table, item->target) == NULL)
+        {
+            g_ptr_array_add(representative_array, item);
+            g_hash_table_insert(visited_targets_table, item->target, item);
+        }
+    }
+    
+    g_hash_table_destroy(visited_targets_table);
+    return representative_array;
+}
+
+static ProcReact_Future print_invalid_outputs_of_target(void *data, DerivationItem *item, Interface *interface)
+{
+    gchar **outputs = collect_outputs_of_target((const GPtrArray*)data, item->target);
+    ProcReact_Future future = exec_print_invalid(interface->clientInterface, item->target, outputs);
+    g_free(outputs);
+    return future;
 }
 
-static void complete_realise_derivation_item(void *data, DerivationItem *item, ProcReact_Future *future, ProcReact_Status status)
+static void complete_print_invalid_outputs_of_target(void *data, DerivationItem *item, ProcReact_Future *future, ProcReact_Status status)
 {
     if(status == PROCREACT_STATUS_OK && future->result != NULL)
-        item->result = future->result;
+    {
+        const GPtrArray *derivation_array = (const GPtrArray*)data;
+        GHashTable *invalid_paths_table = create_path_table(future->result);
+        unsigned int i;
+        
+        /* Derivations of which the build results are present only have to be retrieved */
+        for(i = 0; i < derivation_array->len; i++)
+        {
+            DerivationItem *target_item = g_ptr_array_index(derivation_array, i);
+            
+            if(g_strcmp0(target_item->target, item->target) == 0 && outputs_are_valid(target_item, invalid_paths_table))
+            {
+                g_print("[target: %s]: Build results of derivation: %s are already present\n", target_item->target, target_item->derivation);
+                target_item->result = g_strdupv(target_item->outputs);
+            }
+        }
+        
+        g_hash_table_destroy(invalid_paths_table);
+        procreact_free_string_array(future->result);
+    }
     else
-        g_printerr("[target: %s]: Realising derivation: %s has failed!\n", item->target, item->derivation);
+        g_printerr("[target: %s]: Cannot check which build results are already present, building all derivations\n", item->target);
 }
 
-static int realise(const GPtrArray *derivation_array, const GPtrArray *interface_array)
+static void filter_remotely_valid_derivations(const GPtrArray *derivation_array, const GPtrArray *interface_array, const unsigned int max_concurrent_transfers)
 {
-    int success;
-    ProcReact_FutureIterator iterator = create_derivation_future_iterator(derivation_array, interface_array, realise_derivation_item, complete_realise_derivation_item, NULL);
-    procreact_fork_in_parallel_buffer_and_wait(&iterator);
+    GPtrArray *representative_array = select_target_representatives(derivation_array, has_known_outputs);
+    ProcReact_FutureIterator iterator = create_derivation_future_iterator(representative_array, interface_array, print_invalid_outputs_of_target, complete_print_invalid_outputs_of_target, (void*)derivation_array);
+    
+    /* Failures are not fatal -- the derivations of a target that cannot be checked are simply built */
+    procreact_fork_buffer_and_wait_in_parallel_limit(&iterator, max_concurrent_transfers);
+    destroy_derivation_future_iterator(&iterator);
+    g_ptr_array_free(representative_array, TRUE);
+}
+
+/* Garbage collection generation infrastructure */
+
+static int must_be_built(const DerivationItem *item)
+{
+    return (item->result == NULL);
+}
+
+static ProcReact_Future query_gc_generation_of_target(void *data, DerivationItem *item, Interface *interface)
+{
+    return exec_query_gc_generation(interface->clientInterface, item->target);
+}
+
+static void complete_query_gc_generation_of_target(void *data, DerivationItem *item, ProcReact_Future *future, ProcReact_Status status)
+{
+    char **result = future->result;
     
-    g_print("[coordinator]: Realising store derivation files...\n");
+    /* A target that cannot provide a marker is not cached, which is remembered as well */
+    if(status == PROCREACT_STATUS_OK && result != NULL && result[0] != NULL)
+        remember_gc_generation(item->target, result[0]);
+    else
+        remember_gc_generation(item->target, NULL);
     
-    success = derivation_iterator_has_succeeded(iterator.data);
+    procreact_free_string_array(result);
+}
+
+static void query_gc_generations(const GPtrArray *derivation_array, const GPtrArray *interface_array, const unsigned int max_concurrent_transfers)
+{
+    GPtrArray *representative_array = select_target_representatives(derivation_array, must_be_built);
+    ProcReact_FutureIterator iterator = create_derivation_future_iterator(representative_array, interface_array, query_gc_generation_of_target, complete_query_gc_generation_of_target, NULL);
     
+    procreact_fork_buffer_and_wait_in_parallel_limit(&iterator, max_concurrent_transfers);
     destroy_derivation_future_iterator(&iterator);
-    return success;
+    g_ptr_array_free(representative_array, TRUE);
 }
 
 /* Build result retrieval infrastructure */
 
 static pid_t copy_result_from(void *data, DerivationItem *item, Interface *interface)
 {
-    char *path;
-    unsigned int count = 0;
-    
     g_print("[target: %s]: Sending build results to coordinator:", item->target);
+    print_paths(item->result);
+    return exec_copy_closure_from(interface->clientInterface, item->target, item->result);
+}
+
+static void complete_copy_result_from(void *data, DerivationItem *item, ProcReact_Status status, int result)
+{
+    if(status != PROCREACT_STATUS_OK || !result)
+        g_print("[target: %s]: Cannot send build result of store derivation to coordinator: %s\n", item->target, item->derivation);
+}
+
+/* Pipelined build infrastructure */
+
+typedef struct
+{
+    /** Limits the amount of concurrent transfers of all pipelines */
+    ConcurrencyTokens transfer_tokens;
+    /** Maps each target to the tokens limiting its concurrent transfers, or NULL if they are unrestricted */
+    GHashTable *target_tokens_table;
+    /** Maps each target with a known amount of CPU cores to the queue limiting its concurrent realisations */
+    GHashTable *realise_queue_table;
+    /** Array with the derivation items that are built by the pipelines */
+    const GPtrArray *derivation_array;
+}
+BuildPipelineData;
+
+static void delete_target_tokens(gpointer data)
+{
+    ConcurrencyTokens *tokens = (ConcurrencyTokens*)data;
+    destroy_concurrency_tokens(tokens);
+    g_free(tokens);
+}
+
+static void delete_target_realise_queue(gpointer data)
+{
+    delete_realise_queue((RealiseQueue*)data);
+}
+
+static void destroy_build_pipeline_data(BuildPipelineData *data)
+{
+    if(data->target_tokens_table != NULL)
+        g_hash_table_destroy(data->target_tokens_table);
+    
+    g_hash_table_destroy(data->realise_queue_table);
+    destroy_concurrency_tokens(&data->transfer_tokens);
+}
+
+static int create_build_pipeline_data(BuildPipelineData *data, const GPtrArray *derivation_array, const GPtrArray *interface_array, const unsigned int max_concurrent_transfers)
+{
+    unsigned int i, max_per_target = max_concurrent_transfers_per_target();
+    
+    if(!create_concurrency_tokens(&data->transfer_tokens, max_concurrent_transfers))
+        return FALSE;
     
-    while((path = item->result[count]) != NULL)
+    data->derivation_array = derivation_array;
+    data->realise_queue_table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, delete_target_realise_queue);
+    
+    if(max_per_target == 0)
+        data->target_tokens_table = NULL;
+    else
+        data->target_tokens_table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, delete_target_tokens);
+    
+    for(i = 0; i < derivation_array->len; i++)
     {
-        g_print(" %s", path);
-        count++;
+        DerivationItem *item = g_ptr_array_index(derivation_array, i);
+        Interface *interface = find_interface(interface_array, item->target);
+        
+        /* Targets with an unknown amount of cores realise their derivations without restrictions */
+        if(interface != NULL && interface->numOfCores > 0 && g_hash_table_lookup(data->realise_queue_table, item->target) == NULL)
+        {
+            RealiseQueue *queue = create_realise_queue(interface->numOfCores);
+            
+            if(queue == NULL)
+            {
+                destroy_build_pipeline_data(data);
+                return FALSE;
+            }
+            
+            g_hash_table_insert(data->realise_queue_table, item->target, queue);
+        }
+        
+        if(data->target_tokens_table != NULL && g_hash_table_lookup(data->target_tokens_table, item->target) == NULL)
+        {
+            ConcurrencyTokens *tokens = (ConcurrencyTokens*)g_malloc(sizeof(ConcurrencyTokens));
+            
+            if(!create_concurrency_tokens(tokens, max_per_target))
+            {
+                g_free(tokens);
+                destroy_build_pipeline_data(data);
+                return FALSE;
+            }
+            
+            g_hash_table_insert(data->target_tokens_table, item->target, tokens);
+        }
     }
     
-    g_print("\n");
+    return TRUE;
+}
+
+static int transfer_derivation_item(BuildPipelineData *data, DerivationItem *item, Interface *interface, map_derivation_item_pid_function transfer, complete_derivation_item_mapping_pid_function complete_transfer)
+{
+    ConcurrencyTokens *target_tokens = (data->target_tokens_table == NULL) ? NULL : g_hash_table_lookup(data->target_tokens_table, item->target);
+    ProcReact_Status status;
+    int result;
     
-    return exec_copy_closure_from(interface->clientInterface, item->target, item->result);
+    /* Wait for a transfer slot of the target first, so that a pipeline never holds a global slot while waiting */
+    if(target_tokens != NULL && !acquire_concurrency_token(target_tokens))
+    {
+        g_printerr("[target: %s]: Cannot acquire a transfer slot of the target!\n", item->target);
+        return FALSE;
+    }
+    
+    if(!acquire_concurrency_token(&data->transfer_tokens))
+    {
+        g_printerr("[target: %s]: Cannot acquire a transfer slot!\n", item->target);
+        
+        if(target_tokens != NULL)
+            release_concurrency_token(target_tokens);
+        
+        return FALSE;
+    }
+    
+    result = procreact_wait_for_boolean(transfer(data, item, interface), &status);
+    
+    release_concurrency_token(&data->transfer_tokens);
+    
+    if(target_tokens != NULL)
+        release_concurrency_token(target_tokens);
+    
+    complete_transfer(data, item, status, result);
+    return (status == PROCREACT_STATUS_OK && result);
 }
 
-static void complete_copy_result_from(void *data, DerivationItem *item, ProcReact_Status status, int result)
+static unsigned int find_derivation_item_index(const GPtrArray *derivation_array, const DerivationItem *item)
 {
-    if(status != PROCREACT_STATUS_OK || !result)
-        g_print("[target: %s]: Cannot send build result of store derivation to coordinator: %s\n", item->target, item->derivation);
+    unsigned int i;
+    
+    for(i = 0; i < derivation_array->len; i++)
+    {
+        if(g_ptr_array_index(derivation_array, i) == item)
+            break;
+    }
+    
+    return i;
 }
 
-static int retrieve_results(const GPtrArray *derivation_array, const GPtrArray *interface_array, const unsigned int max_concurrent_transfers)
+static pid_t build_derivation_item(void *data, DerivationItem *item, Interface *interface)
+{
+    pid_t pid = fork();
+    
+    if(pid == 0)
+    {
+        BuildPipelineData *build_pipeline_data = (BuildPipelineData*)data;
+        
+        /* Derivations of which the build results are already present on the target only have to be retrieved */
+        if(item->result == NULL)
+        {
+            RealiseQueue *queue = g_hash_table_lookup(build_pipeline_data->realise_queue_table, item->target);
+            
+            /* Send the store derivation to the target machine */
+            if(!transfer_derivation_item(build_pipeline_data, item, interface, copy_derivation_item_to, complete_copy_derivation_item_to))
+                exit(1);
+            
+            /* Realise the store derivation on the target machine, which is limited by the cores of the target rather than the transfer limits */
+            item->result = realise_in_queue(queue, build_pipeline_data->derivation_array, find_derivation_item_index(build_pipeline_data->derivation_array, item), interface);
+            
+            if(item->result == NULL)
+                exit(1);
+        }
+        
+        /* Retrieve the build results */
+        exit(!transfer_derivation_item(build_pipeline_data, item, interface, copy_result_from, complete_copy_result_from));
+    }
+    
+    return pid;
+}
+
+static void complete_build_derivation_item(void *data, DerivationItem *item, ProcReact_Status status, int result)
+{
+    /* The stages report their own failures, except abnormal terminations */
+    if(status != PROCREACT_STATUS_OK)
+        g_printerr("[target: %s]: Building store derivation: %s terminated abnormally!\n", item->target, item->derivation);
+}
+
+static int build_derivations(const GPtrArray *derivation_array, const GPtrArray *interface_array, const unsigned int max_concurrent_transfers)
 {
     int success;
-    ProcReact_PidIterator iterator = create_derivation_pid_iterator(derivation_array, interface_array, copy_result_from, complete_copy_result_from, NULL);
+    BuildPipelineData data;
+    ProcReact_PidIterator iterator;
+    GPtrArray *pending_derivation_array;
+    
+    /* Skip the derivations of which the build results are already present on the coordinator */
+    g_print("[coordinator]: Checking which build results are already present...\n");
+    query_derivation_outputs(derivation_array, interface_array, max_concurrent_transfers);
+    pending_derivation_array = filter_locally_valid_derivations(derivation_array);
     
-    g_print("[coordinator]: Retrieving build results...\n");
+    /* Check once per target which derivations have already been built there, for example by a previous run that failed partially */
+    g_print("[coordinator]: Checking which build results are already present on the targets...\n");
+    filter_remotely_valid_derivations(pending_derivation_array, interface_array, max_concurrent_transfers);
     
-    procreact_fork_and_wait_in_parallel_limit(&iterator, max_concurrent_transfers);
+    /* Query the garbage collection generation of each target once, instead of in every transfer of a store derivation */
+    if(closure_cache_is_enabled())
+        query_gc_generations(pending_derivation_array, interface_array, max_concurrent_transfers);
+    
+    if(!create_build_pipeline_data(&data, pending_derivation_array, interface_array, max_concurrent_transfers))
+    {
+        g_printerr("[coordinator]: Cannot create the transfer and realisation slots!\n");
+        g_ptr_array_free(pending_derivation_array, TRUE);
+        return FALSE;
+    }
+    
+    iterator = create_derivation_pid_iterator(pending_derivation_array, interface_array, build_derivation_item, complete_build_derivation_item, &data);
+    
+    g_print("[coordinator]: Distributing, realising and retrieving store derivation files...\n");
+    
+    /*
+     * Each derivation item moves through its stages independently, so that a
+     * slow transfer or build does not hold back the other items. The transfer
+     * stages share the transfer slots and the realisations of a target share
+     * its realisation slots.
+     */
+    procreact_fork_in_parallel_and_wait(&iterator);
     success = derivation_iterator_has_succeeded(iterator.data);
     
     destroy_derivation_pid_iterator(&iterator);
+    destroy_build_pipeline_data(&data);
+    g_ptr_array_free(pending_derivation_array, TRUE);
     return success;
 }
 
@@ -137,13 +542,11 @@ int build(const gchar *distributed_derivation_file, const unsigned int max_concu
     {
         int exit_status;
         
-        if(distribute_derivations(distributed_derivation->derivation_array, distributed_derivation->interface_array, max_concurrent_transfers) /* Distribute derivations to target machines */
-          && realise(distributed_derivation->derivation_array, distributed_derivation->interface_array) /* Realise derivations on target machines */
-          && retrieve_results(distributed_derivation->derivation_array, distributed_derivation->interface_array, max_concurrent_transfers)) /* Retrieve back the build results */
+        if(build_derivations(distributed_derivation->derivation_array, distributed_derivation->interface_array, max_concurrent_transfers)) /* Distribute, realise and retrieve each derivation */
             exit_status = 0;
         else
             exit_status = 1;
-            
+        
         /* Cleanup */
         delete_distributed_derivation(distributed_derivation);
         
@@ -0,0 +1,390 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "realisequeue.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <client-interface.h>
+
+RealiseQueue *create_realise_queue(const unsigned int num_of_cores)
+{
+    RealiseQueue *queue = (RealiseQueue*)g_malloc(sizeof(RealiseQueue));
+    gchar *claims_path;
+    
+    queue->waiting_dir = g_build_filename(g_get_tmp_dir(), "disnix-realise-XXXXXX", NULL);
+    
+    if(g_mkdtemp(queue->waiting_dir) == NULL)
+    {
+        g_free(queue->waiting_dir);
+        g_free(queue);
+        return NULL;
+    }
+    
+    queue->claims_fd = g_file_open_tmp("disnix-claims-XXXXXX", &claims_path, NULL);
+    
+    if(queue->claims_fd == -1)
+    {
+        rmdir(queue->waiting_dir);
+        g_free(queue->waiting_dir);
+        g_free(queue);
+        return NULL;
+    }
+    
+    /* The claims file is only used through the descriptor that forked processes inherit */
+    unlink(claims_path);
+    g_free(claims_path);
+    fcntl(queue->claims_fd, F_SETFD, FD_CLOEXEC);
+    
+    if(!create_concurrency_tokens(&queue->tokens, num_of_cores))
+    {
+        close(queue->claims_fd);
+        rmdir(queue->waiting_dir);
+        g_free(queue->waiting_dir);
+        g_free(queue);
+        return NULL;
+    }
+    
+    return queue;
+}
+
+void delete_realise_queue(RealiseQueue *queue)
+{
+    if(queue != NULL)
+    {
+        GDir *dir = g_dir_open(queue->waiting_dir, 0, NULL);
+        
+        /* Remove the requests and results that have been left behind by failed processes */
+        if(dir != NULL)
+        {
+            const gchar *filename;
+            
+            while((filename = g_dir_read_name(dir)) != NULL)
+            {
+                gchar *path = g_build_filename(queue->waiting_dir, filename, NULL);
+                unlink(path);
+                g_free(path);
+            }
+            
+            g_dir_close(dir);
+        }
+        
+        rmdir(queue->waiting_dir);
+        g_free(queue->waiting_dir);
+        close(queue->claims_fd);
+        destroy_concurrency_tokens(&queue->tokens);
+        g_free(queue);
+    }
+}
+
+static int lock_claim(RealiseQueue *queue, const unsigned int index, short type, int command)
+{
+    struct flock lock;
+    
+    memset(&lock, 0, sizeof(struct flock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = index;
+    lock.l_len = 1;
+    
+    return (fcntl(queue->claims_fd, command, &lock) == 0);
+}
+
+static gchar *compose_request_path(RealiseQueue *queue, const unsigned int index)
+{
+    gchar *filename = g_strdup_printf("%u", index);
+    gchar *request_path = g_build_filename(queue->waiting_dir, filename, NULL);
+    g_free(filename);
+    return request_path;
+}
+
+static gchar *compose_result_path(RealiseQueue *queue, const unsigned int index)
+{
+    gchar *filename = g_strdup_printf("%u.result", index);
+    gchar *result_path = g_build_filename(queue->waiting_dir, filename, NULL);
+    g_free(filename);
+    return result_path;
+}
+
+static int register_request(RealiseQueue *queue, const unsigned int index)
+{
+    gchar *request_path = compose_request_path(queue, index);
+    int fd = open(request_path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    
+    g_free(request_path);
+    
+    if(fd == -1)
+        return FALSE;
+    else
+    {
+        close(fd);
+        return TRUE;
+    }
+}
+
+static int remove_request(RealiseQueue *queue, const unsigned int index)
+{
+    gchar *request_path = compose_request_path(queue, index);
+    int status = unlink(request_path);
+    g_free(request_path);
+    return (status == 0);
+}
+
+static int claim_request(RealiseQueue *queue, const unsigned int index)
+{
+    /* Lock the claim before removing the request, so that the owner of the request waits for the result once it sees that the request is gone */
+    if(!lock_claim(queue, index, F_WRLCK, F_SETLK))
+        return FALSE;
+    
+    if(remove_request(queue, index))
+        return TRUE;
+    else
+    {
+        lock_claim(queue, index, F_UNLCK, F_SETLK);
+        return FALSE;
+    }
+}
+
+static GArray *claim_pending_requests(RealiseQueue *queue, const GPtrArray *derivation_array)
+{
+    GArray *claimed_array = g_array_new(FALSE, FALSE, sizeof(unsigned int));
+    GDir *dir = g_dir_open(queue->waiting_dir, 0, NULL);
+    
+    if(dir != NULL)
+    {
+        const gchar *filename;
+        
+        while((filename = g_dir_read_name(dir)) != NULL)
+        {
+            gchar *endptr;
+            unsigned int index = strtoul(filename, &endptr, 10);
+            
+            /* Skip the stored results, which have a suffix */
+            if(*endptr == '\0' && index < derivation_array->len && claim_request(queue, index))
+                g_array_append_val(claimed_array, index);
+        }
+        
+        g_dir_close(dir);
+    }
+    
+    return claimed_array;
+}
+
+static void store_result(RealiseQueue *queue, const unsigned int index, gchar **result)
+{
+    /* A claimed derivation without a stored result has failed */
+    if(result != NULL)
+    {
+        gchar *result_path = compose_result_path(queue, index);
+        gchar *contents = g_strjoinv("\n", result);
+        g_file_set_contents(result_path, contents, -1, NULL);
+        g_free(contents);
+        g_free(result_path);
+    }
+    
+    /* Wake up the owner of the request */
+    lock_claim(queue, index, F_UNLCK, F_SETLK);
+}
+
+static gchar **wait_for_claimed_result(RealiseQueue *queue, DerivationItem *item, const unsigned int index)
+{
+    gchar *result_path = compose_result_path(queue, index);
+    gchar *contents;
+    gchar **result = NULL;
+    
+    /* The claim is released once the result has been stored, or when the process that has claimed it dies */
+    while(!lock_claim(queue, index, F_WRLCK, F_SETLKW))
+    {
+        if(errno != EINTR && errno != EDEADLK)
+        {
+            g_printerr("[target: %s]: Cannot wait for the realisation of derivation: %s\n", item->target, item->derivation);
+            g_free(result_path);
+            return NULL;
+        }
+    }
+    
+    if(g_file_get_contents(result_path, &contents, NULL, NULL))
+    {
+        result = g_strsplit(contents, "\n", -1);
+        g_free(contents);
+        unlink(result_path);
+    }
+    
+    lock_claim(queue, index, F_UNLCK, F_SETLK);
+    g_free(result_path);
+    
+    return result;
+}
+
+static void print_paths(gchar **paths)
+{
+    unsigned int i;
+    
+    for(i = 0; paths[i] != NULL; i++)
+        g_print(" %s", paths[i]);
+    
+    g_print("\n");
+}
+
+static gchar **realise_derivations(Interface *interface, gchar *target, gchar **derivations)
+{
+    ProcReact_Future future;
+    ProcReact_Status status;
+    char **result;
+    
+    g_print("[target: %s]: Realising derivations:", target);
+    print_paths(derivations);
+    
+    future = exec_realise(interface->clientInterface, target, derivations);
+    result = procreact_future_get(&future, &status);
+    
+    if(status == PROCREACT_STATUS_OK && result != NULL)
+        return result;
+    else
+    {
+        procreact_free_string_array(result);
+        return NULL;
+    }
+}
+
+static gchar **realise_derivation_item(DerivationItem *item, Interface *interface)
+{
+    gchar *derivations[] = { item->derivation, NULL };
+    gchar **result = realise_derivations(interface, item->target, derivations);
+    
+    if(result == NULL)
+        g_printerr("[target: %s]: Realising derivation: %s has failed!\n", item->target, item->derivation);
+    
+    return result;
+}
+
+static gchar **realise_with_claimed_derivations(RealiseQueue *queue, const GPtrArray *derivation_array, DerivationItem *item, GArray *claimed_array, Interface *interface)
+{
+    gchar **derivations = (gchar**)g_malloc((claimed_array->len + 2) * sizeof(gchar*));
+    gchar **result;
+    unsigned int i;
+    
+    derivations[0] = item->derivation;
+    
+    for(i = 0; i < claimed_array->len; i++)
+    {
+        DerivationItem *claimed_item = g_ptr_array_index(derivation_array, g_array_index(claimed_array, unsigned int, i));
+        derivations[i + 1] = claimed_item->derivation;
+    }
+    
+    derivations[i + 1] = NULL;
+    
+    result = realise_derivations(interface, item->target, derivations);
+    
+    if(result != NULL)
+    {
+        /* Each derivation has been realised, so their results are their outputs */
+        procreact_free_string_array(result);
+        
+        for(i = 0; i < claimed_array->len; i++)
+        {
+            unsigned int index = g_array_index(claimed_array, unsigned int, i);
+            DerivationItem *claimed_item = g_ptr_array_index(derivation_array, index);
+            store_result(queue, index, claimed_item->outputs);
+        }
+        
+        result = g_strdupv(item->outputs);
+    }
+    else
+    {
+        /* Realise the derivations separately, so that the failure of one of them does not affect the others */
+        g_printerr("[target: %s]: Realising the derivations together has failed, realising them separately\n", item->target);
+        
+        for(i = 0; i < claimed_array->len; i++)
+        {
+            unsigned int index = g_array_index(claimed_array, unsigned int, i);
+            gchar **claimed_result = realise_derivation_item(g_ptr_array_index(derivation_array, index), interface);
+            store_result(queue, index, claimed_result);
+            procreact_free_string_array(claimed_result);
+        }
+        
+        result = realise_derivation_item(item, interface);
+    }
+    
+    g_free(derivations);
+    return result;
+}
+
+gchar **realise_in_queue(RealiseQueue *queue, const GPtrArray *derivation_array, const unsigned int index, Interface *interface)
+{
+    DerivationItem *item = g_ptr_array_index(derivation_array, index);
+    GArray *claimed_array;
+    gchar **result;
+    
+    /* Without a queue, the target realises its derivations without restrictions */
+    if(queue == NULL)
+        return realise_derivation_item(item, interface);
+    
+    /* Only derivations with known outputs can share a realisation, because their outputs tell which results belong to which derivation */
+    if(item->outputs == NULL)
+    {
+        if(!acquire_concurrency_token(&queue->tokens))
+        {
+            g_printerr("[target: %s]: Cannot acquire a realisation slot for derivation: %s\n", item->target, item->derivation);
+            return NULL;
+        }
+        
+        result = realise_derivation_item(item, interface);
+        release_concurrency_token(&queue->tokens);
+        return result;
+    }
+    
+    if(!try_acquire_concurrency_token(&queue->tokens))
+    {
+        /* All realisation slots are occupied. Register the derivation, so that the next process that obtains a slot realises it along with its own */
+        if(!register_request(queue, index))
+        {
+            g_printerr("[target: %s]: Cannot register derivation: %s for realisation\n", item->target, item->derivation);
+            return NULL;
+        }
+        
+        if(!acquire_concurrency_token(&queue->tokens))
+        {
+            g_printerr("[target: %s]: Cannot acquire a realisation slot for derivation: %s\n", item->target, item->derivation);
+            return NULL;
+        }
+        
+        /* If the request is gone, another process has claimed the derivation */
+        if(!remove_request(queue, index))
+        {
+            release_concurrency_token(&queue->tokens);
+            result = wait_for_claimed_result(queue, item, index);
+            
+            if(result == NULL)
+                g_printerr("[target: %s]: Realising derivation: %s has failed!\n", item->target, item->derivation);
+            
+            return result;
+        }
+    }
+    
+    /* Realise the derivations that are waiting for a slot along with our own */
+    claimed_array = claim_pending_requests(queue, derivation_array);
+    result = realise_with_claimed_derivations(queue, derivation_array, item, claimed_array, interface);
+    release_concurrency_token(&queue->tokens);
+    
+    g_array_free(claimed_array, TRUE);
+    return result;
+}
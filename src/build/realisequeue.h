@@ -0,0 +1,78 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __DISNIX_REALISEQUEUE_H
+#define __DISNIX_REALISEQUEUE_H
+#include <glib.h>
+#include <derivationmapping.h>
+#include <interfaces.h>
+#include <concurrencylimit.h>
+
+/**
+ * @brief Limits the amount of concurrent realisations on a target
+ *
+ * The processes that realise derivations on the same target share the queue.
+ * A derivation with known outputs that has to wait for a realisation slot
+ * registers itself in the queue. The next process that obtains a slot claims
+ * all registered derivations and realises them along with its own in one
+ * invocation, so that no slot is spent on a single derivation while others
+ * are waiting.
+ */
+typedef struct
+{
+    /** Realisation slots of the target */
+    ConcurrencyTokens tokens;
+    /** Directory in which the waiting derivations register themselves and in which the results of claimed derivations are stored */
+    gchar *waiting_dir;
+    /** File with a byte per derivation item, locked by the process that has claimed it until its result is stored */
+    int claims_fd;
+}
+RealiseQueue;
+
+/**
+ * Creates a realise queue for a target.
+ *
+ * @param num_of_cores Amount of CPU cores of the target, which is the amount of concurrent realisations
+ * @return A realise queue, or NULL if it cannot be created
+ */
+RealiseQueue *create_realise_queue(const unsigned int num_of_cores);
+
+/**
+ * Deletes a realise queue and the files it has created.
+ *
+ * @param queue Realise queue to delete
+ */
+void delete_realise_queue(RealiseQueue *queue);
+
+/**
+ * Realises a derivation item on its target as soon as a realisation slot is
+ * available, possibly along with the derivations of the target that are
+ * waiting for a slot. If a combined realisation fails, each derivation is
+ * realised separately, so that one failing derivation does not affect the
+ * others.
+ *
+ * @param queue Realise queue of the target, or NULL to realise the derivation right away
+ * @param derivation_array Array with derivation items that is shared by all processes using the queue
+ * @param index Index of the derivation item to realise
+ * @param interface Interface of the target
+ * @return NULL-terminated array with the build results, or NULL if the realisation failed
+ */
+gchar **realise_in_queue(RealiseQueue *queue, const GPtrArray *derivation_array, const unsigned int index, Interface *interface);
+
+#endif
@@ -22,6 +22,7 @@
 #include <client-interface.h>
 #include <profilemanifest.h>
 #include <profilemanifesttarget.h>
+#include <concurrencylimit.h>
 
 /* Resolve profiles infrastructure */
 
@@ -113,7 +114,7 @@ static int retrieve_profiles(gchar *interface, GPtrArray *profile_manifest_targe
     
     g_printerr("[coordinator]: Retrieving intra-dependency closures of the profiles...\n");
     
-    procreact_fork_and_wait_in_parallel_limit(&iterator, max_concurrent_transfers);
+    fork_and_wait_in_parallel_with_concurrency_limit(&iterator, max_concurrent_transfers);
     success = profile_manifest_target_iterator_has_succeeded(&iterator);
     destroy_profile_manifest_target_iterator(&iterator);
     
@@ -0,0 +1,294 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "batch.h"
+#include <stdio.h>
+#include <unistd.h>
+#include "logging.h"
+#include "signaling.h"
+
+/*
+ * The items of a batch are ordinary jobs that are scheduled under the
+ * admission rules of their operation classes. A batch only keeps track of
+ * the dependencies among its items and reports the outcome of the entire
+ * batch through its own job id.
+ */
+
+typedef struct
+{
+    OrgNixosDisnixDisnix *object;
+    gint jid;
+    int log_fd;
+    GPtrArray *item_array;
+    unsigned int remaining;
+    gboolean failed;
+    unsigned int ref_count;
+}
+Batch;
+
+/** Hash table mapping the job ids of running and waiting batch items to the items */
+static GHashTable *batch_items_table = NULL;
+
+BatchItem *create_batch_item(unsigned int index, gint jid, GVariant *parameters, JobClass job_class, start_job_function start_job, GArray *dependencies)
+{
+    BatchItem *item = (BatchItem*)g_malloc(sizeof(BatchItem));
+    
+    item->index = index;
+    item->jid = jid;
+    item->parameters = g_variant_ref_sink(parameters);
+    item->job_class = job_class;
+    item->start_job = start_job;
+    item->dependencies = dependencies;
+    item->dependents = g_array_new(FALSE, FALSE, sizeof(guint));
+    item->pending_dependencies = dependencies->len;
+    item->skipped = FALSE;
+    item->batch = NULL;
+    
+    return item;
+}
+
+static void delete_batch_item(BatchItem *item)
+{
+    if(item->parameters != NULL)
+        g_variant_unref(item->parameters);
+    
+    g_array_free(item->dependencies, TRUE);
+    g_array_free(item->dependents, TRUE);
+    g_free(item);
+}
+
+static void delete_batch_item_array(GPtrArray *item_array)
+{
+    unsigned int i;
+    
+    for(i = 0; i < item_array->len; i++)
+        delete_batch_item(g_ptr_array_index(item_array, i));
+    
+    g_ptr_array_free(item_array, TRUE);
+}
+
+static void unref_batch(Batch *batch)
+{
+    batch->ref_count--;
+    
+    if(batch->ref_count == 0)
+    {
+        delete_batch_item_array(batch->item_array);
+        g_object_unref(batch->object);
+        g_free(batch);
+    }
+}
+
+static void schedule_batch_item(Batch *batch, BatchItem *item)
+{
+    GVariant *parameters = item->parameters;
+    
+    /* The job holds its own reference to the parameters */
+    item->parameters = NULL;
+    
+    /* An item that cannot be scheduled has failed. Completing it again after its failure signal has no effect */
+    if(!schedule_job_with_parameters(batch->object, parameters, item->jid, item->job_class, item->start_job))
+        complete_batch_item(item->jid, FALSE);
+    
+    g_variant_unref(parameters);
+}
+
+static void release_dependents(Batch *batch, BatchItem *item, GPtrArray *ready_items)
+{
+    unsigned int i;
+    
+    for(i = 0; i < item->dependents->len; i++)
+    {
+        BatchItem *dependent = g_ptr_array_index(batch->item_array, g_array_index(item->dependents, guint, i));
+        
+        dependent->pending_dependencies--;
+        
+        if(dependent->pending_dependencies == 0 && !dependent->skipped)
+            g_ptr_array_add(ready_items, dependent);
+    }
+}
+
+static void skip_batch_item(Batch *batch, BatchItem *item, BatchItem *failed_item)
+{
+    int log_fd;
+    
+    item->skipped = TRUE;
+    batch->remaining--;
+    g_hash_table_remove(batch_items_table, GINT_TO_POINTER(item->jid));
+    dprintf(batch->log_fd, "Operation %u (job id: %d) has been skipped\n", item->index, item->jid);
+    
+    /* Explain the failure in the logfile of the skipped item, so that the client can display it */
+    log_fd = open_log_file(batch->object, item->jid);
+    
+    if(log_fd != -1)
+    {
+        dprintf(log_fd, "Skipped, because it depends on operation %u (job id: %d), which has failed\n", failed_item->index, failed_item->jid);
+        close(log_fd);
+        emit_job_failure(batch->object, item->jid);
+    }
+}
+
+static void skip_dependents(Batch *batch, BatchItem *failed_item)
+{
+    GQueue failed_items = G_QUEUE_INIT;
+    BatchItem *item = failed_item;
+    
+    /* Skip the items that transitively depend on the failed item */
+    do
+    {
+        unsigned int i;
+        
+        for(i = 0; i < item->dependents->len; i++)
+        {
+            BatchItem *dependent = g_ptr_array_index(batch->item_array, g_array_index(item->dependents, guint, i));
+            
+            if(!dependent->skipped)
+            {
+                skip_batch_item(batch, dependent, item);
+                g_queue_push_tail(&failed_items, dependent);
+            }
+        }
+    }
+    while((item = g_queue_pop_head(&failed_items)) != NULL);
+}
+
+static void finish_batch_if_complete(Batch *batch)
+{
+    if(batch->remaining == 0 && batch->log_fd != -1)
+    {
+        if(batch->failed)
+            dprintf(batch->log_fd, "Batch has failed\n");
+        else
+            dprintf(batch->log_fd, "Batch has completed\n");
+        
+        close(batch->log_fd);
+        batch->log_fd = -1;
+        
+        if(batch->failed)
+            emit_job_failure(batch->object, batch->jid);
+        else
+            emit_job_finish(batch->object, batch->jid);
+        
+        /* Release the reference that is held while the batch runs */
+        unref_batch(batch);
+    }
+}
+
+static void schedule_ready_items(Batch *batch, GPtrArray *ready_items)
+{
+    unsigned int i;
+    
+    for(i = 0; i < ready_items->len; i++)
+        schedule_batch_item(batch, g_ptr_array_index(ready_items, i));
+}
+
+gboolean start_batch(OrgNixosDisnixDisnix *object, gint jid, GPtrArray *item_array)
+{
+    Batch *batch;
+    GPtrArray *ready_items;
+    unsigned int i;
+    int log_fd = open_log_file(object, jid);
+    
+    if(log_fd == -1)
+    {
+        delete_batch_item_array(item_array);
+        return FALSE;
+    }
+    
+    if(batch_items_table == NULL)
+        batch_items_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    
+    /* Compose the batch. One reference is held while the batch runs and one while it is being started */
+    batch = (Batch*)g_malloc(sizeof(Batch));
+    batch->object = g_object_ref(object);
+    batch->jid = jid;
+    batch->log_fd = log_fd;
+    batch->item_array = item_array;
+    batch->remaining = item_array->len;
+    batch->failed = FALSE;
+    batch->ref_count = 2;
+    
+    dprintf(log_fd, "Running batch of %u operations\n", item_array->len);
+    
+    /* Register the items and the reverse dependency relationships */
+    ready_items = g_ptr_array_new();
+    
+    for(i = 0; i < item_array->len; i++)
+    {
+        BatchItem *item = g_ptr_array_index(item_array, i);
+        unsigned int j;
+        
+        item->batch = batch;
+        g_hash_table_insert(batch_items_table, GINT_TO_POINTER(item->jid), item);
+        dprintf(log_fd, "Operation %u has job id: %d\n", item->index, item->jid);
+        
+        for(j = 0; j < item->dependencies->len; j++)
+        {
+            BatchItem *dependency = g_ptr_array_index(item_array, g_array_index(item->dependencies, guint, j));
+            g_array_append_val(dependency->dependents, i);
+        }
+        
+        if(item->pending_dependencies == 0)
+            g_ptr_array_add(ready_items, item);
+    }
+    
+    /* Schedule the items that do not depend on anything */
+    schedule_ready_items(batch, ready_items);
+    g_ptr_array_free(ready_items, TRUE);
+    
+    /* An empty batch completes right away */
+    finish_batch_if_complete(batch);
+    unref_batch(batch);
+    return TRUE;
+}
+
+void complete_batch_item(gint jid, gboolean succeeded)
+{
+    BatchItem *item;
+    
+    if(batch_items_table != NULL && (item = g_hash_table_lookup(batch_items_table, GINT_TO_POINTER(jid))) != NULL)
+    {
+        Batch *batch = (Batch*)item->batch;
+        
+        /* Keep the batch alive while the completion propagates, as skipped and scheduled items can complete synchronously */
+        batch->ref_count++;
+        batch->remaining--;
+        g_hash_table_remove(batch_items_table, GINT_TO_POINTER(jid));
+        
+        if(succeeded)
+        {
+            GPtrArray *ready_items = g_ptr_array_new();
+            
+            dprintf(batch->log_fd, "Operation %u (job id: %d) has succeeded\n", item->index, item->jid);
+            release_dependents(batch, item, ready_items);
+            schedule_ready_items(batch, ready_items);
+            g_ptr_array_free(ready_items, TRUE);
+        }
+        else
+        {
+            batch->failed = TRUE;
+            dprintf(batch->log_fd, "Operation %u (job id: %d) has failed\n", item->index, item->jid);
+            skip_dependents(batch, item);
+        }
+        
+        finish_batch_if_complete(batch);
+        unref_batch(batch);
+    }
+}
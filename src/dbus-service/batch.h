@@ -0,0 +1,90 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __DISNIX_BATCH_H
+#define __DISNIX_BATCH_H
+#include <glib.h>
+#include "disnix-dbus.h"
+#include "jobmanagement.h"
+
+/**
+ * @brief An operation of a batch that runs as a separate job
+ */
+typedef struct
+{
+    /** Position of the item in the batch */
+    unsigned int index;
+    /** Job ID of the item */
+    gint jid;
+    /** Parameters of the job in the format of the method call that normally requests it */
+    GVariant *parameters;
+    /** Class of operations that the job belongs to */
+    JobClass job_class;
+    /** Function that starts the job */
+    start_job_function start_job;
+    /** Indices of the items that must have succeeded before this item can start */
+    GArray *dependencies;
+    /** Indices of the items that depend on this item */
+    GArray *dependents;
+    /** Amount of dependencies that have not yet succeeded */
+    unsigned int pending_dependencies;
+    /** Indicates whether the item is skipped, because one of its dependencies has failed */
+    gboolean skipped;
+    /** Batch that the item belongs to */
+    gpointer batch;
+}
+BatchItem;
+
+/**
+ * Creates a new batch item.
+ *
+ * @param index Position of the item in the batch
+ * @param jid Job ID of the item
+ * @param parameters Parameters of the job. A floating reference is consumed
+ * @param job_class Class of operations that the job belongs to
+ * @param start_job Function that starts the job
+ * @param dependencies Array of guint indices of earlier items that must have succeeded first. The item takes ownership of it
+ * @return A batch item
+ */
+BatchItem *create_batch_item(unsigned int index, gint jid, GVariant *parameters, JobClass job_class, start_job_function start_job, GArray *dependencies);
+
+/**
+ * Starts a batch. The items without dependencies are scheduled right away,
+ * the others as soon as their dependencies have succeeded. Items of which a
+ * dependency fails are skipped and reported as failed. When all items have
+ * completed, a finish signal is propagated for the batch, or a failure signal
+ * if any of its items has failed.
+ *
+ * @param object A Disnix DBus interface object
+ * @param jid Job ID of the batch
+ * @param item_array Array of batch items in batch order. The batch takes ownership of it
+ * @return TRUE if the batch has been started, FALSE if its logfile cannot be opened and a failure signal has been propagated
+ */
+gboolean start_batch(OrgNixosDisnixDisnix *object, gint jid, GPtrArray *item_array);
+
+/**
+ * Notifies that the job of a batch item has completed. Jobs that do not
+ * belong to a batch are ignored.
+ *
+ * @param jid Job ID of the completed job
+ * @param succeeded Indicates whether the job has succeeded
+ */
+void complete_batch_item(gint jid, gboolean succeeded);
+
+#endif
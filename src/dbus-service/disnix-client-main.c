@@ -80,6 +80,15 @@ static void print_usage(const char *command)
     printf("  --clean-snapshots          Removes older snapshots from the snapshot store\n");
     printf("  --capture-config           Captures the configuration of the machine from the\n");
     printf("                             Dysnomia container properties in a Nix expression\n");
+    printf("  --query-gc-generation      Queries the marker that changes each time garbage\n");
+    printf("                             is collected on the target machine\n");
+    printf("  --copy-from-peer           Copies a closure from a peer machine into the Nix\n");
+    printf("                             store of the target machine\n");
+    printf("  --copy-snapshots-from-peer Copies the latest snapshot of a component from a\n");
+    printf("                             peer machine into the snapshot store of the target\n");
+    printf("                             machine\n");
+    printf("  --batch                    Carries out a batch of activities and locking\n");
+    printf("                             operations read from the standard input\n");
     printf("  --help                     Shows the usage of this command to the user\n");
     printf("  --version                  Shows the version of this command to the user\n");
 
@@ -97,6 +106,18 @@ static void print_usage(const char *command)
     printf("  --remotefile               Specifies that the given paths are stored remotely\n");
     printf("                             and must transferred from the remote machine if\n");
     printf("                             needed\n");
+    printf("  --stdin                    Import: reads the closure serialisation from the\n");
+    printf("                             standard input instead of a file\n");
+    printf("  --stdout                   Export/Capture config: streams the closure\n");
+    printf("                             serialisation or configuration to the standard\n");
+    printf("                             output instead of printing the path of a temp file\n");
+    
+    printf("\nCopy from peer/Copy snapshots from peer options:\n");
+    printf("  --peer=PEER                Address of the peer machine that provides the\n");
+    printf("                             closure or snapshots\n");
+    printf("  --peer-interface=INTERFACE Client interface used by the target machine to\n");
+    printf("                             connect to the peer. Defaults to:\n");
+    printf("                             disnix-ssh-client\n");
     
     printf("\nSet/Query installed/Lock/Unlock options:\n");
     printf("  -p, --profile=PROFILE      Name of the Disnix profile. Defaults to: default\n");
@@ -124,6 +145,14 @@ static void print_usage(const char *command)
     printf("  -C, --container=CONTAINER  Name of the container to filter on\n");
     printf("  -c, --component=COMPONENT  Name of the component to filter on\n");
 
+    printf("\nBatch options:\n");
+    printf("  The standard input contains one operation per line with the following\n");
+    printf("  tab-separated fields: the operation (activate, deactivate, snapshot, restore,\n");
+    printf("  delete-state, lock or unlock), the derivation or the profile, the container,\n");
+    printf("  the type, a comma-separated list of the line numbers (starting at 0) of the\n");
+    printf("  operations that must have succeeded first, and the arguments. The outcome of\n");
+    printf("  each operation is printed as its line number followed by: finish or failure.\n");
+
     printf("\nEnvironment:\n");
     printf("  DISNIX_PROFILE    Sets the name of the profile that stores the manifest on the\n");
     printf("                    coordinator machine and the deployed services per machine on\n");
@@ -158,9 +187,17 @@ int main(int argc, char *argv[])
         {"resolve-snapshots", no_argument, 0, 'Z'},
         {"clean-snapshots", no_argument, 0, 'e'},
         {"capture-config", no_argument, 0, '1'},
+        {"query-gc-generation", no_argument, 0, 'G'},
+        {"copy-from-peer", no_argument, 0, 'K'},
+        {"copy-snapshots-from-peer", no_argument, 0, 'X'},
+        {"batch", no_argument, 0, 'x'},
         {"target", required_argument, 0, 't'},
         {"localfile", no_argument, 0, 'l'},
         {"remotefile", no_argument, 0, 'R'},
+        {"stdin", no_argument, 0, 'i'},
+        {"stdout", no_argument, 0, 'o'},
+        {"peer", required_argument, 0, 'k'},
+        {"peer-interface", required_argument, 0, 'j'},
         {"profile", required_argument, 0, 'p'},
         {"delete-old", no_argument, 0, 'd'},
         {"type", required_argument, 0, 'T'},
@@ -176,7 +213,7 @@ int main(int argc, char *argv[])
 
     /* Option value declarations */
     Operation operation = OP_NONE;
-    char *profile = NULL, *type = NULL, *container = NULL, *component = NULL;
+    char *profile = NULL, *type = NULL, *container = NULL, *component = NULL, *peer = NULL, *peer_interface = NULL;
     gchar **derivation = NULL, **arguments = NULL;
     unsigned int derivation_size = 0, arguments_size = 0, flags = 0;
     int keep = 1;
@@ -252,12 +289,36 @@ int main(int argc, char *argv[])
             case '1':
                 operation = OP_CAPTURE_CONFIG;
                 break;
+            case 'G':
+                operation = OP_QUERY_GC_GENERATION;
+                break;
+            case 'K':
+                operation = OP_COPY_FROM_PEER;
+                break;
+            case 'X':
+                operation = OP_COPY_SNAPSHOTS_FROM_PEER;
+                break;
+            case 'x':
+                operation = OP_BATCH;
+                break;
             case 't':
                 break;
             case 'l':
                 break;
             case 'R':
                 break;
+            case 'i':
+                flags |= FLAG_STDIN;
+                break;
+            case 'o':
+                flags |= FLAG_STDOUT;
+                break;
+            case 'k':
+                peer = optarg;
+                break;
+            case 'j':
+                peer_interface = optarg;
+                break;
             case 'p':
                 profile = optarg;
                 break;
@@ -314,5 +375,5 @@ int main(int argc, char *argv[])
     arguments[arguments_size] = NULL;
     
     /* Execute Disnix client */
-    return run_disnix_client(operation, derivation, flags, profile, arguments, type, container, component, keep);
+    return run_disnix_client(operation, derivation, flags, profile, arguments, type, container, component, keep, peer, peer_interface);
 }
@@ -20,14 +20,29 @@
 #include "disnix-client.h"
 #include <stdio.h>
 #include <stdlib.h>
-
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <string.h>
 
+#include <gio/gunixfdlist.h>
 #include "disnix-dbus.h"
 #define BUFFER_SIZE 1024
 
 char *logdir;
 
+/* Named pipe through which a closure is streamed to the service, if any */
+static gchar *closure_fifo_dir = NULL, *closure_fifo = NULL;
+
+/* PID of the process feeding the named pipe */
+static pid_t feeder_pid = -1;
+
+/* Maps the job ids of the operations of a batch to their line numbers plus one */
+static GHashTable *batch_items_table = NULL;
+
 static void print_log(const gint pid)
 {
     char pidStr[15], buf[BUFFER_SIZE];
@@ -53,6 +68,227 @@ static void print_log(const gint pid)
     g_free(logfile);
 }
 
+static int copy_fd(int from_fd, int to_fd)
+{
+    char buf[BUFFER_SIZE];
+    ssize_t bytes_read;
+    
+    while((bytes_read = read(from_fd, buf, BUFFER_SIZE)) > 0)
+    {
+        if(write(to_fd, buf, bytes_read) != bytes_read)
+            return FALSE;
+    }
+    
+    return (bytes_read == 0);
+}
+
+static void cleanup_closure_fifo(void)
+{
+    if(feeder_pid > 0)
+    {
+        kill(feeder_pid, SIGTERM);
+        waitpid(feeder_pid, NULL, 0);
+    }
+    
+    if(closure_fifo != NULL)
+    {
+        unlink(closure_fifo);
+        rmdir(closure_fifo_dir);
+    }
+    
+    g_free(closure_fifo);
+    g_free(closure_fifo_dir);
+}
+
+/*
+ * Creates a named pipe and spawns a process that copies the stdin into it, so
+ * that the service can import a closure that is streamed to this client without
+ * storing it in a temp file first.
+ */
+static gchar *create_closure_fifo(void)
+{
+    const char *tmpdir = getenv("TMPDIR");
+    
+    if(tmpdir == NULL)
+        tmpdir = "/tmp";
+    
+    closure_fifo_dir = g_strconcat(tmpdir, "/disnix-client.XXXXXX", NULL);
+    
+    if(mkdtemp(closure_fifo_dir) == NULL)
+    {
+        g_printerr("ERROR: Cannot create temp directory for the closure stream!\n");
+        return NULL;
+    }
+    
+    closure_fifo = g_strconcat(closure_fifo_dir, "/closure", NULL);
+    
+    if(mkfifo(closure_fifo, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == -1 || chmod(closure_fifo_dir, S_IRWXU | S_IXGRP | S_IXOTH) == -1)
+    {
+        g_printerr("ERROR: Cannot create named pipe for the closure stream!\n");
+        return NULL;
+    }
+    
+    atexit(cleanup_closure_fifo);
+    
+    feeder_pid = fork();
+    
+    if(feeder_pid == 0)
+    {
+        /* Opening the pipe blocks until the service starts reading from it */
+        int fifo_fd = open(closure_fifo, O_WRONLY);
+        
+        if(fifo_fd == -1)
+            _exit(1);
+        
+        _exit(!copy_fd(0, fifo_fd));
+    }
+    else if(feeder_pid == -1)
+    {
+        g_printerr("ERROR: Cannot fork process feeding the closure stream!\n");
+        return NULL;
+    }
+    
+    return closure_fifo;
+}
+
+static int print_stream(GVariant *stream_handle, GUnixFDList *stream_fd_list)
+{
+    GError *error = NULL;
+    int stream_fd = g_unix_fd_list_get(stream_fd_list, g_variant_get_handle(stream_handle), &error);
+    int status;
+    
+    if(stream_fd == -1)
+    {
+        g_printerr("ERROR: Cannot receive the stream! Reason: %s\n", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+    
+    status = copy_fd(stream_fd, 1);
+    close(stream_fd);
+    return status;
+}
+
+/*
+ * A batch is read from the stdin with one operation per line. The fields are
+ * separated by tabs: the operation, the derivation or profile, the container,
+ * the type, a comma-separated list of line numbers of the operations it
+ * depends on, followed by the arguments. Empty lines are skipped and not
+ * counted as line numbers.
+ */
+static GVariant *parse_batch_operation(gchar **fields, char *profile)
+{
+    gchar **dependencies;
+    const gchar *derivation = fields[1], *container = fields[2];
+    GVariantBuilder dependencies_builder;
+    unsigned int i;
+    
+    /* Lock and unlock operations default to the profile option */
+    if(g_strcmp0(derivation, "") == 0)
+        derivation = profile;
+    
+    /* The container defaults to the type */
+    if(g_strcmp0(container, "") == 0)
+        container = fields[3];
+    
+    g_variant_builder_init(&dependencies_builder, G_VARIANT_TYPE("ai"));
+    dependencies = g_strsplit(fields[4], ",", 0);
+    
+    for(i = 0; dependencies[i] != NULL; i++)
+    {
+        char *end;
+        long dependency;
+        
+        if(g_strcmp0(dependencies[i], "") == 0)
+            continue;
+        
+        dependency = strtol(dependencies[i], &end, 10);
+        
+        if(*end != '\0')
+        {
+            g_variant_unref(g_variant_ref_sink(g_variant_builder_end(&dependencies_builder)));
+            g_strfreev(dependencies);
+            return NULL;
+        }
+        
+        g_variant_builder_add(&dependencies_builder, "i", (gint)dependency);
+    }
+    
+    g_strfreev(dependencies);
+    return g_variant_new("(ssss^as@ai)", fields[0], derivation, container, fields[3], &fields[5], g_variant_builder_end(&dependencies_builder));
+}
+
+static GVariant *read_batch_operations(char *profile)
+{
+    GVariantBuilder builder;
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t line_length;
+    unsigned int line_number = 0;
+    
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(ssssasai)"));
+    
+    while((line_length = getline(&line, &line_size, stdin)) != -1)
+    {
+        gchar **fields;
+        GVariant *operation;
+        
+        /* Remove the trailing newline */
+        if(line_length > 0 && line[line_length - 1] == '\n')
+            line[line_length - 1] = '\0';
+        
+        /* Skip empty lines, such as a trailing blank line */
+        if(line[0] == '\0')
+            continue;
+        
+        fields = g_strsplit(line, "\t", 0);
+        
+        if(g_strv_length(fields) < 5 || (operation = parse_batch_operation(fields, profile)) == NULL)
+        {
+            g_printerr("ERROR: Line %u of the batch is invalid!\n", line_number);
+            g_variant_unref(g_variant_ref_sink(g_variant_builder_end(&builder)));
+            g_strfreev(fields);
+            free(line);
+            return NULL;
+        }
+        
+        g_variant_builder_add_value(&builder, operation);
+        g_strfreev(fields);
+        line_number++;
+    }
+    
+    free(line);
+    return g_variant_builder_end(&builder);
+}
+
+static void register_batch_items(GVariant *jids)
+{
+    gsize i;
+    
+    batch_items_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    
+    for(i = 0; i < g_variant_n_children(jids); i++)
+    {
+        gint jid;
+        
+        g_variant_get_child(jids, i, "i", &jid);
+        g_hash_table_insert(batch_items_table, GINT_TO_POINTER(jid), GUINT_TO_POINTER(i + 1));
+    }
+}
+
+static gboolean print_batch_item_outcome(const gint pid, const gchar *outcome)
+{
+    guint line_number;
+    
+    if(batch_items_table == NULL || (line_number = GPOINTER_TO_UINT(g_hash_table_lookup(batch_items_table, GINT_TO_POINTER(pid)))) == 0)
+        return FALSE;
+    else
+    {
+        g_print("%u %s\n", line_number - 1, outcome);
+        return TRUE;
+    }
+}
+
 /* Signal handlers */
 
 static void disnix_finish_signal_handler(GDBusProxy *proxy, const gint pid, gpointer user_data)
@@ -61,6 +297,8 @@ static void disnix_finish_signal_handler(GDBusProxy *proxy, const gint pid, gpoi
 
     if(pid == my_pid)
         exit(0);
+    else
+        print_batch_item_outcome(pid, "finish");
 }
 
 static void disnix_success_signal_handler(GDBusProxy *proxy, const gint pid, gchar **derivation, gpointer user_data)
@@ -70,7 +308,7 @@ static void disnix_success_signal_handler(GDBusProxy *proxy, const gint pid, gch
     if(pid == my_pid)
     {
         unsigned int i;
-    
+        
         for(i = 0; i < g_strv_length(derivation); i++)
             g_print("%s\n", derivation[i]);
         
@@ -87,6 +325,8 @@ static void disnix_failure_signal_handler(GDBusProxy *proxy, const gint pid, gpo
         print_log(pid);
         exit(1);
     }
+    else if(print_batch_item_outcome(pid, "failure"))
+        print_log(pid);
 }
 
 static void cleanup(OrgNixosDisnixDisnix *proxy, gchar **derivation, gchar **arguments)
@@ -118,7 +358,7 @@ static gchar *check_dysnomia_activity_parameters(OrgNixosDisnixDisnix *proxy, gc
         return container;
 }
 
-int run_disnix_client(Operation operation, gchar **derivation, const unsigned int flags, char *profile, gchar **arguments, char *type, char *container, char *component, int keep)
+int run_disnix_client(Operation operation, gchar **derivation, const unsigned int flags, char *profile, gchar **arguments, char *type, char *container, char *component, int keep, char *peer, char *peer_interface)
 {
     /* Proxy object representing the D-Bus service object. */
     OrgNixosDisnixDisnix *proxy;
@@ -129,6 +369,13 @@ int run_disnix_client(Operation operation, gchar **derivation, const unsigned in
     /* Captures the results of D-Bus operations */
     GError *error = NULL;
     
+    /* Result of a method that streams its result to this client */
+    GVariant *stream_handle = NULL;
+    GUnixFDList *stream_fd_list = NULL;
+    
+    /* Job ids of the operations of a batch */
+    GVariant *batch_jids = NULL;
+    
     /* Other declarations */
     gint pid;
     
@@ -200,7 +447,19 @@ int run_disnix_client(Operation operation, gchar **derivation, const unsigned in
     switch(operation)
     {
 	case OP_IMPORT:
-	    if(derivation[0] == NULL)
+	    if(flags & FLAG_STDIN)
+	    {
+		gchar *closure = create_closure_fifo();
+		
+		if(closure == NULL)
+		{
+		    cleanup(proxy, derivation, arguments);
+		    return 1;
+		}
+		else
+		    org_nixos_disnix_disnix_call_import_sync(proxy, pid, closure, NULL, &error);
+	    }
+	    else if(derivation[0] == NULL)
 	    {
 		g_printerr("ERROR: A Nix store component has to be specified!\n");
 		cleanup(proxy, derivation, arguments);
@@ -210,11 +469,27 @@ int run_disnix_client(Operation operation, gchar **derivation, const unsigned in
 		org_nixos_disnix_disnix_call_import_sync(proxy, pid, derivation[0], NULL, &error);
 	    break;
 	case OP_EXPORT:
-	    org_nixos_disnix_disnix_call_export_sync(proxy, pid, (const gchar**) derivation, NULL, &error);
+	    if(flags & FLAG_STDOUT)
+	        org_nixos_disnix_disnix_call_export_stream_sync(proxy, pid, (const gchar**) derivation, NULL, &stream_handle, &stream_fd_list, NULL, &error);
+	    else
+	        org_nixos_disnix_disnix_call_export_sync(proxy, pid, (const gchar**) derivation, NULL, &error);
 	    break;
 	case OP_PRINT_INVALID:
 	    org_nixos_disnix_disnix_call_print_invalid_sync(proxy, pid, (const gchar**) derivation, NULL, &error);
 	    break;
+	case OP_COPY_FROM_PEER:
+	    if(peer == NULL)
+	    {
+		g_printerr("ERROR: A peer has to be specified!\n");
+		cleanup(proxy, derivation, arguments);
+		return 1;
+	    }
+	    
+	    if(peer_interface == NULL)
+	        peer_interface = "disnix-ssh-client";
+	    
+	    org_nixos_disnix_disnix_call_copy_from_peer_sync(proxy, pid, peer, peer_interface, (const gchar**) derivation, NULL, &error);
+	    break;
 	case OP_REALISE:
 	    org_nixos_disnix_disnix_call_realise_sync(proxy, pid, (const gchar**) derivation, NULL, &error);
 	    break;
@@ -304,8 +579,52 @@ int run_disnix_client(Operation operation, gchar **derivation, const unsigned in
 	        
 	    org_nixos_disnix_disnix_call_clean_snapshots_sync(proxy, pid, keep, container, component, NULL, &error);
 	    break;
+	case OP_COPY_SNAPSHOTS_FROM_PEER:
+	    if(peer == NULL)
+	    {
+		g_printerr("ERROR: A peer has to be specified!\n");
+		cleanup(proxy, derivation, arguments);
+		return 1;
+	    }
+	    else if(container == NULL)
+	    {
+		g_printerr("ERROR: A container has to be specified!\n");
+		cleanup(proxy, derivation, arguments);
+		return 1;
+	    }
+	    else if(component == NULL)
+	    {
+		g_printerr("ERROR: A component has to be specified!\n");
+		cleanup(proxy, derivation, arguments);
+		return 1;
+	    }
+	    
+	    if(peer_interface == NULL)
+	        peer_interface = "disnix-ssh-client";
+	    
+	    org_nixos_disnix_disnix_call_copy_snapshots_from_peer_sync(proxy, pid, peer, peer_interface, container, component, NULL, &error);
+	    break;
 	case OP_CAPTURE_CONFIG:
-	    org_nixos_disnix_disnix_call_capture_config_sync(proxy, pid, NULL, &error);
+	    if(flags & FLAG_STDOUT)
+	        org_nixos_disnix_disnix_call_capture_config_stream_sync(proxy, pid, NULL, &stream_handle, &stream_fd_list, NULL, &error);
+	    else
+	        org_nixos_disnix_disnix_call_capture_config_sync(proxy, pid, NULL, &error);
+	    break;
+	case OP_QUERY_GC_GENERATION:
+	    org_nixos_disnix_disnix_call_query_gc_generation_sync(proxy, pid, NULL, &error);
+	    break;
+	case OP_BATCH:
+	    {
+		GVariant *operations = read_batch_operations(profile);
+		
+		if(operations == NULL)
+		{
+		    cleanup(proxy, derivation, arguments);
+		    return 1;
+		}
+		else
+		    org_nixos_disnix_disnix_call_submit_batch_sync(proxy, pid, operations, &batch_jids, NULL, &error);
+	    }
 	    break;
 	case OP_NONE:
 	    g_printerr("ERROR: No operation specified!\n");
@@ -321,6 +640,29 @@ int run_disnix_client(Operation operation, gchar **derivation, const unsigned in
         return 1;
     }
     
+    /* Remember which job ids belong to the operations of the batch, so that their outcomes can be reported */
+    if(batch_jids != NULL)
+    {
+        register_batch_items(batch_jids);
+        g_variant_unref(batch_jids);
+    }
+    
+    /* Write the stream to the stdout. Afterwards, the finish or failure signal tells whether it is complete */
+    if(stream_fd_list != NULL)
+    {
+        int status = print_stream(stream_handle, stream_fd_list);
+        
+        g_variant_unref(stream_handle);
+        g_object_unref(stream_fd_list);
+        
+        if(!status)
+        {
+            g_printerr("ERROR: Cannot write the stream to the stdout!\n");
+            cleanup(proxy, derivation, arguments);
+            return 1;
+        }
+    }
+    
     /* Create main loop */
     mainloop = g_main_loop_new(NULL, FALSE);
     if(mainloop == NULL)
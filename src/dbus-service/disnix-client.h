@@ -22,6 +22,8 @@
 
 #define FLAG_DELETE_OLD 0x1
 #define FLAG_SESSION_BUS 0x2
+#define FLAG_STDIN 0x4
+#define FLAG_STDOUT 0x8
 
 #include <glib.h>
 
@@ -52,7 +54,11 @@ typedef enum
     OP_RESOLVE_SNAPSHOTS,
     OP_CLEAN_SNAPSHOTS,
     OP_DELETE_STATE,
-    OP_CAPTURE_CONFIG
+    OP_CAPTURE_CONFIG,
+    OP_QUERY_GC_GENERATION,
+    OP_COPY_FROM_PEER,
+    OP_COPY_SNAPSHOTS_FROM_PEER,
+    OP_BATCH
 }
 Operation;
 
@@ -68,8 +74,10 @@ Operation;
  * @param container Name of the container in which snapshots must be deployed
  * @param component Name of a mutable component in a container
  * @param keep Amount of snapshot generations to keep
+ * @param peer Address of a peer target machine from which a closure must be copied
+ * @param peer_interface Client interface used to communicate with the peer target machine
  * @return 0 if the operation succeeds, else a non-zero exit value
  */
-int run_disnix_client(Operation operation, gchar **derivation, const unsigned int flags, char *profile, gchar **arguments, char *type, char *container, char *component, int keep);
+int run_disnix_client(Operation operation, gchar **derivation, const unsigned int flags, char *profile, gchar **arguments, char *type, char *container, char *component, int keep, char *peer, char *peer_interface);
 
 #endif
@@ -18,8 +18,11 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <getopt.h>
 #include "disnix-service.h"
+#include "jobmanagement.h"
 
 #define TRUE 1
 #define FALSE 0
@@ -47,8 +50,27 @@ static void print_usage(const char *command)
     printf("                     the system bus (useful for testing)\n");
     printf("      --log-dir      Specify the directory in which the logfiles are stored\n");
     printf("                     (defaults to: /var/log/disnix)\n");
+    printf("      --max-running-jobs=NUM\n");
+    printf("                     Maximum amount of jobs that run concurrently. Further\n");
+    printf("                     jobs are queued until a running job completes. 0\n");
+    printf("                     means no limit (defaults to: 32)\n");
+    printf("      --max-concurrent-imports=NUM\n");
+    printf("                     Maximum amount of closures and snapshots that are\n");
+    printf("                     imported concurrently. 0 means no limit (defaults to: 1)\n");
+    printf("      --max-concurrent-builds=NUM\n");
+    printf("                     Maximum amount of builds that run concurrently. 0 means\n");
+    printf("                     no limit (defaults to: the amount of CPU cores)\n");
+    printf("      --max-concurrent-activities=NUM\n");
+    printf("                     Maximum amount of Dysnomia activities, such as\n");
+    printf("                     activation and restoring snapshots, that run\n");
+    printf("                     concurrently. 0 means no limit (defaults to: the amount\n");
+    printf("                     of CPU cores)\n");
     printf("  -h, --help         Shows the usage of this command to the user\n");
     printf("  -v, --version      Shows the version of this command to the user\n");
+    
+    printf("\nQueries are not limited by a class of their own. Garbage collection always\n");
+    printf("runs exclusively: it waits until all running jobs have completed and jobs that\n");
+    printf("arrive later wait until it has completed.\n");
 }
 
 static void print_version(const char *command)
@@ -65,6 +87,10 @@ int main(int argc, char *argv[])
     {
         {"session-bus", no_argument, 0, 's'},
         {"log-dir", required_argument, 0, 'l'},
+        {"max-running-jobs", required_argument, 0, 'j'},
+        {"max-concurrent-imports", required_argument, 0, 'i'},
+        {"max-concurrent-builds", required_argument, 0, 'b'},
+        {"max-concurrent-activities", required_argument, 0, 'a'},
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'v'},
         {0, 0, 0, 0}
@@ -72,6 +98,16 @@ int main(int argc, char *argv[])
     
     int session_bus = FALSE;
     char *logdir = "/var/log/disnix";
+    int max_running_jobs = 32;
+    long num_of_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_concurrent_imports = 1;
+    int max_concurrent_builds, max_concurrent_activities;
+    
+    if(num_of_cores < 1)
+        num_of_cores = 1;
+    
+    max_concurrent_builds = num_of_cores;
+    max_concurrent_activities = num_of_cores;
     
     /* Parse command-line options */
     while((c = getopt_long(argc, argv, "hv", long_options, &option_index)) != -1)
@@ -84,6 +120,18 @@ int main(int argc, char *argv[])
             case 'l':
                 logdir = optarg;
                 break;
+            case 'j':
+                max_running_jobs = atoi(optarg);
+                break;
+            case 'i':
+                max_concurrent_imports = atoi(optarg);
+                break;
+            case 'b':
+                max_concurrent_builds = atoi(optarg);
+                break;
+            case 'a':
+                max_concurrent_activities = atoi(optarg);
+                break;
             case 'h':
             case '?':
                 print_usage(argv[0]);
@@ -94,6 +142,25 @@ int main(int argc, char *argv[])
         }
     }
 
+    /* Validate options */
+    if(max_running_jobs < 0)
+    {
+        fprintf(stderr, "The maximum amount of running jobs cannot be negative!\n");
+        return 1;
+    }
+    
+    if(max_concurrent_imports < 0 || max_concurrent_builds < 0 || max_concurrent_activities < 0)
+    {
+        fprintf(stderr, "The maximum amount of concurrent operations cannot be negative!\n");
+        return 1;
+    }
+    
+    /* Configure the admission limits of the jobs */
+    set_max_running_jobs(max_running_jobs);
+    set_job_class_limit(JOB_CLASS_IMPORT, max_concurrent_imports);
+    set_job_class_limit(JOB_CLASS_BUILD, max_concurrent_builds);
+    set_job_class_limit(JOB_CLASS_ACTIVITY, max_concurrent_activities);
+    
     /* Start the program with the given options */
     return start_disnix_service(session_bus, logdir);
 }
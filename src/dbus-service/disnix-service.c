@@ -34,6 +34,17 @@ char *tmpdir;
 /* Path to the log directory */
 extern char *logdir;
 
+static void on_name_owner_changed(GDBusConnection *connection, const gchar *sender_name, const gchar *object_path, const gchar *interface_name, const gchar *signal_name, GVariant *parameters, gpointer user_data)
+{
+    const gchar *name, *old_owner, *new_owner;
+    
+    g_variant_get(parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+    
+    /* A unique name without a new owner belongs to a client that has disconnected */
+    if(name[0] == ':' && new_owner[0] == '\0')
+        remove_job_destinations(name);
+}
+
 static void on_bus_acquired(GDBusConnection *connection, const gchar *name, gpointer user_data)
 {
     GError *error = NULL;
@@ -44,7 +55,9 @@ static void on_bus_acquired(GDBusConnection *connection, const gchar *name, gpoi
     g_signal_connect(interface, "handle-get-job-id", G_CALLBACK(on_handle_get_job_id), NULL);
     g_signal_connect(interface, "handle-import", G_CALLBACK(on_handle_import), NULL);
     g_signal_connect(interface, "handle-export", G_CALLBACK(on_handle_export), NULL);
+    g_signal_connect(interface, "handle-export-stream", G_CALLBACK(on_handle_export_stream), NULL);
     g_signal_connect(interface, "handle-print-invalid", G_CALLBACK(on_handle_print_invalid), NULL);
+    g_signal_connect(interface, "handle-copy-from-peer", G_CALLBACK(on_handle_copy_from_peer), NULL);
     g_signal_connect(interface, "handle-realise", G_CALLBACK(on_handle_realise), NULL);
     g_signal_connect(interface, "handle-set", G_CALLBACK(on_handle_set), NULL);
     g_signal_connect(interface, "handle-query-installed", G_CALLBACK(on_handle_query_installed), NULL);
@@ -63,8 +76,12 @@ static void on_bus_acquired(GDBusConnection *connection, const gchar *name, gpoi
     g_signal_connect(interface, "handle-import-snapshots", G_CALLBACK(on_handle_import_snapshots), NULL);
     g_signal_connect(interface, "handle-resolve-snapshots", G_CALLBACK(on_handle_resolve_snapshots), NULL);
     g_signal_connect(interface, "handle-clean-snapshots", G_CALLBACK(on_handle_clean_snapshots), NULL);
+    g_signal_connect(interface, "handle-copy-snapshots-from-peer", G_CALLBACK(on_handle_copy_snapshots_from_peer), NULL);
     g_signal_connect(interface, "handle-get-logdir", G_CALLBACK(on_handle_get_logdir), NULL);
     g_signal_connect(interface, "handle-capture-config", G_CALLBACK(on_handle_capture_config), NULL);
+    g_signal_connect(interface, "handle-capture-config-stream", G_CALLBACK(on_handle_capture_config_stream), NULL);
+    g_signal_connect(interface, "handle-query-gc-generation", G_CALLBACK(on_handle_query_gc_generation), NULL);
+    g_signal_connect(interface, "handle-submit-batch", G_CALLBACK(on_handle_submit_batch), NULL);
     
     /* Export skeleton */
     if(!g_dbus_interface_skeleton_export(G_DBUS_INTERFACE_SKELETON(interface),
@@ -76,6 +93,18 @@ static void on_bus_acquired(GDBusConnection *connection, const gchar *name, gpoi
         g_error_free(error);
         exit(1);
     }
+    
+    /* Forget the job ids of clients that disconnect */
+    g_dbus_connection_signal_subscribe(connection,
+        "org.freedesktop.DBus",
+        "org.freedesktop.DBus",
+        "NameOwnerChanged",
+        "/org/freedesktop/DBus",
+        NULL,
+        G_DBUS_SIGNAL_FLAGS_NONE,
+        on_name_owner_changed,
+        NULL,
+        NULL);
 }
 
 static void on_name_acquired(GDBusConnection *connection, const gchar *name, gpointer user_data)
@@ -19,11 +19,53 @@
 
 #include "jobmanagement.h"
 #include <stdlib.h>
+#include <stdio.h>
 #include <dirent.h>
+#include "logging.h"
 
 /* Provides each job a unique job id */
 int job_counter;
 
+/* Maximum amount of running jobs, 0 means no limit */
+static unsigned int max_running_jobs = 0;
+
+/* Amount of jobs that are currently running */
+static unsigned int running_jobs = 0;
+
+/* Maximum amount of running jobs per class, 0 means no limit */
+static unsigned int job_class_limits[NUM_OF_JOB_CLASSES] = { 0, 0, 0, 0, 0 };
+
+/* Amount of jobs per class that are currently running */
+static unsigned int running_jobs_per_class[NUM_OF_JOB_CLASSES] = { 0, 0, 0, 0, 0 };
+
+/* Names of the job classes, used in the logs */
+static const char *job_class_names[NUM_OF_JOB_CLASSES] = { "query", "import", "build", "activity", "garbage collection" };
+
+/* Jobs waiting for admission in order of arrival */
+static GQueue pending_jobs = G_QUEUE_INIT;
+
+/* Amount of garbage collection jobs waiting for admission */
+static unsigned int pending_gc_jobs = 0;
+
+/* Maps job ids to the unique bus names of the clients that requested them */
+static GHashTable *job_destinations_table = NULL;
+
+/* Maps the job ids of running jobs to their classes */
+static GHashTable *running_jobs_table = NULL;
+
+typedef struct
+{
+    OrgNixosDisnixDisnix *object;
+    gint jid;
+    GVariant *parameters;
+    JobClass job_class;
+    start_job_function start_job;
+    start_merged_jobs_function start_merged_jobs;
+    int log_fd;
+    gint64 queued_since;
+}
+Job;
+
 static int numbersort(const struct dirent **a, const struct dirent **b)
 {
     int left = atoi((*a)->d_name);
@@ -60,3 +102,277 @@ int assign_pid(void)
     job_counter++;
     return return_value;
 }
+
+void set_job_destination(gint jid, const gchar *destination)
+{
+    if(job_destinations_table == NULL)
+        job_destinations_table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    
+    g_hash_table_insert(job_destinations_table, GINT_TO_POINTER(jid), g_strdup(destination));
+}
+
+gchar *take_job_destination(gint jid)
+{
+    gpointer destination;
+    
+    if(job_destinations_table != NULL && g_hash_table_lookup_extended(job_destinations_table, GINT_TO_POINTER(jid), NULL, &destination))
+    {
+        g_hash_table_steal(job_destinations_table, GINT_TO_POINTER(jid));
+        return (gchar*)destination;
+    }
+    else
+        return NULL;
+}
+
+static gboolean has_destination(gpointer key, gpointer value, gpointer user_data)
+{
+    return (g_strcmp0((const gchar*)value, (const gchar*)user_data) == 0);
+}
+
+void remove_job_destinations(const gchar *destination)
+{
+    if(job_destinations_table != NULL)
+        g_hash_table_foreach_remove(job_destinations_table, has_destination, (gpointer)destination);
+}
+
+void set_max_running_jobs(unsigned int limit)
+{
+    max_running_jobs = limit;
+}
+
+void set_job_class_limit(JobClass job_class, unsigned int limit)
+{
+    job_class_limits[job_class] = limit;
+}
+
+static int job_can_be_admitted(const Job *job)
+{
+    /* A garbage collection job excludes all other jobs */
+    if(running_jobs_per_class[JOB_CLASS_GC] > 0)
+        return FALSE;
+    else if(job->job_class == JOB_CLASS_GC)
+        return (running_jobs == 0);
+    else if(max_running_jobs > 0 && running_jobs >= max_running_jobs)
+        return FALSE;
+    else
+        return (job_class_limits[job->job_class] == 0 || running_jobs_per_class[job->job_class] < job_class_limits[job->job_class]);
+}
+
+static void delete_job(Job *job)
+{
+    g_variant_unref(job->parameters);
+    g_object_unref(job->object);
+    g_free(job);
+}
+
+static void log_queued_time(const Job *job)
+{
+    if(job->queued_since > 0)
+        dprintf(job->log_fd, "Started after being queued for %.1f seconds\n", (double)(g_get_monotonic_time() - job->queued_since) / G_USEC_PER_SEC);
+}
+
+static GPtrArray *take_mergeable_jobs(const Job *job)
+{
+    GPtrArray *merged_jobs = g_ptr_array_new();
+    GList *node = pending_jobs.head;
+    
+    while(node != NULL)
+    {
+        GList *next = node->next;
+        Job *pending_job = (Job*)node->data;
+        
+        if(pending_job->job_class == JOB_CLASS_GC)
+            break; /* Jobs behind a waiting garbage collection job cannot be merged into an earlier job */
+        else if(pending_job->start_merged_jobs == job->start_merged_jobs && pending_job->object == job->object)
+        {
+            g_queue_delete_link(&pending_jobs, node);
+            g_ptr_array_add(merged_jobs, pending_job);
+        }
+        
+        node = next;
+    }
+    
+    return merged_jobs;
+}
+
+static gboolean admit_merged_jobs(Job *job, GPtrArray *merged_jobs)
+{
+    unsigned int i, num_of_jobs = merged_jobs->len + 1;
+    gint *jids = (gint*)g_malloc(num_of_jobs * sizeof(gint));
+    GVariant **parameters = (GVariant**)g_malloc(num_of_jobs * sizeof(GVariant*));
+    int *log_fds = (int*)g_malloc(num_of_jobs * sizeof(int));
+    gboolean result;
+    
+    jids[0] = job->jid;
+    parameters[0] = job->parameters;
+    log_fds[0] = job->log_fd;
+    
+    for(i = 1; i < num_of_jobs; i++)
+    {
+        Job *merged_job = g_ptr_array_index(merged_jobs, i - 1);
+        
+        log_queued_time(merged_job);
+        
+        jids[i] = merged_job->jid;
+        parameters[i] = merged_job->parameters;
+        log_fds[i] = merged_job->log_fd;
+    }
+    
+    g_printerr("Merged %u jobs into job id: %d\n", num_of_jobs, job->jid);
+    
+    result = job->start_merged_jobs(job->object, jids, parameters, log_fds, num_of_jobs);
+    
+    /* Cleanup */
+    for(i = 0; i < merged_jobs->len; i++)
+        delete_job(g_ptr_array_index(merged_jobs, i));
+    
+    g_free(jids);
+    g_free(parameters);
+    g_free(log_fds);
+    
+    return result;
+}
+
+static void admit_job(Job *job)
+{
+    gboolean started;
+    
+    running_jobs++;
+    running_jobs_per_class[job->job_class]++;
+    
+    log_queued_time(job);
+    
+    /* Jobs of the same kind that are still queued are carried out together with this job, occupying a single slot */
+    if(job->start_merged_jobs != NULL)
+    {
+        GPtrArray *merged_jobs = take_mergeable_jobs(job);
+        
+        if(merged_jobs->len > 0)
+            started = admit_merged_jobs(job, merged_jobs);
+        else
+            started = job->start_job(job->object, job->jid, job->parameters, job->log_fd);
+        
+        g_ptr_array_free(merged_jobs, TRUE);
+    }
+    else
+        started = job->start_job(job->object, job->jid, job->parameters, job->log_fd);
+    
+    if(started)
+        g_hash_table_insert(running_jobs_table, GINT_TO_POINTER(job->jid), GINT_TO_POINTER(job->job_class));
+    else
+    {
+        /* A job that completes right away does not occupy a slot */
+        running_jobs--;
+        running_jobs_per_class[job->job_class]--;
+    }
+    
+    /* Cleanup */
+    delete_job(job);
+}
+
+static void start_pending_jobs(void)
+{
+    GList *node = pending_jobs.head;
+    
+    while(node != NULL)
+    {
+        Job *job = (Job*)node->data;
+        
+        if(job_can_be_admitted(job))
+        {
+            g_queue_delete_link(&pending_jobs, node);
+            
+            if(job->job_class == JOB_CLASS_GC)
+                pending_gc_jobs--;
+            
+            admit_job(job);
+            
+            /* Admitting a job may have taken other jobs from the queue, so start over */
+            node = pending_jobs.head;
+        }
+        else if(job->job_class == JOB_CLASS_GC)
+            break; /* Jobs behind a waiting garbage collection job wait as well, so that it cannot starve */
+        else
+            node = node->next;
+    }
+}
+
+static gboolean schedule_job_parameters(OrgNixosDisnixDisnix *object, GVariant *parameters, gint jid, JobClass job_class, start_job_function start_job, start_merged_jobs_function start_merged_jobs)
+{
+    int log_fd = open_log_file(object, jid);
+    
+    if(log_fd == -1)
+    {
+        g_variant_unref(g_variant_ref_sink(parameters)); /* Discards the parameters if they are floating */
+        return FALSE;
+    }
+    else
+    {
+        Job *job = (Job*)g_malloc(sizeof(Job));
+        
+        job->object = g_object_ref(object);
+        job->jid = jid;
+        job->parameters = g_variant_ref_sink(parameters);
+        job->job_class = job_class;
+        job->start_job = start_job;
+        job->start_merged_jobs = start_merged_jobs;
+        job->log_fd = log_fd;
+        job->queued_since = 0;
+        
+        if(running_jobs_table == NULL)
+            running_jobs_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+        
+        /* Start the job right away, unless the limits are reached or a garbage collection job waits */
+        if(pending_gc_jobs == 0 && job_can_be_admitted(job))
+            admit_job(job);
+        else
+        {
+            job->queued_since = g_get_monotonic_time();
+            
+            if(job_class == JOB_CLASS_GC)
+                dprintf(log_fd, "Queued until all running jobs have completed\n");
+            else if(pending_gc_jobs > 0 || running_jobs_per_class[JOB_CLASS_GC] > 0)
+                dprintf(log_fd, "Queued until garbage collection has completed\n");
+            else
+                dprintf(log_fd, "Queued until a slot for %s operations becomes available\n", job_class_names[job_class]);
+            
+            if(job_class == JOB_CLASS_GC)
+                pending_gc_jobs++;
+            
+            g_queue_push_tail(&pending_jobs, job);
+            
+            g_printerr("Queued job id: %d in class: %s\n", jid, job_class_names[job_class]);
+        }
+        
+        return TRUE;
+    }
+}
+
+gboolean schedule_mergeable_job(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint jid, JobClass job_class, start_job_function start_job, start_merged_jobs_function start_merged_jobs)
+{
+    return schedule_job_parameters(object, g_dbus_method_invocation_get_parameters(invocation), jid, job_class, start_job, start_merged_jobs);
+}
+
+gboolean schedule_job(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint jid, JobClass job_class, start_job_function start_job)
+{
+    return schedule_job_parameters(object, g_dbus_method_invocation_get_parameters(invocation), jid, job_class, start_job, NULL);
+}
+
+gboolean schedule_job_with_parameters(OrgNixosDisnixDisnix *object, GVariant *parameters, gint jid, JobClass job_class, start_job_function start_job)
+{
+    return schedule_job_parameters(object, parameters, jid, job_class, start_job, NULL);
+}
+
+void finish_job(gint jid)
+{
+    gpointer job_class;
+    
+    if(g_hash_table_lookup_extended(running_jobs_table, GINT_TO_POINTER(jid), NULL, &job_class))
+    {
+        g_hash_table_remove(running_jobs_table, GINT_TO_POINTER(jid));
+        running_jobs--;
+        running_jobs_per_class[GPOINTER_TO_INT(job_class)]--;
+    }
+    
+    start_pending_jobs();
+}
@@ -19,6 +19,55 @@
 
 #ifndef __DISNIX_JOBMANAGEMENT_H
 #define __DISNIX_JOBMANAGEMENT_H
+#include <glib.h>
+#include <gio/gio.h>
+#include "disnix-dbus.h"
+
+/**
+ * @brief Classes of operations that are admitted with separate limits
+ */
+typedef enum
+{
+    /** Queries and other light-weight operations */
+    JOB_CLASS_QUERY,
+    /** Operations that import closures or snapshots */
+    JOB_CLASS_IMPORT,
+    /** Operations that realise store derivations */
+    JOB_CLASS_BUILD,
+    /** Dysnomia activities, such as activation and restoring state */
+    JOB_CLASS_ACTIVITY,
+    /** Garbage collection, which runs exclusively */
+    JOB_CLASS_GC,
+    /** Amount of job classes */
+    NUM_OF_JOB_CLASSES
+}
+JobClass;
+
+/**
+ * Function that starts a job. If it spawns a process, it should hand it over
+ * to one of the signaling functions.
+ *
+ * @param object A Disnix DBus interface object
+ * @param jid Job ID of the job
+ * @param parameters Parameters of the method call that requested the job
+ * @param log_fd File descriptor of the job's logfile
+ * @return TRUE if the job runs and finish_job() gets invoked when it completes, FALSE if it has already completed
+ */
+typedef gboolean (*start_job_function) (OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd);
+
+/**
+ * Function that starts a group of jobs of the same kind as a single
+ * operation. The first job is the one that got admitted, the others were
+ * queued and have been merged into it.
+ *
+ * @param object A Disnix DBus interface object
+ * @param jids Job IDs of the jobs
+ * @param parameters Parameters of the method calls that requested the jobs
+ * @param log_fds File descriptors of the logfiles of the jobs
+ * @param num_of_jobs Amount of jobs in the group
+ * @return TRUE if the jobs run and finish_job() gets invoked for the first job when they complete, FALSE if they have already completed
+ */
+typedef gboolean (*start_merged_jobs_function) (OrgNixosDisnixDisnix *object, const gint *jids, GVariant **parameters, const int *log_fds, unsigned int num_of_jobs);
 
 /**
  * Determines what the next job id would be by inspecting the log files stored
@@ -35,4 +84,98 @@ void determine_next_pid(char *logdir);
  */
 int assign_pid(void);
 
+/**
+ * Records the client that has requested a job id, so that the completion
+ * signals of the job are only delivered to that client.
+ *
+ * @param jid Job ID of the job
+ * @param destination Unique bus name of the client
+ */
+void set_job_destination(gint jid, const gchar *destination);
+
+/**
+ * Retrieves and forgets the client that has requested a job id.
+ *
+ * @param jid Job ID of the job
+ * @return Unique bus name of the client that should be freed with g_free(), or NULL if it is unknown
+ */
+gchar *take_job_destination(gint jid);
+
+/**
+ * Forgets all job ids that have been requested by a client, which is done when
+ * the client disconnects, since nobody waits for their signals anymore.
+ *
+ * @param destination Unique bus name of the client
+ */
+void remove_job_destinations(const gchar *destination);
+
+/**
+ * Sets the maximum amount of jobs that run concurrently.
+ *
+ * @param limit Maximum amount of running jobs, or 0 for no limit
+ */
+void set_max_running_jobs(unsigned int limit);
+
+/**
+ * Sets the maximum amount of jobs of a class that run concurrently. Garbage
+ * collection jobs always run exclusively.
+ *
+ * @param job_class Class of jobs
+ * @param limit Maximum amount of running jobs of the class, or 0 for no limit
+ */
+void set_job_class_limit(JobClass job_class, unsigned int limit);
+
+/**
+ * Schedules a job requested by a method call and opens its logfile. The job
+ * starts right away if the limits permit it, otherwise it is queued and the
+ * logfile records that it waits.
+ *
+ * Queued jobs start in order of arrival as soon as both the overall limit and
+ * the limit of their class permit it. A garbage collection job waits until
+ * no other job runs. Jobs that arrive after it wait until it has completed.
+ *
+ * @param object A Disnix DBus interface object
+ * @param invocation Method invocation from which the parameters are taken
+ * @param jid Job ID of the job
+ * @param job_class Class of operations that the job belongs to
+ * @param start_job Function that starts the job
+ * @return TRUE if the job has been scheduled, FALSE if its logfile cannot be opened and a failure signal has been propagated
+ */
+gboolean schedule_job(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint jid, JobClass job_class, start_job_function start_job);
+
+/**
+ * Schedules a job like schedule_job(), but with parameters that do not
+ * originate from a method call, such as the items of a batch.
+ *
+ * @param object A Disnix DBus interface object
+ * @param parameters Parameters of the job in the format of the method call that normally requests it. A floating reference is consumed
+ * @param jid Job ID of the job
+ * @param job_class Class of operations that the job belongs to
+ * @param start_job Function that starts the job
+ * @return TRUE if the job has been scheduled, FALSE if its logfile cannot be opened and a failure signal has been propagated
+ */
+gboolean schedule_job_with_parameters(OrgNixosDisnixDisnix *object, GVariant *parameters, gint jid, JobClass job_class, start_job_function start_job);
+
+/**
+ * Schedules a job like schedule_job(), but when it gets admitted, the jobs
+ * with the same merge function that are still queued are carried out
+ * together with it as a single operation, occupying one slot.
+ *
+ * @param object A Disnix DBus interface object
+ * @param invocation Method invocation from which the parameters are taken
+ * @param jid Job ID of the job
+ * @param job_class Class of operations that the job belongs to
+ * @param start_job Function that starts the job if there is nothing to merge
+ * @param start_merged_jobs Function that starts the job together with the merged jobs
+ * @return TRUE if the job has been scheduled, FALSE if its logfile cannot be opened and a failure signal has been propagated
+ */
+gboolean schedule_mergeable_job(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint jid, JobClass job_class, start_job_function start_job, start_merged_jobs_function start_merged_jobs);
+
+/**
+ * Notifies that a running job has completed, so that queued jobs can start.
+ *
+ * @param jid Job ID of the completed job
+ */
+void finish_job(gint jid);
+
 #endif
@@ -19,21 +19,89 @@
 
 #include "methods.h"
 #include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <glib.h>
+#include <gio/gunixfdlist.h>
 #include "logging.h"
 #include "locking.h"
 #include "jobmanagement.h"
 #include "signaling.h"
+#include "batch.h"
 #include "package-management.h"
 #include "state-management.h"
 
 extern char *tmpdir, *logdir;
 
+/*
+ * Each method that carries out a deployment operation schedules a job in the
+ * class of operations it belongs to and replies right away. The job starts
+ * when the limits of its class permit it and retrieves its arguments from the
+ * parameters of the method call.
+ */
+
+/*
+ * Methods with a _stream suffix reply with the read end of a pipe, so that the
+ * caller reads the result while it is being produced instead of fetching a
+ * temp file afterwards. The write end is kept until the job starts.
+ */
+
+/* Maps the job ids of streaming jobs to the write ends of their pipes */
+static GHashTable *stream_fds_table = NULL;
+
+static GUnixFDList *open_stream(gint jid)
+{
+    int pipefd[2];
+    GUnixFDList *fd_list;
+    
+    if(pipe(pipefd) == -1)
+        return NULL;
+    
+    /* Prevent processes of other jobs from inheriting the pipe, so that the reader sees the end of the stream */
+    fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pipefd[1], F_SETFD, FD_CLOEXEC);
+    
+    /* The list takes over the read end */
+    fd_list = g_unix_fd_list_new_from_array(&pipefd[0], 1);
+    
+    if(stream_fds_table == NULL)
+        stream_fds_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    
+    g_hash_table_insert(stream_fds_table, GINT_TO_POINTER(jid), GINT_TO_POINTER(pipefd[1]));
+    return fd_list;
+}
+
+static int take_stream(gint jid)
+{
+    gpointer stream_fd;
+    
+    if(stream_fds_table != NULL && g_hash_table_lookup_extended(stream_fds_table, GINT_TO_POINTER(jid), NULL, &stream_fd))
+    {
+        g_hash_table_remove(stream_fds_table, GINT_TO_POINTER(jid));
+        return GPOINTER_TO_INT(stream_fd);
+    }
+    else
+        return -1;
+}
+
+static GUnixFDList *schedule_stream_job(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint jid, start_job_function start_job)
+{
+    GUnixFDList *fd_list = open_stream(jid);
+    
+    if(fd_list == NULL)
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_FAILED, "Cannot create a pipe for the stream of job id: %d", jid);
+    else if(!schedule_job(object, invocation, jid, JOB_CLASS_QUERY, start_job))
+        close(take_stream(jid)); /* The caller reads an empty stream and receives a failure signal */
+    
+    return fd_list;
+}
+
 /* Get job id method */
 
 gboolean on_handle_get_job_id(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation)
 {
     int job_counter = assign_pid();
+    set_job_destination(job_counter, g_dbus_method_invocation_get_sender(invocation));
     g_printerr("Assigned job id: %d\n", job_counter);
     org_nixos_disnix_disnix_complete_get_job_id(object, invocation, job_counter);
     return TRUE;
@@ -41,423 +109,652 @@ gboolean on_handle_get_job_id(OrgNixosDisnixDisnix *object, GDBusMethodInvocatio
 
 /* Import method */
 
-gboolean on_handle_import(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_closure)
+static gboolean start_import(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    const gchar *closure;
+    g_variant_get(parameters, "(i&s)", NULL, &closure);
     
-    if(log_fd != -1)
+    /* Print log entry */
+    dprintf(log_fd, "Importing: %s\n", closure);
+    
+    /* Execute command */
+    return signal_boolean_result(pkgmgmt_import_closure((gchar*)closure, log_fd, log_fd), object, jid, log_fd);
+}
+
+static gboolean start_merged_import(OrgNixosDisnixDisnix *object, const gint *jids, GVariant **parameters, const int *log_fds, unsigned int num_of_jobs)
+{
+    gchar **closures = (gchar**)g_malloc((num_of_jobs + 1) * sizeof(gchar*));
+    unsigned int i;
+    gboolean result;
+    
+    for(i = 0; i < num_of_jobs; i++)
     {
+        const gchar *closure;
+        g_variant_get(parameters[i], "(i&s)", NULL, &closure);
+        closures[i] = (gchar*)closure;
+        
         /* Print log entry */
-        dprintf(log_fd, "Importing: %s\n", arg_closure);
+        dprintf(log_fds[i], "Importing: %s\n", closure);
         
-        /* Execute command */
-        signal_boolean_result(pkgmgmt_import_closure(arg_closure, log_fd, log_fd), object, arg_pid, log_fd);
+        if(i > 0)
+            dprintf(log_fds[i], "Merged into the import of job id: %d\n", jids[0]);
     }
     
+    closures[i] = NULL;
+    
+    /* Execute command */
+    result = signal_merged_boolean_results(pkgmgmt_import_closures(closures, log_fds), object, jids, log_fds, num_of_jobs);
+    
+    g_free(closures);
+    return result;
+}
+
+gboolean on_handle_import(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_closure)
+{
+    schedule_mergeable_job(object, invocation, arg_pid, JOB_CLASS_IMPORT, start_import, start_merged_import);
     org_nixos_disnix_disnix_complete_import(object, invocation);
     return TRUE;
 }
 
 /* Export method */
 
-gboolean on_handle_export(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_derivation)
+static gboolean start_export(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    pid_t pid = -1;
+    int temp_fd;
+    gchar *tempfilename;
+    gchar **derivation;
+    gboolean result;
     
-    if(log_fd != -1)
-    {
-        pid_t pid;
-        int temp_fd;
-        gchar *tempfilename;
-        
-        /* Print log entry */
-        dprintf(log_fd, "Exporting: ");
-        print_paths(log_fd, (gchar**)arg_derivation);
-        dprintf(log_fd, "\n");
+    g_variant_get(parameters, "(i^a&s)", NULL, &derivation);
     
-        /* Execute command */
-        tempfilename = pkgmgmt_export_closure(tmpdir, (gchar**)arg_derivation, log_fd, &pid, &temp_fd);
-        signal_tempfile_result(pid, tempfilename, temp_fd, object, arg_pid, log_fd);
-    }
+    /* Print log entry */
+    dprintf(log_fd, "Exporting: ");
+    print_paths(log_fd, derivation);
+    dprintf(log_fd, "\n");
+
+    /* Execute command */
+    tempfilename = pkgmgmt_export_closure(tmpdir, derivation, log_fd, &pid, &temp_fd);
+    result = signal_tempfile_result(pid, tempfilename, temp_fd, object, jid, log_fd);
     
+    g_free(derivation);
+    return result;
+}
+
+gboolean on_handle_export(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_derivation)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_export);
     org_nixos_disnix_disnix_complete_export(object, invocation);
     return TRUE;
 }
 
-/* Print invalid paths method */
+/* Export stream method */
 
-gboolean on_handle_print_invalid(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_derivation)
+static gboolean start_export_stream(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    int stream_fd = take_stream(jid);
+    gchar **derivation;
+    pid_t pid;
     
-    if(log_fd != -1)
+    g_variant_get(parameters, "(i^a&s)", NULL, &derivation);
+    
+    /* Print log entry */
+    dprintf(log_fd, "Exporting to stream: ");
+    print_paths(log_fd, derivation);
+    dprintf(log_fd, "\n");
+    
+    /* Execute command */
+    pid = pkgmgmt_export_closure_fd(derivation, stream_fd, log_fd);
+    close(stream_fd);
+    
+    g_free(derivation);
+    return signal_boolean_result(pid, object, jid, log_fd);
+}
+
+gboolean on_handle_export_stream(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, GUnixFDList *fd_list, gint arg_pid, const gchar *const *arg_derivation)
+{
+    GUnixFDList *stream_fd_list = schedule_stream_job(object, invocation, arg_pid, start_export_stream);
+    
+    if(stream_fd_list != NULL)
     {
-        /* Print log entry */
-        dprintf(log_fd, "Print invalid: ");
-        print_paths(log_fd, (gchar**)arg_derivation);
-        dprintf(log_fd, "\n");
-        
-        /* Execute command */
-        signal_strv_result(pkgmgmt_print_invalid_packages((gchar**)arg_derivation, log_fd), object, arg_pid, log_fd);
+        org_nixos_disnix_disnix_complete_export_stream(object, invocation, stream_fd_list, g_variant_new_handle(0));
+        g_object_unref(stream_fd_list);
     }
     
+    return TRUE;
+}
+
+/* Print invalid paths method */
+
+static gboolean start_print_invalid(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
+{
+    gchar **derivation;
+    gboolean result;
+    
+    g_variant_get(parameters, "(i^a&s)", NULL, &derivation);
+    
+    /* Print log entry */
+    dprintf(log_fd, "Print invalid: ");
+    print_paths(log_fd, derivation);
+    dprintf(log_fd, "\n");
+    
+    /* Execute command */
+    result = signal_strv_result(pkgmgmt_print_invalid_packages(derivation, log_fd), object, jid, log_fd);
+    
+    g_free(derivation);
+    return result;
+}
+
+gboolean on_handle_print_invalid(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_derivation)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_print_invalid);
     org_nixos_disnix_disnix_complete_print_invalid(object, invocation);
     return TRUE;
 }
 
 /* Realise method */
 
-gboolean on_handle_realise(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_derivation)
+static gboolean start_realise(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    gchar **derivation;
+    gboolean result;
     
-    if(log_fd != -1)
-    {
-        /* Print log entry */
-        dprintf(log_fd, "Realising: ");
-        print_paths(log_fd, (gchar**)arg_derivation);
-        dprintf(log_fd, "\n");
-        
-        /* Execute command and wait and asychronously propagate its end result */
-        signal_strv_result(pkgmgmt_realise((gchar**)arg_derivation, log_fd), object, arg_pid, log_fd);
-    }
+    g_variant_get(parameters, "(i^a&s)", NULL, &derivation);
+    
+    /* Print log entry */
+    dprintf(log_fd, "Realising: ");
+    print_paths(log_fd, derivation);
+    dprintf(log_fd, "\n");
+    
+    /* Execute command and asychronously propagate its end result */
+    result = signal_strv_result(pkgmgmt_realise(derivation, log_fd), object, jid, log_fd);
     
+    g_free(derivation);
+    return result;
+}
+
+gboolean on_handle_realise(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_derivation)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_BUILD, start_realise);
     org_nixos_disnix_disnix_complete_realise(object, invocation);
     return TRUE;
 }
 
-/* Set method */
+/* Copy from peer method */
 
-gboolean on_handle_set(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_profile, const gchar *arg_derivation)
+static gboolean start_copy_from_peer(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    const gchar *peer, *peer_interface;
+    gchar **paths;
+    gboolean result;
     
-    if(log_fd != -1)
-    {
-        /* Print log entry */
-        dprintf(log_fd, "Set profile: %s with derivation: %s\n", arg_profile, arg_derivation);
+    g_variant_get(parameters, "(i&s&s^a&s)", NULL, &peer, &peer_interface, &paths);
     
-        /* Execute command */
-        signal_boolean_result(pkgmgmt_set_profile((gchar*)arg_profile, (gchar*)arg_derivation, log_fd, log_fd), object, arg_pid, log_fd);
-    }
+    /* Print log entry */
+    dprintf(log_fd, "Copying closure from peer: %s through interface: %s of: ", peer, peer_interface);
+    print_paths(log_fd, paths);
+    dprintf(log_fd, "\n");
+    
+    /* Execute command */
+    result = signal_boolean_result(pkgmgmt_copy_closure_from((gchar*)peer_interface, (gchar*)peer, paths, log_fd, log_fd), object, jid, log_fd);
     
+    g_free(paths);
+    return result;
+}
+
+gboolean on_handle_copy_from_peer(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_peer, const gchar *arg_peer_interface, const gchar *const *arg_paths)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_IMPORT, start_copy_from_peer);
+    org_nixos_disnix_disnix_complete_copy_from_peer(object, invocation);
+    return TRUE;
+}
+
+/* Set method */
+
+static gboolean start_set(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
+{
+    const gchar *profile, *derivation;
+    g_variant_get(parameters, "(i&s&s)", NULL, &profile, &derivation);
+    
+    /* Print log entry */
+    dprintf(log_fd, "Set profile: %s with derivation: %s\n", profile, derivation);
+
+    /* Execute command */
+    return signal_boolean_result(pkgmgmt_set_profile((gchar*)profile, (gchar*)derivation, log_fd, log_fd), object, jid, log_fd);
+}
+
+gboolean on_handle_set(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_profile, const gchar *arg_derivation)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_set);
     org_nixos_disnix_disnix_complete_set(object, invocation);
     return TRUE;
 }
 
 /* Query installed method */
 
-gboolean on_handle_query_installed(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_profile)
+static gboolean start_query_installed(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
-    
-    if(log_fd != -1)
-    {
-        GPtrArray *profile_manifest_array;
-    
-        /* Print log entry */
-        dprintf(log_fd, "Query installed derivations from profile: %s\n", arg_profile);
+    const gchar *profile;
+    GPtrArray *profile_manifest_array;
     
-        /* Execute command */
-        profile_manifest_array = create_profile_manifest_array((gchar*)arg_profile);
+    g_variant_get(parameters, "(i&s)", NULL, &profile);
     
-        if(profile_manifest_array == NULL)
-            org_nixos_disnix_disnix_emit_failure(object, arg_pid);
-        else
-        {
-            signal_strv_result(query_installed_services(profile_manifest_array), object, arg_pid, log_fd);
-            delete_profile_manifest_array(profile_manifest_array);
-        }
+    /* Print log entry */
+    dprintf(log_fd, "Query installed derivations from profile: %s\n", profile);
+
+    /* Execute command */
+    profile_manifest_array = create_profile_manifest_array((gchar*)profile);
+
+    if(profile_manifest_array == NULL)
+    {
+        emit_job_failure(object, jid);
+        close(log_fd);
+        return FALSE;
     }
-    
+    else
+    {
+        gboolean result = signal_strv_result(query_installed_services(profile_manifest_array), object, jid, log_fd);
+        delete_profile_manifest_array(profile_manifest_array);
+        return result;
+    }
+}
+
+gboolean on_handle_query_installed(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_profile)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_query_installed);
     org_nixos_disnix_disnix_complete_query_installed(object, invocation);
     return TRUE;
 }
 
 /* Query requisites method */
 
-gboolean on_handle_query_requisites(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_derivation)
+static gboolean start_query_requisites(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    gchar **derivation;
+    gboolean result;
     
-    if(log_fd != -1)
-    {
-        /* Print log entry */
-        dprintf(log_fd, "Query requisites from derivations: ");
-        print_paths(log_fd, (gchar**)arg_derivation);
-        dprintf(log_fd, "\n");
-        
-        /* Execute command */
-        signal_strv_result(pkgmgmt_query_requisites((gchar**)arg_derivation, log_fd), object, arg_pid, log_fd);
-    }
+    g_variant_get(parameters, "(i^a&s)", NULL, &derivation);
     
+    /* Print log entry */
+    dprintf(log_fd, "Query requisites from derivations: ");
+    print_paths(log_fd, derivation);
+    dprintf(log_fd, "\n");
+    
+    /* Execute command */
+    result = signal_strv_result(pkgmgmt_query_requisites(derivation, log_fd), object, jid, log_fd);
+    
+    g_free(derivation);
+    return result;
+}
+
+gboolean on_handle_query_requisites(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_derivation)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_query_requisites);
     org_nixos_disnix_disnix_complete_query_requisites(object, invocation);
     return TRUE;
 }
 
 /* Garbage collect method */
 
-gboolean on_handle_collect_garbage(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, gboolean arg_delete_old)
+static gboolean start_collect_garbage(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
-    
-    if(log_fd != -1)
-    {
-        /* Print log entry */
-        if(arg_delete_old)
-            dprintf(log_fd, "Garbage collect and remove old derivations\n");
-        else
-            dprintf(log_fd, "Garbage collect\n");
-    
-        /* Execute command */
-        signal_boolean_result(pkgmgmt_collect_garbage(arg_delete_old, log_fd, log_fd), object, arg_pid, log_fd);
-    }
+    gboolean delete_old;
+    g_variant_get(parameters, "(ib)", NULL, &delete_old);
     
+    /* Print log entry */
+    if(delete_old)
+        dprintf(log_fd, "Garbage collect and remove old derivations\n");
+    else
+        dprintf(log_fd, "Garbage collect\n");
+
+    /* Execute command */
+    return signal_boolean_result(pkgmgmt_collect_garbage(delete_old, log_fd, log_fd), object, jid, log_fd);
+}
+
+gboolean on_handle_collect_garbage(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, gboolean arg_delete_old)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_GC, start_collect_garbage);
     org_nixos_disnix_disnix_complete_collect_garbage(object, invocation);
     return TRUE;
 }
 
 /* Common dysnomia invocation function */
 
-static gboolean on_handle_dysnomia_activity(gchar *activity, OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_derivation, const gchar *arg_container, const gchar *arg_type, const gchar *const *arg_arguments)
+static gboolean start_dysnomia_activity(gchar *activity, OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    const gchar *derivation, *container, *type;
+    gchar **arguments;
+    gboolean result;
     
-    if(log_fd != -1)
-    {
-        /* Print log entry */
-        dprintf(log_fd, "%s: %s of type: %s in container: %s with arguments: ", activity, arg_derivation, arg_type, arg_container);
-        print_paths(log_fd, (gchar**)arg_arguments);
-        dprintf(log_fd, "\n");
+    g_variant_get(parameters, "(i&s&s&s^a&s)", NULL, &derivation, &container, &type, &arguments);
     
-        /* Execute command */
-        signal_boolean_result(statemgmt_run_dysnomia_activity((gchar*)arg_type, activity, (gchar*)arg_derivation, (gchar*)arg_container, (gchar**)arg_arguments, log_fd, log_fd), object, arg_pid, log_fd);
-    }
+    /* Print log entry */
+    dprintf(log_fd, "%s: %s of type: %s in container: %s with arguments: ", activity, derivation, type, container);
+    print_paths(log_fd, arguments);
+    dprintf(log_fd, "\n");
+
+    /* Execute command */
+    result = signal_boolean_result(statemgmt_run_dysnomia_activity((gchar*)type, activity, (gchar*)derivation, (gchar*)container, arguments, log_fd, log_fd), object, jid, log_fd);
     
-    org_nixos_disnix_disnix_complete_activate(object, invocation);
-    return TRUE;
+    g_free(arguments);
+    return result;
 }
 
 /* Activate method */
 
+static gboolean start_activate(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
+{
+    return start_dysnomia_activity("activate", object, jid, parameters, log_fd);
+}
+
 gboolean on_handle_activate(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_derivation, const gchar *arg_container, const gchar *arg_type, const gchar *const *arg_arguments)
 {
-    return on_handle_dysnomia_activity("activate", object, invocation, arg_pid, arg_derivation, arg_container, arg_type, arg_arguments);
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_ACTIVITY, start_activate);
+    org_nixos_disnix_disnix_complete_activate(object, invocation);
+    return TRUE;
 }
 
 /* Deactivate method */
 
+static gboolean start_deactivate(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
+{
+    return start_dysnomia_activity("deactivate", object, jid, parameters, log_fd);
+}
+
 gboolean on_handle_deactivate(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_derivation, const gchar *arg_container, const gchar *arg_type, const gchar *const *arg_arguments)
 {
-    return on_handle_dysnomia_activity("deactivate", object, invocation, arg_pid, arg_derivation, arg_container, arg_type, arg_arguments);
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_ACTIVITY, start_deactivate);
+    org_nixos_disnix_disnix_complete_deactivate(object, invocation);
+    return TRUE;
 }
 
 /* Lock method */
 
-gboolean on_handle_lock(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_profile)
+static gboolean start_lock(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    const gchar *profile;
+    GPtrArray *profile_manifest_array;
     
-    if(log_fd != -1)
+    g_variant_get(parameters, "(i&s)", NULL, &profile);
+    
+    /* Print log entry */
+    dprintf(log_fd, "Acquiring lock on profile: %s\n", profile);
+    
+    /* Lock the disnix instance */
+    profile_manifest_array = create_profile_manifest_array((gchar*)profile);
+    
+    if(profile_manifest_array == NULL)
     {
-        GPtrArray *profile_manifest_array;
-        
-        /* Print log entry */
-        dprintf(log_fd, "Acquiring lock on profile: %s\n", arg_profile);
-        
-        /* Lock the disnix instance */
-        profile_manifest_array = create_profile_manifest_array((gchar*)arg_profile);
+        dprintf(log_fd, "Corrupt profile manifest: a service or type is missing!\n");
+        emit_job_failure(object, jid);
+        close(log_fd);
+        return FALSE;
+    }
+    else
+    {
+        gboolean result = signal_boolean_result(acquire_locks_async(log_fd, profile_manifest_array, (gchar*)profile), object, jid, log_fd);
         
-        if(profile_manifest_array == NULL)
-        {
-            dprintf(log_fd, "Corrupt profile manifest: a service or type is missing!\n");
-            org_nixos_disnix_disnix_emit_failure(object, arg_pid);
-        }
-        else
-        {
-            signal_boolean_result(acquire_locks_async(log_fd, profile_manifest_array, (gchar*)arg_profile), object, arg_pid, log_fd);
-            
-            /* Cleanup */
-            delete_profile_manifest_array(profile_manifest_array);
-        }
+        /* Cleanup */
+        delete_profile_manifest_array(profile_manifest_array);
+        return result;
     }
-    
+}
+
+gboolean on_handle_lock(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_profile)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_lock);
     org_nixos_disnix_disnix_complete_lock(object, invocation);
     return TRUE;
 }
 
 /* Unlock method */
 
-gboolean on_handle_unlock(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_profile)
+static gboolean start_unlock(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    const gchar *profile;
+    GPtrArray *profile_manifest_array;
+    gboolean result;
     
-    if(log_fd != -1)
-    {
-        GPtrArray *profile_manifest_array;
-        
-        /* Print log entry */
-        dprintf(log_fd, "Releasing lock on profile: %s\n", arg_profile);
-
-        /* Unlock the Disnix instance */
-        profile_manifest_array = create_profile_manifest_array((gchar*)arg_profile);
-        signal_boolean_result(release_locks_async(log_fd, profile_manifest_array, (gchar*)arg_profile), object, arg_pid, log_fd);
-        
-       /* Cleanup */
-       delete_profile_manifest_array(profile_manifest_array);
-    }
+    g_variant_get(parameters, "(i&s)", NULL, &profile);
+    
+    /* Print log entry */
+    dprintf(log_fd, "Releasing lock on profile: %s\n", profile);
+    
+    /* Unlock the Disnix instance */
+    profile_manifest_array = create_profile_manifest_array((gchar*)profile);
+    result = signal_boolean_result(release_locks_async(log_fd, profile_manifest_array, (gchar*)profile), object, jid, log_fd);
     
+    /* Cleanup */
+    delete_profile_manifest_array(profile_manifest_array);
+    return result;
+}
+
+gboolean on_handle_unlock(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_profile)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_unlock);
     org_nixos_disnix_disnix_complete_unlock(object, invocation);
     return TRUE;
 }
 
 /* Snapshot method */
 
+static gboolean start_snapshot(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
+{
+    return start_dysnomia_activity("snapshot", object, jid, parameters, log_fd);
+}
+
 gboolean on_handle_snapshot(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_derivation, const gchar *arg_container, const gchar *arg_type, const gchar *const *arg_arguments)
 {
-    return on_handle_dysnomia_activity("snapshot", object, invocation, arg_pid, arg_derivation, arg_container, arg_type, arg_arguments);
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_ACTIVITY, start_snapshot);
+    org_nixos_disnix_disnix_complete_snapshot(object, invocation);
+    return TRUE;
 }
 
 /* Restore method */
 
+static gboolean start_restore(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
+{
+    return start_dysnomia_activity("restore", object, jid, parameters, log_fd);
+}
+
 gboolean on_handle_restore(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_derivation, const gchar *arg_container, const gchar *arg_type, const gchar *const *arg_arguments)
 {
-    return on_handle_dysnomia_activity("restore", object, invocation, arg_pid, arg_derivation, arg_container, arg_type, arg_arguments);
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_ACTIVITY, start_restore);
+    org_nixos_disnix_disnix_complete_restore(object, invocation);
+    return TRUE;
 }
 
 /* Query all snapshots method */
 
-gboolean on_handle_query_all_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_container, const gchar *arg_component)
+static gboolean start_query_all_snapshots(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    const gchar *container, *component;
+    g_variant_get(parameters, "(i&s&s)", NULL, &container, &component);
     
-    if(log_fd != -1)
-    {
-        /* Print log entry */
-        dprintf(log_fd, "Query all snapshots from container: %s and component: %s\n", arg_container, arg_component);
-        
-        /* Execute command */
-        signal_strv_result(statemgmt_query_all_snapshots((gchar*)arg_container, (gchar*)arg_component, log_fd), object, arg_pid, log_fd);
-    }
+    /* Print log entry */
+    dprintf(log_fd, "Query all snapshots from container: %s and component: %s\n", container, component);
     
+    /* Execute command */
+    return signal_strv_result(statemgmt_query_all_snapshots((gchar*)container, (gchar*)component, log_fd), object, jid, log_fd);
+}
+
+gboolean on_handle_query_all_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_container, const gchar *arg_component)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_query_all_snapshots);
     org_nixos_disnix_disnix_complete_query_all_snapshots(object, invocation);
     return TRUE;
 }
 
 /* Query latest snapshot method */
 
-gboolean on_handle_query_latest_snapshot(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_container, const gchar *arg_component)
+static gboolean start_query_latest_snapshot(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
-    
-    if(log_fd != -1)
-    {
-        /* Print log entry */
-        dprintf(log_fd, "Query latest snapshot from container: %s and component: %s\n", arg_container, arg_component);
-    
-        /* Execute command */
-        signal_strv_result(statemgmt_query_latest_snapshot((gchar*)arg_container, (gchar*)arg_component, log_fd), object, arg_pid, log_fd);
-    }
+    const gchar *container, *component;
+    g_variant_get(parameters, "(i&s&s)", NULL, &container, &component);
     
+    /* Print log entry */
+    dprintf(log_fd, "Query latest snapshot from container: %s and component: %s\n", container, component);
+
+    /* Execute command */
+    return signal_strv_result(statemgmt_query_latest_snapshot((gchar*)container, (gchar*)component, log_fd), object, jid, log_fd);
+}
+
+gboolean on_handle_query_latest_snapshot(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_container, const gchar *arg_component)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_query_latest_snapshot);
     org_nixos_disnix_disnix_complete_query_latest_snapshot(object, invocation);
     return TRUE;
 }
 
 /* Query missing snapshots method */
 
-gboolean on_handle_print_missing_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_component)
+static gboolean start_print_missing_snapshots(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    gchar **component;
+    gboolean result;
     
-    if(log_fd != -1)
-    {
-        /* Print log entry */
-        dprintf(log_fd, "Print missing snapshots: ");
-        print_paths(log_fd, (gchar**)arg_component);
-        dprintf(log_fd, "\n");
-        
-        /* Execute command */
-        signal_strv_result(statemgmt_print_missing_snapshots((gchar**)arg_component, log_fd), object, arg_pid, log_fd);
-    }
+    g_variant_get(parameters, "(i^a&s)", NULL, &component);
+    
+    /* Print log entry */
+    dprintf(log_fd, "Print missing snapshots: ");
+    print_paths(log_fd, component);
+    dprintf(log_fd, "\n");
+    
+    /* Execute command */
+    result = signal_strv_result(statemgmt_print_missing_snapshots(component, log_fd), object, jid, log_fd);
     
+    g_free(component);
+    return result;
+}
+
+gboolean on_handle_print_missing_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_component)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_print_missing_snapshots);
     org_nixos_disnix_disnix_complete_print_missing_snapshots(object, invocation);
     return TRUE;
 }
 
 /* Import snapshots operation */
 
-gboolean on_handle_import_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_container, const gchar *arg_component, const gchar *const *arg_snapshots)
+static gboolean start_import_snapshots(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    const gchar *container, *component;
+    gchar **snapshots;
+    gboolean result;
     
-    if(log_fd != -1)
-    {
-        /* Print log entry */
-        dprintf(log_fd, "Import snapshots: ");
-        print_paths(log_fd, (gchar**)arg_snapshots);
-        dprintf(log_fd, "\n");
-        
-        /* Execute command */
-        signal_boolean_result(statemgmt_import_snapshots((gchar*)arg_container, (gchar*)arg_component, (gchar**)arg_snapshots, log_fd, log_fd), object, arg_pid, log_fd);
-    }
+    g_variant_get(parameters, "(i&s&s^a&s)", NULL, &container, &component, &snapshots);
+    
+    /* Print log entry */
+    dprintf(log_fd, "Import snapshots: ");
+    print_paths(log_fd, snapshots);
+    dprintf(log_fd, "\n");
     
+    /* Execute command */
+    result = signal_boolean_result(statemgmt_import_snapshots((gchar*)container, (gchar*)component, snapshots, log_fd, log_fd), object, jid, log_fd);
+    
+    g_free(snapshots);
+    return result;
+}
+
+gboolean on_handle_import_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_container, const gchar *arg_component, const gchar *const *arg_snapshots)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_IMPORT, start_import_snapshots);
     org_nixos_disnix_disnix_complete_import_snapshots(object, invocation);
     return TRUE;
 }
 
 /* Resolve snapshots operation */
 
-gboolean on_handle_resolve_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_snapshots)
+static gboolean start_resolve_snapshots(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    gchar **snapshots;
+    gboolean result;
     
-    if(log_fd != -1)
-    {
-        /* Print log entry */
-        dprintf(log_fd, "Resolve snapshots: ");
-        print_paths(log_fd, (gchar**)arg_snapshots);
-        dprintf(log_fd, "\n");
-        
-        /* Execute command */
-        signal_strv_result(statemgmt_resolve_snapshots((gchar**)arg_snapshots, log_fd), object, arg_pid, log_fd);
-    }
+    g_variant_get(parameters, "(i^a&s)", NULL, &snapshots);
+    
+    /* Print log entry */
+    dprintf(log_fd, "Resolve snapshots: ");
+    print_paths(log_fd, snapshots);
+    dprintf(log_fd, "\n");
     
+    /* Execute command */
+    result = signal_strv_result(statemgmt_resolve_snapshots(snapshots, log_fd), object, jid, log_fd);
+    
+    g_free(snapshots);
+    return result;
+}
+
+gboolean on_handle_resolve_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_snapshots)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_resolve_snapshots);
     org_nixos_disnix_disnix_complete_resolve_snapshots(object, invocation);
     return TRUE;
 }
 
 /* Clean snapshots method */
 
-gboolean on_handle_clean_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, gint arg_keep, const gchar *arg_container, const char *arg_component)
+static gboolean start_clean_snapshots(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
 {
-    int log_fd = open_log_file(object, arg_pid);
+    gint keep;
+    const gchar *container, *component;
     
-    if(log_fd != -1)
-    {
-        /* Print log entry */
-        dprintf(log_fd, "Clean old snapshots");
-        
-        if(g_strcmp0(arg_container, "") != 0)
-            dprintf(log_fd, " for container: %s", arg_container);
-        
-        if(g_strcmp0(arg_component, "") != 0)
-            dprintf(log_fd, " for component: %s", arg_component);
-        
-        dprintf(log_fd, " num of generations to keep: %d!\n", arg_keep);
-        
-        /* Execute command */
-        signal_boolean_result(statemgmt_clean_snapshots(arg_keep, (gchar*)arg_container, (gchar*)arg_component, log_fd, log_fd), object, arg_pid, log_fd);
-    }
+    g_variant_get(parameters, "(ii&s&s)", NULL, &keep, &container, &component);
     
+    /* Print log entry */
+    dprintf(log_fd, "Clean old snapshots");
+    
+    if(g_strcmp0(container, "") != 0)
+        dprintf(log_fd, " for container: %s", container);
+    
+    if(g_strcmp0(component, "") != 0)
+        dprintf(log_fd, " for component: %s", component);
+    
+    dprintf(log_fd, " num of generations to keep: %d!\n", keep);
+    
+    /* Execute command */
+    return signal_boolean_result(statemgmt_clean_snapshots(keep, (gchar*)container, (gchar*)component, log_fd, log_fd), object, jid, log_fd);
+}
+
+gboolean on_handle_clean_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, gint arg_keep, const gchar *arg_container, const char *arg_component)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_ACTIVITY, start_clean_snapshots);
     org_nixos_disnix_disnix_complete_clean_snapshots(object, invocation);
     return TRUE;
 }
 
+/* Copy snapshots from peer method */
+
+static gboolean start_copy_snapshots_from_peer(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
+{
+    const gchar *peer, *peer_interface, *container, *component;
+    g_variant_get(parameters, "(i&s&s&s&s)", NULL, &peer, &peer_interface, &container, &component);
+    
+    /* Print log entry */
+    dprintf(log_fd, "Copying snapshots of component: %s in container: %s from peer: %s through interface: %s\n", component, container, peer, peer_interface);
+    
+    /* Execute command */
+    return signal_boolean_result(statemgmt_copy_snapshots_from((gchar*)peer_interface, (gchar*)peer, (gchar*)container, (gchar*)component, log_fd, log_fd), object, jid, log_fd);
+}
+
+gboolean on_handle_copy_snapshots_from_peer(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_peer, const gchar *arg_peer_interface, const gchar *arg_container, const gchar *arg_component)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_IMPORT, start_copy_snapshots_from_peer);
+    org_nixos_disnix_disnix_complete_copy_snapshots_from_peer(object, invocation);
+    return TRUE;
+}
+
 /* Delete state operation */
 
+static gboolean start_delete_state(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
+{
+    return start_dysnomia_activity("collect-garbage", object, jid, parameters, log_fd);
+}
+
 gboolean on_handle_delete_state(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_derivation, const gchar *arg_container, const gchar *arg_type, const gchar *const *arg_arguments)
 {
-    return on_handle_dysnomia_activity("collect-garbage", object, invocation, arg_pid, arg_derivation, arg_container, arg_type, arg_arguments);
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_ACTIVITY, start_delete_state);
+    org_nixos_disnix_disnix_complete_delete_state(object, invocation);
+    return TRUE;
 }
 
 /* Get logdir operation */
@@ -470,19 +767,213 @@ gboolean on_handle_get_logdir(OrgNixosDisnixDisnix *object, GDBusMethodInvocatio
 
 /* Capture config operation */
 
+static gboolean start_capture_config(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
+{
+    pid_t pid = -1;
+    int temp_fd;
+    gchar *tempfilename = statemgmt_capture_config(tmpdir, log_fd, &pid, &temp_fd);
+    
+    return signal_tempfile_result(pid, tempfilename, temp_fd, object, jid, log_fd);
+}
+
 gboolean on_handle_capture_config(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid)
+{
+    schedule_job(object, invocation, arg_pid, JOB_CLASS_QUERY, start_capture_config);
+    org_nixos_disnix_disnix_complete_capture_config(object, invocation);
+    return TRUE;
+}
+
+/* Capture config stream operation */
+
+static gboolean start_capture_config_stream(OrgNixosDisnixDisnix *object, gint jid, GVariant *parameters, int log_fd)
+{
+    int stream_fd = take_stream(jid);
+    pid_t pid = statemgmt_capture_config_fd(stream_fd, log_fd);
+    
+    close(stream_fd);
+    return signal_boolean_result(pid, object, jid, log_fd);
+}
+
+gboolean on_handle_capture_config_stream(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, GUnixFDList *fd_list, gint arg_pid)
+{
+    GUnixFDList *stream_fd_list = schedule_stream_job(object, invocation, arg_pid, start_capture_config_stream);
+    
+    if(stream_fd_list != NULL)
+    {
+        org_nixos_disnix_disnix_complete_capture_config_stream(object, invocation, stream_fd_list, g_variant_new_handle(0));
+        g_object_unref(stream_fd_list);
+    }
+    
+    return TRUE;
+}
+
+/* Query garbage collection generation operation */
+
+gboolean on_handle_query_gc_generation(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid)
 {
     int log_fd = open_log_file(object, arg_pid);
     
     if(log_fd != -1)
     {
-        pid_t pid;
-        int temp_fd;
-        gchar *tempfilename = statemgmt_capture_config(tmpdir, log_fd, &pid, &temp_fd);
+        gchar *generation = pkgmgmt_query_gc_generation();
+        const gchar *result[] = { generation, NULL };
+        
+        /* Print log entry */
+        dprintf(log_fd, "Query garbage collection generation: %s\n", generation);
         
-        signal_tempfile_result(pid, tempfilename, temp_fd, object, arg_pid, log_fd);
+        emit_job_success(object, arg_pid, result);
+        
+        /* Cleanup */
+        g_free(generation);
+        close(log_fd);
+    }
+    
+    org_nixos_disnix_disnix_complete_query_gc_generation(object, invocation);
+    return TRUE;
+}
+
+/* Submit batch operation */
+
+/*
+ * The operations of a batch are the activities and locking operations that
+ * can otherwise be requested by separate method calls. Each operation runs as
+ * a separate job in its own class and gets its own job id, so that it can be
+ * followed in the same way.
+ */
+
+typedef struct
+{
+    const gchar *name;
+    JobClass job_class;
+    start_job_function start_job;
+    gboolean takes_profile;
+}
+BatchOperation;
+
+static const BatchOperation batch_operations[] = {
+    { "activate", JOB_CLASS_ACTIVITY, start_activate, FALSE },
+    { "deactivate", JOB_CLASS_ACTIVITY, start_deactivate, FALSE },
+    { "snapshot", JOB_CLASS_ACTIVITY, start_snapshot, FALSE },
+    { "restore", JOB_CLASS_ACTIVITY, start_restore, FALSE },
+    { "delete-state", JOB_CLASS_ACTIVITY, start_delete_state, FALSE },
+    { "lock", JOB_CLASS_QUERY, start_lock, TRUE },
+    { "unlock", JOB_CLASS_QUERY, start_unlock, TRUE },
+    { NULL, JOB_CLASS_QUERY, NULL, FALSE }
+};
+
+static const BatchOperation *find_batch_operation(const gchar *name)
+{
+    unsigned int i;
+    
+    for(i = 0; batch_operations[i].name != NULL; i++)
+    {
+        if(g_strcmp0(batch_operations[i].name, name) == 0)
+            return &batch_operations[i];
+    }
+    
+    return NULL;
+}
+
+static gboolean check_batch_operations(GDBusMethodInvocation *invocation, GVariant *operations)
+{
+    gsize i;
+    
+    for(i = 0; i < g_variant_n_children(operations); i++)
+    {
+        const gchar *operation;
+        GVariant *dependencies;
+        gsize j;
+        
+        g_variant_get_child(operations, i, "(&s&s&s&sas@ai)", &operation, NULL, NULL, NULL, NULL, &dependencies);
+        
+        if(find_batch_operation(operation) == NULL)
+        {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "Operation %u has an unsupported type: %s", (unsigned int)i, operation);
+            g_variant_unref(dependencies);
+            return FALSE;
+        }
+        
+        /* Dependencies must refer to earlier operations, which rules out cycles */
+        for(j = 0; j < g_variant_n_children(dependencies); j++)
+        {
+            gint dependency;
+            
+            g_variant_get_child(dependencies, j, "i", &dependency);
+            
+            if(dependency < 0 || (gsize)dependency >= i)
+            {
+                g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "Operation %u depends on operation %d, which does not precede it", (unsigned int)i, dependency);
+                g_variant_unref(dependencies);
+                return FALSE;
+            }
+        }
+        
+        g_variant_unref(dependencies);
+    }
+    
+    return TRUE;
+}
+
+static GArray *create_dependency_array(GVariant *dependencies)
+{
+    GArray *dependency_array = g_array_new(FALSE, FALSE, sizeof(guint));
+    gsize i;
+    
+    for(i = 0; i < g_variant_n_children(dependencies); i++)
+    {
+        gint dependency;
+        guint index;
+        
+        g_variant_get_child(dependencies, i, "i", &dependency);
+        index = dependency;
+        g_array_append_val(dependency_array, index);
+    }
+    
+    return dependency_array;
+}
+
+gboolean on_handle_submit_batch(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, GVariant *arg_operations)
+{
+    if(check_batch_operations(invocation, arg_operations))
+    {
+        const gchar *sender = g_dbus_method_invocation_get_sender(invocation);
+        GPtrArray *item_array = g_ptr_array_new();
+        GVariantBuilder builder;
+        gsize i;
+        
+        g_variant_builder_init(&builder, G_VARIANT_TYPE("ai"));
+        
+        for(i = 0; i < g_variant_n_children(arg_operations); i++)
+        {
+            const gchar *operation, *derivation, *container, *type;
+            GVariant *arguments, *dependencies, *parameters;
+            const BatchOperation *batch_operation;
+            gint jid = assign_pid();
+            
+            g_variant_get_child(arg_operations, i, "(&s&s&s&s@as@ai)", &operation, &derivation, &container, &type, &arguments, &dependencies);
+            batch_operation = find_batch_operation(operation);
+            
+            /* Compose the parameters of the method call that normally requests the operation */
+            if(batch_operation->takes_profile)
+                parameters = g_variant_new("(is)", jid, derivation);
+            else
+                parameters = g_variant_new("(isss@as)", jid, derivation, container, type, arguments);
+            
+            set_job_destination(jid, sender);
+            g_variant_builder_add(&builder, "i", jid);
+            g_ptr_array_add(item_array, create_batch_item(i, jid, parameters, batch_operation->job_class, batch_operation->start_job, create_dependency_array(dependencies)));
+            
+            /* Cleanup */
+            g_variant_unref(arguments);
+            g_variant_unref(dependencies);
+        }
+        
+        g_printerr("Assigned job ids of a batch of %u operations\n", item_array->len);
+        
+        /* Reply with the job ids before any of them can complete */
+        org_nixos_disnix_disnix_complete_submit_batch(object, invocation, g_variant_builder_end(&builder));
+        start_batch(object, arg_pid, item_array);
     }
     
-    org_nixos_disnix_disnix_complete_capture_config(object, invocation);
     return TRUE;
 }
@@ -19,6 +19,7 @@
 
 #ifndef __DISNIX_METHODS_H
 #define __DISNIX_METHODS_H
+#include <gio/gunixfdlist.h>
 #include "disnix-dbus.h"
 
 gboolean on_handle_get_job_id(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation);
@@ -27,8 +28,12 @@ gboolean on_handle_import(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *i
 
 gboolean on_handle_export(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_derivation);
 
+gboolean on_handle_export_stream(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, GUnixFDList *fd_list, gint arg_pid, const gchar *const *arg_derivation);
+
 gboolean on_handle_print_invalid(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_derivation);
 
+gboolean on_handle_copy_from_peer(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_peer, const gchar *arg_peer_interface, const gchar *const *arg_paths);
+
 gboolean on_handle_realise(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *const *arg_derivation);
 
 gboolean on_handle_set(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_profile, const gchar *arg_derivation);
@@ -63,10 +68,18 @@ gboolean on_handle_resolve_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodIn
 
 gboolean on_handle_clean_snapshots(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, gint arg_keep, const gchar *arg_container, const char *arg_component);
 
+gboolean on_handle_copy_snapshots_from_peer(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_peer, const gchar *arg_peer_interface, const gchar *arg_container, const gchar *arg_component);
+
 gboolean on_handle_delete_state(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, const gchar *arg_derivation, const gchar *arg_container, const gchar *arg_type, const gchar *const *arg_arguments);
 
 gboolean on_handle_get_logdir(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation);
 
 gboolean on_handle_capture_config(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid);
 
+gboolean on_handle_capture_config_stream(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, GUnixFDList *fd_list, gint arg_pid);
+
+gboolean on_handle_query_gc_generation(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid);
+
+gboolean on_handle_submit_batch(OrgNixosDisnixDisnix *object, GDBusMethodInvocation *invocation, gint arg_pid, GVariant *arg_operations);
+
 #endif
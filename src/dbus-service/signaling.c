@@ -20,7 +20,64 @@
 #include "signaling.h"
 #include <stdio.h>
 #include <sys/stat.h>
-#include <procreact_pid.h>
+#include <sys/wait.h>
+#include "jobmanagement.h"
+#include "batch.h"
+
+/*
+ * Completions are observed by child watches and file descriptor watches on
+ * the main loop of the service, so that waiting for a job does not occupy a
+ * thread.
+ */
+
+/* Completion signals */
+
+static void emit_job_signal(OrgNixosDisnixDisnix *object, gint jid, const gchar *signal_name, GVariant *parameters)
+{
+    GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON(object);
+    GDBusConnection *connection = g_dbus_interface_skeleton_get_connection(skeleton);
+    gchar *destination = take_job_destination(jid);
+    
+    /* Without a requesting client, for example because it has disconnected, nobody waits for the signal */
+    if(connection == NULL || destination == NULL)
+        g_variant_unref(g_variant_ref_sink(parameters));
+    else
+    {
+        GError *error = NULL;
+        
+        /* Deliver the signal to the requesting client only */
+        if(!g_dbus_connection_emit_signal(connection, destination, g_dbus_interface_skeleton_get_object_path(skeleton), g_dbus_interface_skeleton_get_info(skeleton)->name, signal_name, parameters, &error))
+        {
+            g_printerr("Cannot emit the %s signal of job id: %d! Reason: %s\n", signal_name, jid, error->message);
+            g_error_free(error);
+        }
+    }
+    
+    g_free(destination);
+}
+
+void emit_job_finish(OrgNixosDisnixDisnix *object, gint jid)
+{
+    emit_job_signal(object, jid, "finish", g_variant_new("(i)", jid));
+    complete_batch_item(jid, TRUE);
+}
+
+void emit_job_success(OrgNixosDisnixDisnix *object, gint jid, const gchar *const *result)
+{
+    emit_job_signal(object, jid, "success", g_variant_new("(i^as)", jid, result));
+    complete_batch_item(jid, TRUE);
+}
+
+void emit_job_failure(OrgNixosDisnixDisnix *object, gint jid)
+{
+    emit_job_signal(object, jid, "failure", g_variant_new("(i)", jid));
+    complete_batch_item(jid, FALSE);
+}
+
+static int process_has_succeeded(gint status)
+{
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
 
 /* Boolean signaling infrastructure */
 
@@ -29,40 +86,46 @@ typedef struct
     OrgNixosDisnixDisnix *object;
     gint jid;
     int log_fd;
-    pid_t pid;
 }
-SignalBooleanResultThreadData;
+SignalBooleanResultData;
 
-static gpointer signal_boolean_result_thread_func(gpointer data)
+static void on_boolean_process_exit(GPid pid, gint status, gpointer data)
 {
-    ProcReact_Status status;
-    SignalBooleanResultThreadData *boolean_data = (SignalBooleanResultThreadData*)data;
-    int result = procreact_wait_for_boolean(boolean_data->pid, &status);
+    SignalBooleanResultData *boolean_data = (SignalBooleanResultData*)data;
     
-    if(status == PROCREACT_STATUS_OK && result)
-        org_nixos_disnix_disnix_emit_finish(boolean_data->object, boolean_data->jid);
+    if(process_has_succeeded(status))
+        emit_job_finish(boolean_data->object, boolean_data->jid);
     else
-        org_nixos_disnix_disnix_emit_failure(boolean_data->object, boolean_data->jid);
+        emit_job_failure(boolean_data->object, boolean_data->jid);
+    
+    finish_job(boolean_data->jid);
     
     /* Cleanup */
-    g_free(boolean_data);
     close(boolean_data->log_fd);
-    
-    return NULL;
+    g_object_unref(boolean_data->object);
+    g_free(boolean_data);
+    g_spawn_close_pid(pid);
 }
 
-void signal_boolean_result(pid_t pid, OrgNixosDisnixDisnix *object, gint jid, int log_fd)
+gboolean signal_boolean_result(pid_t pid, OrgNixosDisnixDisnix *object, gint jid, int log_fd)
 {
-    GThread *thread;
-    SignalBooleanResultThreadData *data = (SignalBooleanResultThreadData*)g_malloc(sizeof(SignalBooleanResultThreadData));
-    
-    data->object = object;
-    data->jid = jid;
-    data->log_fd = log_fd;
-    data->pid = pid;
-    
-    thread = g_thread_new("evaluate-boolean", signal_boolean_result_thread_func, data);
-    g_thread_unref(thread);
+    if(pid == -1)
+    {
+        emit_job_failure(object, jid);
+        close(log_fd);
+        return FALSE;
+    }
+    else
+    {
+        SignalBooleanResultData *data = (SignalBooleanResultData*)g_malloc(sizeof(SignalBooleanResultData));
+        
+        data->object = g_object_ref(object);
+        data->jid = jid;
+        data->log_fd = log_fd;
+        
+        g_child_watch_add(pid, on_boolean_process_exit, data);
+        return TRUE;
+    }
 }
 
 /* String vector signaling infrastructure */
@@ -73,42 +136,65 @@ typedef struct
     gint jid;
     int log_fd;
     ProcReact_Future future;
+    void *state;
 }
-SignalStrvResultThreadData;
+SignalStrvResultData;
 
-static gpointer signal_strv_result_thread_func(gpointer data)
+static gboolean on_strv_output(GIOChannel *channel, GIOCondition condition, gpointer data)
 {
-    SignalStrvResultThreadData *strv_data = (SignalStrvResultThreadData*)data;
-    ProcReact_Status status;
-    char **result = procreact_future_get(&strv_data->future, &status);
+    SignalStrvResultData *strv_data = (SignalStrvResultData*)data;
     
-    if(status != PROCREACT_STATUS_OK || result == NULL)
-        org_nixos_disnix_disnix_emit_failure(strv_data->object, strv_data->jid);
+    /* Consume the output that is available without blocking */
+    if(strv_data->future.type.append(&strv_data->future.type, strv_data->state, strv_data->future.fd) > 0)
+        return TRUE;
     else
     {
-        org_nixos_disnix_disnix_emit_success(strv_data->object, strv_data->jid, (const gchar**)result);
-        procreact_free_string_array(result);
+        /* The process has closed its output, so it is about to terminate */
+        ProcReact_Status status;
+        char **result = strv_data->future.type.finalize(strv_data->state, strv_data->future.pid, &status);
+        
+        if(status != PROCREACT_STATUS_OK || result == NULL)
+            emit_job_failure(strv_data->object, strv_data->jid);
+        else
+            emit_job_success(strv_data->object, strv_data->jid, (const gchar**)result);
+        
+        finish_job(strv_data->jid);
+        
+        /* Cleanup */
+        if(result != NULL)
+            procreact_free_string_array(result);
+        
+        procreact_destroy_future(&strv_data->future);
+        close(strv_data->log_fd);
+        g_object_unref(strv_data->object);
+        g_free(strv_data);
+        return FALSE;
     }
-    
-    /* Cleanup */
-    g_free(strv_data);
-    close(strv_data->log_fd);
-    
-    return NULL;
 }
 
-void signal_strv_result(ProcReact_Future future, OrgNixosDisnixDisnix *object, gint jid, int log_fd)
+gboolean signal_strv_result(ProcReact_Future future, OrgNixosDisnixDisnix *object, gint jid, int log_fd)
 {
-    GThread *thread;
-    SignalStrvResultThreadData *data = (SignalStrvResultThreadData*)g_malloc(sizeof(SignalStrvResultThreadData));
-    
-    data->object = object;
-    data->jid = jid;
-    data->log_fd = log_fd;
-    data->future = future;
-    
-    thread = g_thread_new("evaluate-strv", signal_strv_result_thread_func, data);
-    g_thread_unref(thread);
+    if(future.pid == -1)
+    {
+        emit_job_failure(object, jid);
+        close(log_fd);
+        return FALSE;
+    }
+    else
+    {
+        GIOChannel *channel = g_io_channel_unix_new(future.fd);
+        SignalStrvResultData *data = (SignalStrvResultData*)g_malloc(sizeof(SignalStrvResultData));
+        
+        data->object = g_object_ref(object);
+        data->jid = jid;
+        data->log_fd = log_fd;
+        data->future = future;
+        data->state = future.type.initialize();
+        
+        g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR, on_strv_output, data);
+        g_io_channel_unref(channel); /* The watch keeps its own reference */
+        return TRUE;
+    }
 }
 
 /* Temp file signaling infrastructure */
@@ -118,52 +204,151 @@ typedef struct
     OrgNixosDisnixDisnix *object;
     gint jid;
     int log_fd;
-    pid_t pid;
     gchar *tempfilename;
     int temp_fd;
 }
-SignalTempFileResultThreadData;
+SignalTempFileResultData;
 
-static gpointer evaluate_tempfile_process_thread_func(gpointer data)
+static void on_tempfile_process_exit(GPid pid, gint status, gpointer data)
 {
-    SignalTempFileResultThreadData *tempfile_data = (SignalTempFileResultThreadData*)data;
-    ProcReact_Status status;
-    int result = procreact_wait_for_boolean(tempfile_data->pid, &status);
-
-    if(status == PROCREACT_STATUS_OK && result)
+    SignalTempFileResultData *tempfile_data = (SignalTempFileResultData*)data;
+    
+    if(process_has_succeeded(status))
     {
         const gchar *tempfilepaths[] = { tempfile_data->tempfilename, NULL };
         
-        if(fchmod(tempfile_data->temp_fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == 1)
+        if(fchmod(tempfile_data->temp_fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == -1)
         {
             dprintf(tempfile_data->log_fd, "Cannot change permissions of tempfile: %s\n", tempfile_data->tempfilename);
-            org_nixos_disnix_disnix_emit_failure(tempfile_data->object, tempfile_data->jid);
+            emit_job_failure(tempfile_data->object, tempfile_data->jid);
         }
         else
-            org_nixos_disnix_disnix_emit_success(tempfile_data->object, tempfile_data->jid, tempfilepaths);
+            emit_job_success(tempfile_data->object, tempfile_data->jid, tempfilepaths);
     }
+    else
+        emit_job_failure(tempfile_data->object, tempfile_data->jid);
     
-    g_free(tempfile_data->tempfilename);
+    finish_job(tempfile_data->jid);
     
     /* Cleanup */
+    g_free(tempfile_data->tempfilename);
     close(tempfile_data->log_fd);
     close(tempfile_data->temp_fd);
-    
-    return NULL;
+    g_object_unref(tempfile_data->object);
+    g_free(tempfile_data);
+    g_spawn_close_pid(pid);
 }
 
-void signal_tempfile_result(pid_t pid, gchar *tempfilename, int temp_fd, OrgNixosDisnixDisnix *object, gint jid, int log_fd)
+gboolean signal_tempfile_result(pid_t pid, gchar *tempfilename, int temp_fd, OrgNixosDisnixDisnix *object, gint jid, int log_fd)
 {
-    GThread *thread;
-    SignalTempFileResultThreadData *data = (SignalTempFileResultThreadData*)g_malloc(sizeof(SignalTempFileResultThreadData));
+    if(pid == -1)
+    {
+        emit_job_failure(object, jid);
+        close(log_fd);
+        
+        if(tempfilename != NULL)
+        {
+            close(temp_fd);
+            unlink(tempfilename);
+            g_free(tempfilename);
+        }
+        
+        return FALSE;
+    }
+    else
+    {
+        SignalTempFileResultData *data = (SignalTempFileResultData*)g_malloc(sizeof(SignalTempFileResultData));
+        
+        data->object = g_object_ref(object);
+        data->jid = jid;
+        data->log_fd = log_fd;
+        data->tempfilename = tempfilename;
+        data->temp_fd = temp_fd;
+        
+        g_child_watch_add(pid, on_tempfile_process_exit, data);
+        return TRUE;
+    }
+}
+
+/* Merged boolean signaling infrastructure */
+
+typedef struct
+{
+    OrgNixosDisnixDisnix *object;
+    gint *jids;
+    int *log_fds;
+    unsigned int num_of_jobs;
+    ProcReact_Future future;
+    void *state;
+}
+SignalMergedBooleanResultsData;
+
+static void emit_merged_boolean_results(OrgNixosDisnixDisnix *object, const gint *jids, const int *log_fds, unsigned int num_of_jobs, char **result)
+{
+    unsigned int i;
     
-    data->object = object;
-    data->jid = jid;
-    data->log_fd = log_fd;
-    data->pid = pid;
-    data->tempfilename = tempfilename;
-    data->temp_fd = temp_fd;
+    for(i = 0; i < num_of_jobs; i++)
+    {
+        /* A job without a reported outcome is considered to have failed */
+        if(result != NULL && i < g_strv_length(result) && g_strcmp0(result[i], "1") == 0)
+            emit_job_finish(object, jids[i]);
+        else
+            emit_job_failure(object, jids[i]);
+        
+        close(log_fds[i]);
+    }
+}
+
+static gboolean on_merged_boolean_output(GIOChannel *channel, GIOCondition condition, gpointer data)
+{
+    SignalMergedBooleanResultsData *merged_data = (SignalMergedBooleanResultsData*)data;
     
-    thread = g_thread_new("evaluate-tempfile", evaluate_tempfile_process_thread_func, data);
-    g_thread_unref(thread);
+    /* Consume the output that is available without blocking */
+    if(merged_data->future.type.append(&merged_data->future.type, merged_data->state, merged_data->future.fd) > 0)
+        return TRUE;
+    else
+    {
+        /* The process has closed its output, so it is about to terminate */
+        ProcReact_Status status;
+        char **result = merged_data->future.type.finalize(merged_data->state, merged_data->future.pid, &status);
+        
+        emit_merged_boolean_results(merged_data->object, merged_data->jids, merged_data->log_fds, merged_data->num_of_jobs, status == PROCREACT_STATUS_OK ? result : NULL);
+        finish_job(merged_data->jids[0]);
+        
+        /* Cleanup */
+        if(result != NULL)
+            procreact_free_string_array(result);
+        
+        procreact_destroy_future(&merged_data->future);
+        g_free(merged_data->jids);
+        g_free(merged_data->log_fds);
+        g_object_unref(merged_data->object);
+        g_free(merged_data);
+        return FALSE;
+    }
+}
+
+gboolean signal_merged_boolean_results(ProcReact_Future future, OrgNixosDisnixDisnix *object, const gint *jids, const int *log_fds, unsigned int num_of_jobs)
+{
+    if(future.pid == -1)
+    {
+        emit_merged_boolean_results(object, jids, log_fds, num_of_jobs, NULL);
+        return FALSE;
+    }
+    else
+    {
+        GIOChannel *channel = g_io_channel_unix_new(future.fd);
+        SignalMergedBooleanResultsData *data = (SignalMergedBooleanResultsData*)g_malloc(sizeof(SignalMergedBooleanResultsData));
+        
+        data->object = g_object_ref(object);
+        data->jids = (gint*)g_memdup(jids, num_of_jobs * sizeof(gint));
+        data->log_fds = (int*)g_memdup(log_fds, num_of_jobs * sizeof(int));
+        data->num_of_jobs = num_of_jobs;
+        data->future = future;
+        data->state = future.type.initialize();
+        
+        g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR, on_merged_boolean_output, data);
+        g_io_channel_unref(channel); /* The watch keeps its own reference */
+        return TRUE;
+    }
 }
@@ -26,31 +26,62 @@
 #include "disnix-dbus.h"
 
 /**
- * Spawns a thread that waits for process to complete and propagates a finish
- * signal when it yields TRUE or a failure signal when it yiels FALSE.
+ * Propagates a finish signal for a job to the client that requested it.
+ *
+ * @param object A Disnix DBus interface object
+ * @param jid Job ID of the job
+ */
+void emit_job_finish(OrgNixosDisnixDisnix *object, gint jid);
+
+/**
+ * Propagates a success signal with a result for a job to the client that
+ * requested it.
+ *
+ * @param object A Disnix DBus interface object
+ * @param jid Job ID of the job
+ * @param result NULL-terminated array of strings
+ */
+void emit_job_success(OrgNixosDisnixDisnix *object, gint jid, const gchar *const *result);
+
+/**
+ * Propagates a failure signal for a job to the client that requested it.
+ *
+ * @param object A Disnix DBus interface object
+ * @param jid Job ID of the job
+ */
+void emit_job_failure(OrgNixosDisnixDisnix *object, gint jid);
+
+/**
+ * Watches a process from the main loop and propagates a finish signal when it
+ * yields TRUE or a failure signal when it yiels FALSE. Upon completion, the
+ * log file is closed and finish_job() is invoked.
  *
  * @param pid PID of the running process
  * @param object A Disnix DBus interface object
  * @param jid Job ID of the running process
  * @param log_fd File descriptor of the job's logfile
+ * @return TRUE if the process is being watched, FALSE if it could not be started and a failure signal has been propagated
  */
-void signal_boolean_result(pid_t pid, OrgNixosDisnixDisnix *object, gint jid, int log_fd);
+gboolean signal_boolean_result(pid_t pid, OrgNixosDisnixDisnix *object, gint jid, int log_fd);
 
 /**
- * Spawns a thread that waits for future to complete and propagates a success
+ * Reads the output of a future from the main loop and propagates a success
  * signal with the result if it succeeds or a failure signal when it fails.
+ * Upon completion, the log file is closed and finish_job() is invoked.
  *
  * @param future Future delivering a string vector
  * @param object A Disnix DBus interface object
  * @param jid Job ID of the running process
  * @param log_fd File descriptor of the job's logfile
+ * @return TRUE if the future is being watched, FALSE if it could not be started and a failure signal has been propagated
  */
-void signal_strv_result(ProcReact_Future future, OrgNixosDisnixDisnix *object, gint jid, int log_fd);
+gboolean signal_strv_result(ProcReact_Future future, OrgNixosDisnixDisnix *object, gint jid, int log_fd);
 
 /**
- * Spawns a thread that waits for process that writes to a tempfile to complete
- * and propagates a success signal with the correspondng path if it succeeds or
- * a failure signal when it fails.
+ * Watches a process that writes to a tempfile from the main loop and
+ * propagates a success signal with the correspondng path if it succeeds or
+ * a failure signal when it fails. Upon completion, the log file is closed and
+ * finish_job() is invoked.
  *
  * @param pid PID of the running process
  * @param tempfilename String containing the path to the tempfile
@@ -58,7 +89,23 @@ void signal_strv_result(ProcReact_Future future, OrgNixosDisnixDisnix *object, g
  * @param object A Disnix DBus interface object
  * @param jid Job ID of the running process
  * @param log_fd File descriptor of the job's logfile
+ * @return TRUE if the process is being watched, FALSE if it could not be started and a failure signal has been propagated
+ */
+gboolean signal_tempfile_result(pid_t pid, gchar *tempfilename, int temp_fd, OrgNixosDisnixDisnix *object, gint jid, int log_fd);
+
+/**
+ * Reads the output of a future that reports the outcome of each job of a
+ * merged group as 1 (success) or 0 (failure) and propagates a finish or
+ * failure signal for each job. Upon completion, the log files are closed and
+ * finish_job() is invoked for the first job.
+ *
+ * @param future Future delivering a string vector with an outcome per job
+ * @param object A Disnix DBus interface object
+ * @param jids Job IDs of the jobs in the group
+ * @param log_fds File descriptors of the logfiles of the jobs
+ * @param num_of_jobs Amount of jobs in the group
+ * @return TRUE if the future is being watched, FALSE if it could not be started and failure signals have been propagated
  */
-void signal_tempfile_result(pid_t pid, gchar *tempfilename, int temp_fd, OrgNixosDisnixDisnix *object, gint jid, int log_fd);
+gboolean signal_merged_boolean_results(ProcReact_Future future, OrgNixosDisnixDisnix *object, const gint *jids, const int *log_fds, unsigned int num_of_jobs);
 
 #endif
@@ -23,13 +23,13 @@
 #include <snapshotmapping.h>
 #include <targets.h>
 
-static pid_t delete_state_on_target(SnapshotMapping *mapping, Target *target, gchar **arguments, unsigned int arguments_length)
+static pid_t delete_state_on_target(void *data, SnapshotMapping *mapping, Target *target, gchar **arguments, unsigned int arguments_length)
 {
     g_print("[target: %s]: Deleting obsolete state of service: %s\n", mapping->target, mapping->component);
     return exec_delete_state(target->client_interface, mapping->target, mapping->container, mapping->type, arguments, arguments_length, mapping->service);
 }
 
-static void complete_delete_state_on_target(SnapshotMapping *mapping, ProcReact_Status status, int result)
+static void complete_delete_state_on_target(void *data, SnapshotMapping *mapping, ProcReact_Status status, int result)
 {
     if(status != PROCREACT_STATUS_OK || !result)
         g_printerr("[target: %s]: Cannot delete state of service: %s\n", mapping->target, mapping->component);
@@ -37,7 +37,7 @@ static void complete_delete_state_on_target(SnapshotMapping *mapping, ProcReact_
 
 static int delete_obsolete_state(GPtrArray *snapshots_array, GPtrArray *target_array)
 {
-    return map_snapshot_items(snapshots_array, target_array, delete_state_on_target, complete_delete_state_on_target);
+    return map_snapshot_items(snapshots_array, target_array, delete_state_on_target, complete_delete_state_on_target, NULL);
 }
 
 int delete_state(const gchar *manifest_file, const gchar *coordinator_profile_path, gchar *profile, const gchar *container, const gchar *component)
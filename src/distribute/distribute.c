@@ -18,28 +18,110 @@
  */
 
 #include "distribute.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <client-interface.h>
 #include <manifest.h>
 #include <distributionmapping.h>
 #include <targets.h>
+#include <concurrencylimit.h>
+#include <transfer-statistics.h>
 
-static pid_t transfer_distribution_item_to(void *data, DistributionItem *item, Target *target)
+static pid_t transfer_distribution_group_to(void *data, DistributionGroup *group, Target *target)
 {
-    char *paths[] = { item->profile, NULL };
-    g_print("[target: %s]: Receiving intra-dependency closure of profile: %s\n", item->target, item->profile);
-    return exec_copy_closure_to(target->client_interface, item->target, paths);
+    unsigned int i;
+    
+    for(i = 0; group->profiles[i] != NULL; i++)
+        g_print("[target: %s]: Receiving intra-dependency closure of profile: %s\n", group->target, group->profiles[i]);
+    
+    /* Transfer the union of the closures of all profiles in one go */
+    return exec_copy_closure_to(target->client_interface, group->target, group->profiles);
 }
 
-static void complete_transfer_distribution_item_to(void *data, DistributionItem *item, ProcReact_Status status, int result)
+static void complete_transfer_distribution_group_to(void *data, DistributionGroup *group, ProcReact_Status status, int result)
 {
     if(status != PROCREACT_STATUS_OK || !result)
-        g_printerr("[target: %s]: Cannot receive intra-dependency closure of profile: %s\n", item->target, item->profile);
+    {
+        unsigned int i;
+        
+        for(i = 0; group->profiles[i] != NULL; i++)
+            g_printerr("[target: %s]: Cannot receive intra-dependency closure of profile: %s\n", group->target, group->profiles[i]);
+    }
+}
+
+static pid_t transfer_distribution_group_from_peer(void *data, DistributionGroup *group, Target *target, DistributionGroup *peer_group, Target *peer_target, gchar **services)
+{
+    if(peer_group == NULL)
+        return transfer_distribution_group_to(data, group, target);
+    else
+    {
+        pid_t pid = fork();
+        
+        if(pid == 0)
+        {
+            ProcReact_Status status;
+            int result;
+            unsigned int i;
+            
+            for(i = 0; services[i] != NULL; i++)
+                g_print("[target: %s]: Receiving closure of service: %s from peer: %s\n", group->target, services[i], peer_group->target);
+            
+            /* Let the target fetch the closures of the services from a peer that already has them */
+            result = procreact_wait_for_boolean(exec_copy_closure_from_peer(target->client_interface, group->target, peer_target->client_interface, peer_group->target, services), &status);
+            
+            if(status != PROCREACT_STATUS_OK || !result)
+                exit(1);
+            
+            /* The profiles are specific to the target, so the coordinator sends the remainder of their closures */
+            for(i = 0; group->profiles[i] != NULL; i++)
+                g_print("[target: %s]: Receiving remainder of the intra-dependency closure of profile: %s\n", group->target, group->profiles[i]);
+            
+            result = procreact_wait_for_boolean(exec_copy_closure_to(target->client_interface, group->target, group->profiles), &status);
+            exit(status != PROCREACT_STATUS_OK || !result);
+        }
+        
+        return pid;
+    }
 }
 
-int distribute(const gchar *manifest_file, const unsigned int max_concurrent_transfers)
+static void complete_transfer_distribution_group_from_peer(void *data, DistributionGroup *group, DistributionGroup *peer_group, ProcReact_Status status, int result)
+{
+    if(peer_group == NULL)
+        complete_transfer_distribution_group_to(data, group, status, result);
+    else if(status != PROCREACT_STATUS_OK || !result)
+        g_printerr("[target: %s]: Cannot receive intra-dependency closure from peer: %s, falling back to the coordinator\n", group->target, peer_group->target);
+}
+
+static int distribute_to_targets(Manifest *manifest, const unsigned int max_concurrent_transfers)
+{
+    /* Iterate over the targets of the distribution mappings, limiting concurrency to the desired concurrent transfers and distribute them */
+    int success;
+    ProcReact_PidIterator iterator = create_distribution_group_iterator(manifest->distribution_array, manifest->target_array, transfer_distribution_group_to, complete_transfer_distribution_group_to, NULL);
+    fork_and_wait_in_parallel_with_concurrency_limit(&iterator, max_concurrent_transfers);
+    success = distribution_group_iterator_has_succeeded(&iterator);
+    
+    destroy_distribution_group_iterator(&iterator);
+    return success;
+}
+
+static int distribute_to_targets_and_peers(Manifest *manifest, const unsigned int max_concurrent_transfers, const unsigned int peer_fan_out)
+{
+    /* Targets that have received a closure pass it on to other targets deploying the same services. The iterator limits the concurrency itself */
+    int success;
+    ProcReact_PidIterator iterator = create_peer_distribution_iterator(manifest->distribution_array, manifest->activation_array, manifest->target_array, max_concurrent_transfers, peer_fan_out, transfer_distribution_group_from_peer, complete_transfer_distribution_group_from_peer, NULL);
+    procreact_fork_and_wait_in_parallel_limit(&iterator, UINT_MAX);
+    success = peer_distribution_iterator_has_succeeded(&iterator);
+    
+    destroy_peer_distribution_iterator(&iterator);
+    return success;
+}
+
+int distribute(const gchar *manifest_file, const unsigned int max_concurrent_transfers, const unsigned int peer_fan_out)
 {
     /* Generate a distribution array from the manifest file */
-    Manifest *manifest = create_manifest(manifest_file, MANIFEST_DISTRIBUTION_FLAG, NULL, NULL);
+    /* Transfers between peers are based on the services that targets share, which are recorded in the activation mappings */
+    Manifest *manifest = create_manifest(manifest_file, (peer_fan_out == 0) ? MANIFEST_DISTRIBUTION_FLAG : (MANIFEST_DISTRIBUTION_FLAG | MANIFEST_ACTIVATION_FLAG), NULL, NULL);
     
     if(manifest == NULL)
     {
@@ -48,14 +130,18 @@ int distribute(const gchar *manifest_file, const unsigned int max_concurrent_tra
     }
     else
     {
-        /* Iterate over the distribution mappings, limiting concurrency to the desired concurrent transfers and distribute them */
         int success;
-        ProcReact_PidIterator iterator = create_distribution_iterator(manifest->distribution_array, manifest->target_array, transfer_distribution_item_to, complete_transfer_distribution_item_to, NULL);
-        procreact_fork_and_wait_in_parallel_limit(&iterator, max_concurrent_transfers);
-        success = distribution_iterator_has_succeeded(&iterator);
+        gchar *transfer_log = transfer_statistics_start();
+        
+        if(peer_fan_out == 0)
+            success = distribute_to_targets(manifest, max_concurrent_transfers);
+        else
+            success = distribute_to_targets_and_peers(manifest, max_concurrent_transfers, peer_fan_out);
+        
+        /* Display how much has been transferred to each target */
+        transfer_statistics_print_summary(transfer_log);
         
         /* Delete resources */
-        destroy_distribution_iterator(&iterator);
         delete_manifest(manifest);
         
         /* Return the exit status, which is 0 if everything succeeds */
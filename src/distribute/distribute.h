@@ -27,8 +27,9 @@
  *
  * @param manifest_file Path to the manifest file which maps services to machines
  * @param max_concurrent_transfers Specifies the maximum amount of concurrent transfers
+ * @param peer_fan_out Maximum amount of concurrent transfers that a target that has received a closure serves to other targets. 0 disables transfers between targets
  * @return 0 if everything succeeds, else a non-zero exit status
  */
-int distribute(const gchar *manifest_file, const unsigned int max_concurrent_transfers);
+int distribute(const gchar *manifest_file, const unsigned int max_concurrent_transfers, const unsigned int peer_fan_out);
 
 #endif
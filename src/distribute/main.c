@@ -38,9 +38,22 @@ static void print_usage(const char *command)
     printf("Options:\n");
     printf("  -m, --max-concurrent-transfers=NUM  Maximum amount of concurrent closure\n");
     printf("                                      transfers. Defauls to: 2\n");
+    printf("  -f, --peer-fan-out=NUM              Lets targets that have received the\n");
+    printf("                                      closures of their services pass them on\n");
+    printf("                                      to at most NUM other targets deploying\n");
+    printf("                                      the same services concurrently.\n");
+    printf("                                      Defaults to: 0, which disables transfers\n");
+    printf("                                      between targets\n");
     printf("  -h, --help                          Shows the usage of this command to the user\n");
     printf("  -v, --version                       Shows the version of this command to the\n");
     printf("                                      user\n");
+    
+    printf("\nEnvironment:\n");
+    printf("  DISNIX_PEER_FAN_OUT    Specifies the default value of the --peer-fan-out\n");
+    printf("                         option\n");
+    printf("  DISNIX_PROGRESS_INTERVAL  Interval (in seconds) in which the progress of\n");
+    printf("                         each transfer is reported. 0 disables progress\n");
+    printf("                         reports (defaults to: 5)\n");
 }
 
 int main(int argc, char *argv[])
@@ -50,21 +63,27 @@ int main(int argc, char *argv[])
     struct option long_options[] =
     {
         {"max-concurrent-transfers", required_argument, 0, 'm'},
+        {"peer-fan-out", required_argument, 0, 'f'},
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'v'},
         {0, 0, 0, 0}
     };
     
     unsigned int max_concurrent_transfers = 2;
+    char *peer_fan_out_env = getenv("DISNIX_PEER_FAN_OUT");
+    unsigned int peer_fan_out = (peer_fan_out_env == NULL) ? 0 : atoi(peer_fan_out_env);
     
     /* Parse command-line options */
-    while((c = getopt_long(argc, argv, "m:hv", long_options, &option_index)) != -1)
+    while((c = getopt_long(argc, argv, "m:f:hv", long_options, &option_index)) != -1)
     {
         switch(c)
         {
             case 'm':
                 max_concurrent_transfers = atoi(optarg);
                 break;
+            case 'f':
+                peer_fan_out = atoi(optarg);
+                break;
             case 'h':
             case '?':
                 print_usage(argv[0]);
@@ -83,5 +102,5 @@ int main(int argc, char *argv[])
         return 1;
     }
     else
-        return distribute(argv[optind], max_concurrent_transfers); /* Execute distribute operation */
+        return distribute(argv[optind], max_concurrent_transfers, peer_fan_out); /* Execute distribute operation */
 }
@@ -84,6 +84,7 @@ GPtrArray *create_derivation_array(const gchar *distributed_derivation_file)
 	    item->derivation = derivation;
 	    item->target = target;
 	    item->result = NULL;
+	    item->outputs = NULL;
 	    
 	    if(item->derivation == NULL || item->target == NULL)
 	    {
@@ -121,6 +122,7 @@ void delete_derivation_array(GPtrArray *derivation_array)
             free(item->derivation);
             g_free(item->target);
             g_strfreev(item->result);
+            g_strfreev(item->outputs);
             g_free(item);
         }
     
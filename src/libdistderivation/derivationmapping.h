@@ -36,6 +36,8 @@ typedef struct
     gchar *target;
     /** Nix store paths of the build result, or NULL if it has not yet been realised */
     gchar **result;
+    /** Nix store paths of the outputs of the derivation, or NULL if they are unknown */
+    gchar **outputs;
 }
 DerivationItem;
 
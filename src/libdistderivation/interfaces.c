@@ -82,6 +82,7 @@ GPtrArray *create_interface_array(const gchar *distributed_derivation_file)
 	    xmlNodePtr interfaces_children = nodeset->nodeTab[i]->children;
 	    gchar *target = NULL;
 	    gchar *clientInterface = NULL;
+	    int numOfCores = 0;
 	    Interface *interface = (Interface*)g_malloc(sizeof(Interface));
 	    
 	    while(interfaces_children != NULL)
@@ -90,12 +91,15 @@ GPtrArray *create_interface_array(const gchar *distributed_derivation_file)
 		    target = g_strdup((gchar*)interfaces_children->children->content);
 		else if(xmlStrcmp(interfaces_children->name, (xmlChar*) "clientInterface") == 0)
 		    clientInterface = g_strdup((gchar*)interfaces_children->children->content);
+		else if(xmlStrcmp(interfaces_children->name, (xmlChar*) "numOfCores") == 0 && interfaces_children->children != NULL)
+		    numOfCores = atoi((char*)interfaces_children->children->content);
 	        
 	        interfaces_children = interfaces_children->next;
 	    }
 	    
 	    interface->target = target;
 	    interface->clientInterface = clientInterface;
+	    interface->numOfCores = numOfCores;
 	    
 	    /* Add interface item to the interface array */
 	    g_ptr_array_add(interface_array, interface);
@@ -31,6 +31,9 @@ typedef struct
     
     /** Executable that needs to be run to connect to the remote machine */
     gchar *clientInterface;
+    
+    /** Amount of CPU cores of the machine, or 0 if it is unknown */
+    int numOfCores;
 }
 Interface;
 
@@ -0,0 +1,203 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Compares the native infrastructure XML converter with the XSLT-based
+ * conversion it replaces. It generates a synthetic evaluated infrastructure
+ * model in the format produced by nix-instantiate --xml, converts it with both
+ * approaches, checks that the results are identical and reports the timings.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libxslt/xslt.h>
+#include <libxslt/transform.h>
+#include "infrastructure.h"
+
+static gchar *generate_infrastructure_xml(unsigned int num_of_targets, unsigned int num_of_containers)
+{
+    unsigned int i;
+    GString *xml = g_string_new("<?xml version='1.0' encoding='utf-8'?>\n<expr>\n  <attrs>\n");
+
+    for(i = 0; i < num_of_targets; i++)
+    {
+        unsigned int j;
+
+        g_string_append_printf(xml, "    <attr name=\"test%u\">\n      <attrs>\n", i);
+        g_string_append(xml, "        <attr name=\"containers\">\n          <attrs>\n");
+
+        for(j = 0; j < num_of_containers; j++)
+        {
+            g_string_append_printf(xml, "            <attr name=\"container%u\">\n              <attrs>\n", j);
+            g_string_append_printf(xml, "                <attr name=\"port\"><int value=\"%u\" /></attr>\n", 3000 + j);
+            g_string_append_printf(xml, "                <attr name=\"username\"><string value=\"user%u\" /></attr>\n", j);
+            g_string_append(xml, "                <attr name=\"tags\"><list><string value=\"a\" /><string value=\"b\" /></list></attr>\n");
+            g_string_append(xml, "              </attrs>\n            </attr>\n");
+        }
+
+        g_string_append(xml, "            <attr name=\"process\">\n              <attrs />\n            </attr>\n");
+        g_string_append(xml, "          </attrs>\n        </attr>\n");
+        g_string_append(xml, "        <attr name=\"numOfCores\"><int value=\"4\" /></attr>\n");
+        g_string_append(xml, "        <attr name=\"properties\">\n          <attrs>\n");
+        g_string_append_printf(xml, "            <attr name=\"hostname\"><string value=\"test%u.example.org\" /></attr>\n", i);
+        g_string_append(xml, "            <attr name=\"supportedTypes\"><list><string value=\"process\" /><string value=\"wrapper\" /></list></attr>\n");
+        g_string_append(xml, "            <attr name=\"secure\"><bool value=\"true\" /></attr>\n");
+        g_string_append(xml, "          </attrs>\n        </attr>\n");
+        g_string_append(xml, "        <attr name=\"system\"><string value=\"x86_64-linux\" /></attr>\n");
+        g_string_append(xml, "        <attr name=\"targetProperty\"><string value=\"hostname\" /></attr>\n");
+        g_string_append(xml, "      </attrs>\n    </attr>\n");
+    }
+
+    g_string_append(xml, "  </attrs>\n</expr>\n");
+    return g_string_free(xml, FALSE);
+}
+
+static GPtrArray *create_target_array_with_xslt(const gchar *infrastructure_xml)
+{
+    xmlDocPtr doc, transform_doc;
+    xsltStylesheetPtr style;
+    GPtrArray *targets_array;
+
+    doc = xmlParseMemory(infrastructure_xml, strlen(infrastructure_xml));
+    style = xsltParseStylesheetFile((const xmlChar *) INFRASTRUCTURE_XSL);
+    transform_doc = xsltApplyStylesheet(style, doc, NULL);
+
+    targets_array = create_target_array_from_doc(transform_doc);
+
+    xsltFreeStylesheet(style);
+    xmlFreeDoc(transform_doc);
+    xmlFreeDoc(doc);
+
+    return targets_array;
+}
+
+static int compare_property_arrays(const GPtrArray *left, const GPtrArray *right)
+{
+    unsigned int i;
+
+    if(left == NULL || right == NULL)
+        return left == right;
+
+    if(left->len != right->len)
+        return FALSE;
+
+    for(i = 0; i < left->len; i++)
+    {
+        TargetProperty *left_property = g_ptr_array_index(left, i);
+        TargetProperty *right_property = g_ptr_array_index(right, i);
+
+        if(g_strcmp0(left_property->name, right_property->name) != 0 || g_strcmp0(left_property->value, right_property->value) != 0)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int compare_target_arrays(const GPtrArray *left, const GPtrArray *right)
+{
+    unsigned int i;
+
+    if(left == NULL || right == NULL || left->len != right->len)
+        return FALSE;
+
+    for(i = 0; i < left->len; i++)
+    {
+        Target *left_target = g_ptr_array_index(left, i);
+        Target *right_target = g_ptr_array_index(right, i);
+        unsigned int j;
+
+        if(g_strcmp0(left_target->name, right_target->name) != 0
+          || g_strcmp0(left_target->system, right_target->system) != 0
+          || g_strcmp0(left_target->client_interface, right_target->client_interface) != 0
+          || g_strcmp0(left_target->target_property, right_target->target_property) != 0
+          || left_target->num_of_cores != right_target->num_of_cores
+          || !compare_property_arrays(left_target->properties, right_target->properties)
+          || (left_target->containers == NULL) != (right_target->containers == NULL))
+            return FALSE;
+
+        if(left_target->containers != NULL)
+        {
+            if(left_target->containers->len != right_target->containers->len)
+                return FALSE;
+
+            for(j = 0; j < left_target->containers->len; j++)
+            {
+                Container *left_container = g_ptr_array_index(left_target->containers, j);
+                Container *right_container = g_ptr_array_index(right_target->containers, j);
+
+                if(g_strcmp0(left_container->name, right_container->name) != 0 || !compare_property_arrays(left_container->properties, right_container->properties))
+                    return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int num_of_targets = 1000, num_of_containers = 10, iterations = 5, i;
+    gchar *infrastructure_xml;
+    gint64 native_time = 0, xslt_time = 0;
+    int exit_status = 0;
+
+    if(argc > 1)
+        num_of_targets = atoi(argv[1]);
+    if(argc > 2)
+        num_of_containers = atoi(argv[2]);
+    if(argc > 3)
+        iterations = atoi(argv[3]);
+
+    infrastructure_xml = generate_infrastructure_xml(num_of_targets, num_of_containers);
+
+    for(i = 0; i < iterations; i++)
+    {
+        GPtrArray *native_array, *xslt_array;
+        gint64 start;
+
+        start = g_get_monotonic_time();
+        native_array = create_target_array_from_nix_xml(infrastructure_xml);
+        native_time += g_get_monotonic_time() - start;
+
+        start = g_get_monotonic_time();
+        xslt_array = create_target_array_with_xslt(infrastructure_xml);
+        xslt_time += g_get_monotonic_time() - start;
+
+        if(!compare_target_arrays(native_array, xslt_array))
+        {
+            g_printerr("The native and XSLT conversions yield different results!\n");
+            exit_status = 1;
+        }
+
+        delete_target_array(native_array);
+        delete_target_array(xslt_array);
+    }
+
+    g_print("targets: %u, containers per target: %u, iterations: %u\n", num_of_targets, num_of_containers, iterations);
+    g_print("native: %.3f ms per conversion\n", (double)native_time / iterations / 1000);
+    g_print("xslt: %.3f ms per conversion\n", (double)xslt_time / iterations / 1000);
+
+    /* Cleanup */
+    g_free(infrastructure_xml);
+    xsltCleanupGlobals();
+    xmlCleanupParser();
+
+    return exit_status;
+}
@@ -24,8 +24,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
-#include <libxslt/xslt.h>
-#include <libxslt/transform.h>
+#include <libxml/xmlreader.h>
 #include "package-management.h"
 
 static gint compare_target_property(const TargetProperty **l, const TargetProperty **r)
@@ -71,44 +70,390 @@ static gint compare_container(const Container **l, const Container **r)
     return g_strcmp0(left->name, right->name);
 }
 
-static xmlDocPtr create_infrastructure_doc(gchar *infrastructureXML)
+static void delete_properties(GPtrArray *properties)
 {
-    /* Declarations */
-    xmlDocPtr doc, transform_doc;
-    xmlNodePtr root_node;
-    xsltStylesheetPtr style;
+    if(properties != NULL)
+    {
+        unsigned int i;
     
-    /* Parse XML file from XML string */
-    doc = xmlParseMemory(infrastructureXML, strlen(infrastructureXML));
+        for(i = 0; i < properties->len; i++)
+        {
+            TargetProperty *target_property = g_ptr_array_index(properties, i);
+            
+            g_free(target_property->name);
+            g_free(target_property->value);
+            g_free(target_property);
+        }
+        
+        g_ptr_array_free(properties, TRUE);
+    }
+}
+
+static void delete_containers(GPtrArray *containers)
+{
+    if(containers != NULL)
+    {
+        unsigned int i;
+
+        for(i = 0; i < containers->len; i++)
+        {
+            Container *container = g_ptr_array_index(containers, i);
+            g_free(container->name);
+            delete_properties(container->properties);
+            g_free(container);
+        }
+        
+        g_ptr_array_free(containers, TRUE);
+    }
+}
+
+static void delete_target(Target *target)
+{
+    delete_properties(target->properties);
+    delete_containers(target->containers);
     
-    if(doc == NULL)
+    g_free(target->name);
+    g_free(target->system);
+    g_free(target->client_interface);
+    g_free(target->target_property);
+    g_free(target);
+}
+
+/*
+ * The functions below convert the output of nix-instantiate --xml directly
+ * into target structs while streaming over it. They follow the semantics of
+ * data/infrastructure.xsl, which is no longer applied at runtime.
+ */
+
+static int next_child_element(xmlTextReaderPtr reader, int parent_depth)
+{
+    while(xmlTextReaderRead(reader) == 1)
+    {
+        int depth = xmlTextReaderDepth(reader);
+        
+        if(depth <= parent_depth)
+            return FALSE; /* We have reached the end of the parent element */
+        else if(depth == parent_depth + 1 && xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT)
+            return TRUE;
+    }
+    
+    return FALSE;
+}
+
+static int has_children(xmlTextReaderPtr reader)
+{
+    return !xmlTextReaderIsEmptyElement(reader);
+}
+
+static int element_name_is(xmlTextReaderPtr reader, const char *name)
+{
+    return xmlStrcmp(xmlTextReaderConstLocalName(reader), (const xmlChar*) name) == 0;
+}
+
+static gchar *get_attribute(xmlTextReaderPtr reader, const char *name)
+{
+    xmlChar *value = xmlTextReaderGetAttribute(reader, (const xmlChar*) name);
+    
+    if(value == NULL)
+        return NULL;
+    else
+    {
+        gchar *result = g_strdup((gchar*)value);
+        xmlFree(value);
+        return result;
+    }
+}
+
+static void append_value_attribute(xmlTextReaderPtr reader, GString *value)
+{
+    xmlChar *attribute = xmlTextReaderGetAttribute(reader, (const xmlChar*) "value");
+    
+    if(attribute != NULL)
+    {
+        g_string_append(value, (gchar*)attribute);
+        xmlFree(attribute);
+    }
+}
+
+/*
+ * Parses the value of an attr element. Primitive values are taken from their
+ * value attribute, lists are flattened into a string in which each element is
+ * followed by a space. Empty values yield NULL. If strings_only is set, values
+ * of other types are ignored.
+ */
+static gchar *parse_attr_value(xmlTextReaderPtr reader, int strings_only)
+{
+    GString *value = g_string_new("");
+    
+    if(has_children(reader))
     {
-	g_printerr("Error with parsing infrastructure XML file!\n");
-	return NULL;
+        int depth = xmlTextReaderDepth(reader);
+        
+        while(next_child_element(reader, depth))
+        {
+            if(strings_only)
+            {
+                if(element_name_is(reader, "string"))
+                    append_value_attribute(reader, value);
+            }
+            else
+            {
+                append_value_attribute(reader, value);
+                
+                if(element_name_is(reader, "list") && has_children(reader))
+                {
+                    int list_depth = xmlTextReaderDepth(reader);
+                    
+                    while(next_child_element(reader, list_depth))
+                    {
+                        append_value_attribute(reader, value);
+                        g_string_append_c(value, ' ');
+                    }
+                }
+            }
+        }
     }
     
-    /* Check if the document has a root */
-    root_node = xmlDocGetRootElement(doc);
+    if(value->len == 0)
+    {
+        g_string_free(value, TRUE);
+        return NULL;
+    }
+    else
+        return g_string_free(value, FALSE);
+}
+
+/*
+ * Parses an attr element whose value is an attribute set into a sorted array
+ * of target properties. Returns NULL if the value is not an attribute set.
+ */
+static GPtrArray *parse_properties(xmlTextReaderPtr reader)
+{
+    GPtrArray *properties = NULL;
     
-    if(root_node == NULL)
+    if(has_children(reader))
     {
-        g_printerr("The infrastructure XML file is empty!\n");
-	xmlFreeDoc(doc);
-	return NULL;
+        int depth = xmlTextReaderDepth(reader);
+        
+        while(next_child_element(reader, depth))
+        {
+            if(element_name_is(reader, "attrs"))
+            {
+                properties = g_ptr_array_new();
+                
+                if(has_children(reader))
+                {
+                    int attrs_depth = xmlTextReaderDepth(reader);
+                    
+                    /* Iterate over all properties */
+                    while(next_child_element(reader, attrs_depth))
+                    {
+                        TargetProperty *target_property = (TargetProperty*)g_malloc(sizeof(TargetProperty));
+                        target_property->name = get_attribute(reader, "name");
+                        target_property->value = parse_attr_value(reader, FALSE);
+                        
+                        g_ptr_array_add(properties, target_property);
+                    }
+                }
+                
+                /* Sort the target properties */
+                g_ptr_array_sort(properties, (GCompareFunc)compare_target_property);
+            }
+        }
     }
+    
+    return properties;
+}
 
-    /* Transform the document into a more concrete format */
-    style = xsltParseStylesheetFile((const xmlChar *) DATADIR "/infrastructure.xsl");
+static GPtrArray *parse_containers(xmlTextReaderPtr reader)
+{
+    GPtrArray *containers = NULL;
     
-    transform_doc = xsltApplyStylesheet(style, doc, NULL);
+    if(has_children(reader))
+    {
+        int depth = xmlTextReaderDepth(reader);
         
+        while(next_child_element(reader, depth))
+        {
+            if(element_name_is(reader, "attrs"))
+            {
+                containers = g_ptr_array_new();
+                
+                if(has_children(reader))
+                {
+                    int attrs_depth = xmlTextReaderDepth(reader);
+                    
+                    /* Iterate over all containers */
+                    while(next_child_element(reader, attrs_depth))
+                    {
+                        Container *container = (Container*)g_malloc(sizeof(Container));
+                        container->name = get_attribute(reader, "name");
+                        container->properties = parse_properties(reader);
+                        
+                        /* A container without properties has no properties array */
+                        if(container->properties != NULL && container->properties->len == 0)
+                        {
+                            g_ptr_array_free(container->properties, TRUE);
+                            container->properties = NULL;
+                        }
+                        
+                        g_ptr_array_add(containers, container);
+                    }
+                }
+                
+                /* Sort the containers */
+                g_ptr_array_sort(containers, (GCompareFunc)compare_container);
+            }
+        }
+    }
+    
+    return containers;
+}
+
+static Target *parse_target(xmlTextReaderPtr reader)
+{
+    Target *target = (Target*)g_malloc(sizeof(Target));
+    
+    target->name = get_attribute(reader, "name");
+    target->system = NULL;
+    target->client_interface = NULL;
+    target->target_property = NULL;
+    target->num_of_cores = 0;
+    target->available_cores = 0;
+    target->properties = NULL;
+    target->containers = NULL;
+    
+    if(has_children(reader))
+    {
+        int depth = xmlTextReaderDepth(reader);
+        
+        while(next_child_element(reader, depth))
+        {
+            if(element_name_is(reader, "attrs") && has_children(reader))
+            {
+                int attrs_depth = xmlTextReaderDepth(reader);
+                
+                /* Parse the target attributes */
+                while(next_child_element(reader, attrs_depth))
+                {
+                    xmlChar *name = xmlTextReaderGetAttribute(reader, (const xmlChar*) "name");
+                    
+                    if(xmlStrcmp(name, (xmlChar*) "properties") == 0)
+                        target->properties = parse_properties(reader);
+                    else if(xmlStrcmp(name, (xmlChar*) "containers") == 0)
+                        target->containers = parse_containers(reader);
+                    else if(xmlStrcmp(name, (xmlChar*) "system") == 0)
+                        target->system = parse_attr_value(reader, TRUE);
+                    else if(xmlStrcmp(name, (xmlChar*) "clientInterface") == 0)
+                        target->client_interface = parse_attr_value(reader, TRUE);
+                    else if(xmlStrcmp(name, (xmlChar*) "targetProperty") == 0)
+                        target->target_property = parse_attr_value(reader, TRUE);
+                    else if(xmlStrcmp(name, (xmlChar*) "numOfCores") == 0)
+                    {
+                        gchar *num_of_cores_str = parse_attr_value(reader, FALSE);
+                        
+                        if(num_of_cores_str != NULL)
+                        {
+                            target->num_of_cores = atoi((char*)num_of_cores_str);
+                            target->available_cores = target->num_of_cores;
+                            g_free(num_of_cores_str);
+                        }
+                    }
+                    
+                    xmlFree(name);
+                }
+            }
+        }
+    }
+    
+    return target;
+}
+
+static GPtrArray *parse_targets(xmlTextReaderPtr reader)
+{
+    GPtrArray *targets_array = NULL;
+    
+    /* Move to the root element, which should be an expr element */
+    if(next_child_element(reader, -1) && element_name_is(reader, "expr") && has_children(reader))
+    {
+        while(next_child_element(reader, 0))
+        {
+            /* The infrastructure model should be an attribute set of targets */
+            if(element_name_is(reader, "attrs"))
+            {
+                targets_array = g_ptr_array_new();
+                
+                if(has_children(reader))
+                {
+                    while(next_child_element(reader, 1))
+                    {
+                        Target *target = parse_target(reader);
+                        
+                        if(target->name == NULL || target->properties == NULL)
+                        {
+                            /* Check if all mandatory properties have been provided */
+                            g_printerr("A mandatory property seems to be missing. Have you provided a correct\n");
+                            g_printerr("infrastrucure file?\n");
+                            delete_target(target);
+                            delete_target_array(targets_array);
+                            return NULL;
+                        }
+                        else
+                            g_ptr_array_add(targets_array, target); /* Add target item to the targets array */
+                    }
+                }
+            }
+        }
+    }
+    
+    return targets_array;
+}
+
+GPtrArray *create_target_array_from_nix_xml(const gchar *infrastructure_xml)
+{
+    /* Declarations */
+    xmlTextReaderPtr reader;
+    GPtrArray *targets_array;
+    int status;
+    
+    /* Open a streaming reader over the XML string */
+    reader = xmlReaderForMemory(infrastructure_xml, strlen(infrastructure_xml), NULL, NULL, 0);
+    
+    if(reader == NULL)
+    {
+        g_printerr("Error with parsing infrastructure XML file!\n");
+        return NULL;
+    }
+    
+    /* Convert the evaluated attribute set into targets */
+    targets_array = parse_targets(reader);
+    
+    /* Consume the remainder of the document so that parse errors are detected */
+    while((status = xmlTextReaderRead(reader)) == 1);
+    
     /* Cleanup */
-    xsltFreeStylesheet(style);
-    xmlFreeDoc(doc);
-    xsltCleanupGlobals();
+    xmlFreeTextReader(reader);
     
-    /* Return transformed XML document */
-    return transform_doc;
+    if(status == -1)
+    {
+        g_printerr("Error with parsing infrastructure XML file!\n");
+        delete_target_array(targets_array);
+        return NULL;
+    }
+    else if(targets_array == NULL || targets_array->len == 0)
+    {
+        g_printerr("No targets found!\n");
+        delete_target_array(targets_array);
+        return NULL;
+    }
+    else
+    {
+        /* Sort the targets array */
+        g_ptr_array_sort(targets_array, (GCompareFunc)compare_target);
+        
+        /* Return the generated targets array */
+        return targets_array;
+    }
 }
 
 GPtrArray *create_target_array_from_doc(xmlDocPtr doc)
@@ -293,8 +638,7 @@ GPtrArray *create_target_array_from_doc(xmlDocPtr doc)
 GPtrArray *create_target_array(char *infrastructure_expr)
 {
     /* Declarations */
-    xmlDocPtr doc;
-    GPtrArray *targets_array = NULL;
+    GPtrArray *targets_array;
     
     /* Open the XML output of nix-instantiate */
     char *infrastructureXML = pkgmgmt_instantiate_sync(infrastructure_expr);
@@ -305,70 +649,17 @@ GPtrArray *create_target_array(char *infrastructure_expr)
         return NULL;
     }
     
-    /* Parse the infrastructure XML file */
-    doc = create_infrastructure_doc(infrastructureXML);
-    
-    /* Create a target array from the XML document */
-    targets_array = create_target_array_from_doc(doc);
+    /* Convert the XML output into a target array */
+    targets_array = create_target_array_from_nix_xml(infrastructureXML);
 
     /* Cleanup */
     free(infrastructureXML);
-    xmlFreeDoc(doc);
     xmlCleanupParser();
 
     /* Return the target array */
     return targets_array;
 }
 
-static void delete_properties(GPtrArray *properties)
-{
-    if(properties != NULL)
-    {
-        unsigned int i;
-    
-        for(i = 0; i < properties->len; i++)
-        {
-            TargetProperty *target_property = g_ptr_array_index(properties, i);
-            
-            g_free(target_property->name);
-            g_free(target_property->value);
-            g_free(target_property);
-        }
-        
-        g_ptr_array_free(properties, TRUE);
-    }
-}
-
-static void delete_containers(GPtrArray *containers)
-{
-    if(containers != NULL)
-    {
-        unsigned int i;
-
-        for(i = 0; i < containers->len; i++)
-        {
-            Container *container = g_ptr_array_index(containers, i);
-            g_free(container->name);
-            delete_properties(container->properties);
-            g_free(container);
-        }
-        
-        g_ptr_array_free(containers, TRUE);
-    }
-}
-
-static void delete_target(Target *target)
-{
-    delete_properties(target->properties);
-    delete_containers(target->containers);
-    
-    g_free(target->name);
-    g_free(target->system);
-    g_free(target->client_interface);
-    g_free(target->target_property);
-    g_free(target);
-}
-
 void delete_target_array(GPtrArray *target_array)
 {
     if(target_array != NULL)
@@ -173,6 +173,16 @@ TargetIteratorData;
  */
 GPtrArray *create_target_array_from_doc(xmlDocPtr doc);
 
+/**
+ * Creates an array with targets directly from the XML representation of an
+ * evaluated infrastructure model, as produced by nix-instantiate --xml. The
+ * document is processed in a single streaming pass.
+ *
+ * @param infrastructure_xml String containing the XML output of nix-instantiate
+ * @return GPtrArray with target properties or NULL if the model is invalid
+ */
+GPtrArray *create_target_array_from_nix_xml(const gchar *infrastructure_xml);
+
 /**
  * Creates an array with targets from an infrastructure Nix expression
  *
@@ -18,6 +18,7 @@
  */
 
 #include "client-interface.h"
+#include "copy-closure.h"
 #include <stdio.h>
 #include <sys/wait.h>
 #include <sys/types.h>
@@ -175,42 +176,169 @@ ProcReact_Future exec_query_installed(gchar *interface, gchar *target, gchar *pr
     return future;
 }
 
-static pid_t exec_copy_closure(gchar *operation, gchar *interface, gchar *target, gchar **paths)
+static pid_t exec_copy_closure(gchar *interface, gchar *target, gchar **paths, int (*copy_closure) (gchar *interface, gchar *target, gchar **paths))
 {
     pid_t pid = fork();
     
     if(pid == 0)
+    {
+        /*
+         * Attach process to its own process group to prevent them from being
+         * interrupted by the shell session starting the process
+         */
+        setpgid(0, 0);
+        
+        _exit(!copy_closure(interface, target, paths));
+    }
+    
+    return pid;
+}
+
+pid_t exec_copy_closure_from(gchar *interface, gchar *target, gchar **paths)
+{
+    return exec_copy_closure(interface, target, paths, copy_closure_from_sync);
+}
+
+pid_t exec_copy_closure_to(gchar *interface, gchar *target, gchar **paths)
+{
+    return exec_copy_closure(interface, target, paths, copy_closure_to_sync);
+}
+
+static ProcReact_Future exec_query_paths(gchar *operation, gchar *interface, gchar *target, gchar **paths)
+{
+    ProcReact_Future future = procreact_initialize_future(procreact_create_string_array_type('\n'));
+    
+    if(future.pid == 0)
     {
         unsigned int i, paths_length = g_strv_length(paths);
-        gchar **args = (gchar**)g_malloc((7 + paths_length) * sizeof(gchar*));
+        gchar **args = (gchar**)g_malloc((5 + paths_length) * sizeof(gchar*));
         
-        args[0] = "disnix-copy-closure";
+        args[0] = interface;
         args[1] = operation;
         args[2] = "--target";
         args[3] = target;
-        args[4] = "--interface";
-        args[5] = interface;
         
         for(i = 0; i < paths_length; i++)
-            args[i + 6] = paths[i];
+            args[i + 4] = paths[i];
         
-        args[i + 6] = NULL;
+        args[i + 4] = NULL;
         
-        execvp(args[0], args);
+        dup2(future.fd, 1); /* Attach pipe to the stdout */
+        execvp(interface, args); /* Run process */
+        _exit(1);
+    }
+    
+    return future;
+}
+
+pid_t exec_copy_closure_from_peer(gchar *interface, gchar *target, gchar *peer_interface, gchar *peer, gchar **paths)
+{
+    pid_t pid = fork();
+    
+    if(pid == 0)
+    {
+        unsigned int i, paths_length = g_strv_length(paths);
+        gchar **args = (gchar**)g_malloc((9 + paths_length) * sizeof(gchar*));
+        
+        args[0] = interface;
+        args[1] = "--target";
+        args[2] = target;
+        args[3] = "--copy-from-peer";
+        args[4] = "--peer";
+        args[5] = peer;
+        args[6] = "--peer-interface";
+        args[7] = peer_interface;
+        
+        for(i = 0; i < paths_length; i++)
+            args[i + 8] = paths[i];
+        
+        args[i + 8] = NULL;
+        
+        /*
+         * Attach process to its own process group to prevent them from being
+         * interrupted by the shell session starting the process
+         */
+        setpgid(0, 0);
+        
+        execvp(interface, args);
         _exit(1);
     }
     
     return pid;
 }
 
-pid_t exec_copy_closure_from(gchar *interface, gchar *target, gchar **paths)
+pid_t exec_copy_snapshots_from_peer(gchar *interface, gchar *target, gchar *peer_interface, gchar *peer, gchar *container, gchar *component)
+{
+    pid_t pid = fork();
+    
+    if(pid == 0)
+    {
+        char *const args[] = {interface, "--target", target, "--copy-snapshots-from-peer", "--peer", peer, "--peer-interface", peer_interface, "--container", container, "--component", component, NULL};
+        
+        /*
+         * Attach process to its own process group to prevent them from being
+         * interrupted by the shell session starting the process
+         */
+        setpgid(0, 0);
+        
+        execvp(interface, args);
+        _exit(1);
+    }
+    
+    return pid;
+}
+
+ProcReact_Future exec_print_invalid(gchar *interface, gchar *target, gchar **paths)
 {
-    return exec_copy_closure("--from", interface, target, paths);
+    return exec_query_paths("--print-invalid", interface, target, paths);
 }
 
-pid_t exec_copy_closure_to(gchar *interface, gchar *target, gchar **paths)
+ProcReact_Future exec_query_requisites_of_paths(gchar *interface, gchar *target, gchar **paths)
 {
-    return exec_copy_closure("--to", interface, target, paths);
+    return exec_query_paths("--query-requisites", interface, target, paths);
+}
+
+pid_t exec_import_closure_stream(gchar *interface, gchar *target, int closure_fd)
+{
+    pid_t pid = fork();
+    
+    if(pid == 0)
+    {
+        char *const args[] = {interface, "--target", target, "--import", "--stdin", NULL};
+        dup2(closure_fd, 0); /* Attach the closure stream to the stdin */
+        execvp(interface, args);
+        _exit(1);
+    }
+    
+    return pid;
+}
+
+pid_t exec_export_closure_stream(gchar *interface, gchar *target, gchar **paths, int closure_fd)
+{
+    pid_t pid = fork();
+    
+    if(pid == 0)
+    {
+        unsigned int i, paths_length = g_strv_length(paths);
+        gchar **args = (gchar**)g_malloc((6 + paths_length) * sizeof(gchar*));
+        
+        args[0] = interface;
+        args[1] = "--target";
+        args[2] = target;
+        args[3] = "--export";
+        args[4] = "--stdout";
+        
+        for(i = 0; i < paths_length; i++)
+            args[i + 5] = paths[i];
+        
+        args[i + 5] = NULL;
+        
+        dup2(closure_fd, 1); /* Attach the closure stream to the stdout */
+        execvp(interface, args);
+        _exit(1);
+    }
+    
+    return pid;
 }
 
 static pid_t exec_copy_snapshots(gchar *operation, gchar *interface, gchar *target, gchar *container, gchar *component, gboolean all)
@@ -306,13 +434,18 @@ pid_t exec_clean_snapshots(gchar *interface, gchar *target, int keep, char *cont
     return pid;
 }
 
-ProcReact_Future exec_realise(gchar *interface, gchar *target, gchar *derivation)
+ProcReact_Future exec_realise(gchar *interface, gchar *target, gchar **derivation)
+{
+    return exec_query_paths("--realise", interface, target, derivation);
+}
+
+ProcReact_Future exec_capture_config(gchar *interface, gchar *target)
 {
     ProcReact_Future future = procreact_initialize_future(procreact_create_string_array_type('\n'));
 
     if(future.pid == 0)
     {
-        char *const args[] = {interface, "--realise", "--target", target, derivation, NULL};
+        char *const args[] = {interface, "--capture-config", "--target", target, NULL};
         dup2(future.fd, 1); /* Attach pipe to the stdout */
         execvp(interface, args); /* Run process */
         _exit(1);
@@ -321,13 +454,13 @@ ProcReact_Future exec_realise(gchar *interface, gchar *target, gchar *derivation
     return future;
 }
 
-ProcReact_Future exec_capture_config(gchar *interface, gchar *target)
+ProcReact_Future exec_query_requisites(gchar *interface, gchar *target, gchar *derivation)
 {
     ProcReact_Future future = procreact_initialize_future(procreact_create_string_array_type('\n'));
 
     if(future.pid == 0)
     {
-        char *const args[] = {interface, "--capture-config", "--target", target, NULL};
+        char *const args[] = {interface, "--query-requisites", "--target", target, derivation, NULL};
         dup2(future.fd, 1); /* Attach pipe to the stdout */
         execvp(interface, args); /* Run process */
         _exit(1);
@@ -336,13 +469,13 @@ ProcReact_Future exec_capture_config(gchar *interface, gchar *target)
     return future;
 }
 
-ProcReact_Future exec_query_requisites(gchar *interface, gchar *target, gchar *derivation)
+ProcReact_Future exec_query_gc_generation(gchar *interface, gchar *target)
 {
     ProcReact_Future future = procreact_initialize_future(procreact_create_string_array_type('\n'));
 
     if(future.pid == 0)
     {
-        char *const args[] = {interface, "--query-requisites", "--target", target, derivation, NULL};
+        char *const args[] = {interface, "--query-gc-generation", "--target", target, NULL};
         dup2(future.fd, 1); /* Attach pipe to the stdout */
         execvp(interface, args); /* Run process */
         _exit(1);
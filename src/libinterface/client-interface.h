@@ -145,7 +145,7 @@ pid_t exec_set(gchar *interface, gchar *target, gchar *profile, gchar *component
 ProcReact_Future exec_query_installed(gchar *interface, gchar *target, gchar *profile);
 
 /**
- * Invokes the copy closure process to copy a closure from a machine
+ * Spawns a process that streams a closure from a machine to this machine
  *
  * @param interface Path to the interface executable
  * @param target Target Address of the remote interface
@@ -155,7 +155,7 @@ ProcReact_Future exec_query_installed(gchar *interface, gchar *target, gchar *pr
 pid_t exec_copy_closure_from(gchar *interface, gchar *target, gchar **paths);
 
 /**
- * Invokes the copy closure process to copy a closure to a machine
+ * Spawns a process that streams a closure from this machine to a machine
  *
  * @param interface Path to the interface executable
  * @param target Target Address of the remote interface
@@ -164,6 +164,82 @@ pid_t exec_copy_closure_from(gchar *interface, gchar *target, gchar **paths);
  */
 pid_t exec_copy_closure_to(gchar *interface, gchar *target, gchar **paths);
 
+/**
+ * Invokes the copy from peer operation through a Disnix client interface,
+ * that makes the target machine copy the closure of the given paths directly
+ * from a peer machine that already has them
+ *
+ * @param interface Path to the interface executable
+ * @param target Target Address of the remote interface
+ * @param peer_interface Path to the interface executable that the target machine uses to connect to the peer
+ * @param peer Target Address of the peer
+ * @param paths Nix store paths to copy
+ * @return PID of the client interface process performing the operation, or -1 in case of a failure
+ */
+pid_t exec_copy_closure_from_peer(gchar *interface, gchar *target, gchar *peer_interface, gchar *peer, gchar **paths);
+
+/**
+ * Invokes the copy snapshots from peer operation through a Disnix client
+ * interface, that makes the target machine copy the latest snapshot of a
+ * component directly from a peer machine that has taken it
+ *
+ * @param interface Path to the interface executable
+ * @param target Target Address of the remote interface
+ * @param peer_interface Path to the interface executable that the target machine uses to connect to the peer
+ * @param peer Target Address of the peer
+ * @param container Name of the container in which the mutable component is deployed
+ * @param component Name of the mutable component
+ * @return PID of the client interface process performing the operation, or -1 in case of a failure
+ */
+pid_t exec_copy_snapshots_from_peer(gchar *interface, gchar *target, gchar *peer_interface, gchar *peer, gchar *container, gchar *component);
+
+/**
+ * Invokes the print invalid operation through a Disnix client interface to
+ * determine which of the given paths are not present on the target machine
+ *
+ * @param interface Path to the interface executable
+ * @param target Target Address of the remote interface
+ * @param paths Nix store paths to check
+ * @return Future struct of the client interface process performing the operation
+ */
+ProcReact_Future exec_print_invalid(gchar *interface, gchar *target, gchar **paths);
+
+/**
+ * Invokes the query requisites operation through a Disnix client interface for
+ * a collection of Nix store paths
+ *
+ * @param interface Path to the interface executable
+ * @param target Target Address of the remote interface
+ * @param paths Nix store paths of which the requisites must be queried
+ * @return Future struct of the client interface process performing the operation
+ */
+ProcReact_Future exec_query_requisites_of_paths(gchar *interface, gchar *target, gchar **paths);
+
+/**
+ * Invokes the import operation through a Disnix client interface that reads
+ * a closure serialisation from the given file descriptor and streams it to
+ * the target machine.
+ *
+ * @param interface Path to the interface executable
+ * @param target Target Address of the remote interface
+ * @param closure_fd File descriptor from which the serialisation is read
+ * @return PID of the client interface process performing the operation, or -1 in case of a failure
+ */
+pid_t exec_import_closure_stream(gchar *interface, gchar *target, int closure_fd);
+
+/**
+ * Invokes the export operation through a Disnix client interface that streams
+ * the serialisation of the given paths from the target machine to the given
+ * file descriptor.
+ *
+ * @param interface Path to the interface executable
+ * @param target Target Address of the remote interface
+ * @param paths Nix store paths to export
+ * @param closure_fd File descriptor to which the serialisation is written
+ * @return PID of the client interface process performing the operation, or -1 in case of a failure
+ */
+pid_t exec_export_closure_stream(gchar *interface, gchar *target, gchar **paths, int closure_fd);
+
 /**
  * Invokes the copy snapshots process to copy snapshots from a machine
  *
@@ -205,10 +281,10 @@ pid_t exec_clean_snapshots(gchar *interface, gchar *target, int keep, char *cont
  *
  * @param interface Path to the interface executable
  * @param target Target Address of the remote interface
- * @param derivation Derivation to build
+ * @param derivation NULL-terminated array of derivations to build in one invocation
  * @return Future struct of the client interface process performing the operation
  */
-ProcReact_Future exec_realise(gchar *interface, gchar *target, gchar *derivation);
+ProcReact_Future exec_realise(gchar *interface, gchar *target, gchar **derivation);
 
 /**
  * Captures the configuration from the Dysnomia container configuration files
@@ -230,6 +306,16 @@ ProcReact_Future exec_capture_config(gchar *interface, gchar *target);
  */
 ProcReact_Future exec_query_requisites(gchar *interface, gchar *target, gchar *derivation);
 
+/**
+ * Queries the garbage collection generation marker of a target machine, which
+ * changes each time garbage is collected through Disnix.
+ *
+ * @param interface Path to the interface executable
+ * @param target Target Address of the remote interface
+ * @return Future struct of the client interface process performing the operation
+ */
+ProcReact_Future exec_query_gc_generation(gchar *interface, gchar *target);
+
 /**
  * Invokes the true command for testing purposes.
  */
@@ -0,0 +1,624 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "closure-cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <procreact_types.h>
+#include <procreact_pid.h>
+#include <package-management.h>
+
+#define DEFAULT_EXPORT_CACHE_SIZE 1024
+#define EXPORT_TERMINATOR_SIZE 8
+#define BUFFER_SIZE 65536
+
+int closure_cache_is_enabled(void)
+{
+    return (getenv("DISNIX_NO_CACHE") == NULL);
+}
+
+static gchar *open_cache_dir(const gchar *subdir)
+{
+    const char *cache_dir = getenv("DISNIX_CACHE_DIR");
+    gchar *path;
+    
+    if(cache_dir == NULL)
+        path = g_build_filename(g_get_user_cache_dir(), "disnix", subdir, NULL);
+    else
+        path = g_build_filename(cache_dir, subdir, NULL);
+    
+    if(g_mkdir_with_parents(path, 0755) == -1)
+    {
+        g_free(path);
+        return NULL;
+    }
+    else
+        return path;
+}
+
+static gchar **read_lines(const gchar *filename)
+{
+    gchar *contents;
+    
+    if(g_file_get_contents(filename, &contents, NULL, NULL))
+    {
+        gchar **lines = g_strsplit(g_strchomp(contents), "\n", -1);
+        g_free(contents);
+        return lines;
+    }
+    else
+        return NULL;
+}
+
+static void write_lines(const gchar *filename, const gchar *first_line, gchar **lines)
+{
+    GString *contents = g_string_new("");
+    unsigned int i;
+    
+    if(first_line != NULL)
+        g_string_append_printf(contents, "%s\n", first_line);
+    
+    for(i = 0; lines[i] != NULL; i++)
+        g_string_append_printf(contents, "%s\n", lines[i]);
+    
+    /* The file gets atomically replaced, so that concurrent readers never observe a partial file */
+    g_file_set_contents(filename, contents->str, contents->len, NULL);
+    g_string_free(contents, TRUE);
+}
+
+static int contains_path(char **paths, const gchar *path)
+{
+    unsigned int i;
+    
+    for(i = 0; paths[i] != NULL; i++)
+    {
+        if(g_strcmp0(paths[i], path) == 0)
+            return TRUE;
+    }
+    
+    return FALSE;
+}
+
+static gchar **query_requisites_uncached(gchar **paths, closure_cache_query_requisites_function query_requisites, void *data)
+{
+    ProcReact_Status status;
+    ProcReact_Future future = query_requisites(paths, data);
+    char **requisites = procreact_future_get(&future, &status);
+    
+    if(status != PROCREACT_STATUS_OK || requisites == NULL)
+    {
+        procreact_free_string_array(requisites);
+        return NULL;
+    }
+    else
+    {
+        gchar **result = g_strdupv(requisites);
+        procreact_free_string_array(requisites);
+        return result;
+    }
+}
+
+static gchar **query_requisites_of_path(const gchar *requisites_dir, gchar *path, closure_cache_query_requisites_function query_requisites, void *data)
+{
+    gchar *basename = g_path_get_basename(path);
+    gchar *cache_file = g_build_filename(requisites_dir, basename, NULL);
+    gchar **requisites = read_lines(cache_file);
+    
+    if(requisites == NULL)
+    {
+        gchar *query_paths[] = { path, NULL };
+        requisites = query_requisites_uncached(query_paths, query_requisites, data);
+        
+        /*
+         * Only memorize the requisites if the path is a store path. The
+         * requisites of a store path always include the path itself, whereas
+         * the requisites of a symlink (such as a profile) may change.
+         */
+        if(requisites != NULL && contains_path(requisites, path))
+            write_lines(cache_file, NULL, requisites);
+    }
+    
+    g_free(basename);
+    g_free(cache_file);
+    
+    return requisites;
+}
+
+gchar **closure_cache_query_requisites(gchar **paths, closure_cache_query_requisites_function query_requisites, void *data)
+{
+    gchar *requisites_dir;
+    
+    if(!closure_cache_is_enabled() || (requisites_dir = open_cache_dir("requisites")) == NULL)
+        return query_requisites_uncached(paths, query_requisites, data);
+    else
+    {
+        unsigned int i;
+        GPtrArray *result = g_ptr_array_new();
+        GHashTable *result_table = g_hash_table_new(g_str_hash, g_str_equal);
+        
+        for(i = 0; paths[i] != NULL; i++)
+        {
+            gchar **requisites = query_requisites_of_path(requisites_dir, paths[i], query_requisites, data);
+            
+            if(requisites == NULL)
+            {
+                /* Querying the requisites failed */
+                g_ptr_array_add(result, NULL);
+                g_strfreev((gchar**)g_ptr_array_free(result, FALSE));
+                g_hash_table_destroy(result_table);
+                g_free(requisites_dir);
+                return NULL;
+            }
+            else
+            {
+                unsigned int j;
+                
+                /* Add the requisites to the union */
+                for(j = 0; requisites[j] != NULL; j++)
+                {
+                    if(!g_hash_table_contains(result_table, requisites[j]))
+                    {
+                        gchar *requisite = g_strdup(requisites[j]);
+                        g_hash_table_insert(result_table, requisite, requisite);
+                        g_ptr_array_add(result, requisite);
+                    }
+                }
+                
+                g_strfreev(requisites);
+            }
+        }
+        
+        g_ptr_array_add(result, NULL);
+        
+        /* Cleanup */
+        g_hash_table_destroy(result_table);
+        g_free(requisites_dir);
+        
+        return (gchar**)g_ptr_array_free(result, FALSE);
+    }
+}
+
+static gchar *compose_valid_paths_file(const gchar *target)
+{
+    gchar *valid_dir = open_cache_dir("valid");
+    
+    if(valid_dir == NULL)
+        return NULL;
+    else
+    {
+        /* Target keys may contain characters that are not allowed in file names, so use a hash */
+        gchar *target_hash = g_compute_checksum_for_string(G_CHECKSUM_SHA256, target, -1);
+        gchar *valid_paths_file = g_build_filename(valid_dir, target_hash, NULL);
+        
+        g_free(valid_dir);
+        g_free(target_hash);
+        
+        return valid_paths_file;
+    }
+}
+
+static gchar *read_fd(int fd)
+{
+    GString *contents = g_string_new("");
+    char buffer[BUFFER_SIZE];
+    ssize_t bytes_read;
+    
+    lseek(fd, 0, SEEK_SET);
+    
+    while((bytes_read = read(fd, buffer, BUFFER_SIZE)) > 0)
+        g_string_append_len(contents, buffer, bytes_read);
+    
+    if(bytes_read == -1)
+    {
+        g_string_free(contents, TRUE);
+        return NULL;
+    }
+    else
+        return g_string_free(contents, FALSE);
+}
+
+static int write_fd(int fd, const gchar *data, gsize length)
+{
+    gsize offset = 0;
+    
+    while(offset < length)
+    {
+        ssize_t bytes_written = write(fd, data + offset, length - offset);
+        
+        if(bytes_written == -1)
+            return FALSE;
+        
+        offset += bytes_written;
+    }
+    
+    return TRUE;
+}
+
+/*
+ * Reads the paths that are known to be valid on a target from a locked
+ * file. The first line contains the garbage collection generation marker for
+ * which the knowledge holds. Returns NULL if nothing is known for the given
+ * generation.
+ */
+static GHashTable *read_valid_paths(int fd, const gchar *gc_generation)
+{
+    gchar *contents = read_fd(fd);
+    GHashTable *valid_paths = NULL;
+    
+    if(contents != NULL)
+    {
+        gchar **lines = g_strsplit(g_strchomp(contents), "\n", -1);
+        
+        if(lines[0] != NULL && g_strcmp0(lines[0], gc_generation) == 0)
+        {
+            unsigned int i;
+            valid_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+            
+            for(i = 1; lines[i] != NULL; i++)
+                g_hash_table_insert(valid_paths, g_strdup(lines[i]), NULL);
+        }
+        
+        g_strfreev(lines);
+        g_free(contents);
+    }
+    
+    return valid_paths;
+}
+
+gchar **closure_cache_filter_valid_paths(const gchar *target, const gchar *gc_generation, gchar **paths)
+{
+    gchar *valid_paths_file;
+    GHashTable *valid_paths = NULL;
+    GPtrArray *result;
+    unsigned int i;
+    int fd;
+    
+    if(!closure_cache_is_enabled() || (valid_paths_file = compose_valid_paths_file(target)) == NULL)
+        return g_strdupv(paths);
+    
+    fd = open(valid_paths_file, O_RDONLY);
+    g_free(valid_paths_file);
+    
+    /* The shared lock prevents us from observing a partially appended line */
+    if(fd != -1)
+    {
+        if(flock(fd, LOCK_SH) == 0)
+            valid_paths = read_valid_paths(fd, gc_generation);
+        
+        close(fd);
+    }
+    
+    if(valid_paths == NULL)
+        return g_strdupv(paths);
+    
+    result = g_ptr_array_new();
+    
+    for(i = 0; paths[i] != NULL; i++)
+    {
+        if(!g_hash_table_contains(valid_paths, paths[i]))
+            g_ptr_array_add(result, g_strdup(paths[i]));
+    }
+    
+    g_ptr_array_add(result, NULL);
+    g_hash_table_destroy(valid_paths);
+    
+    return (gchar**)g_ptr_array_free(result, FALSE);
+}
+
+void closure_cache_add_valid_paths(const gchar *target, const gchar *gc_generation, gchar **paths)
+{
+    gchar *valid_paths_file;
+    
+    if(closure_cache_is_enabled() && (valid_paths_file = compose_valid_paths_file(target)) != NULL)
+    {
+        int fd = open(valid_paths_file, O_RDWR | O_CREAT, 0644);
+        
+        /* Concurrent transfers to the same target update the file one at the time, so that none of their additions get lost */
+        if(fd != -1 && flock(fd, LOCK_EX) == 0)
+        {
+            GHashTable *valid_paths = read_valid_paths(fd, gc_generation);
+            GString *contents = g_string_new("");
+            int writable = TRUE;
+            unsigned int i;
+            
+            /* If the generation has changed, previously known paths are discarded */
+            if(valid_paths == NULL)
+            {
+                valid_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+                writable = (ftruncate(fd, 0) == 0);
+                g_string_append_printf(contents, "%s\n", gc_generation);
+            }
+            
+            /* Only append the paths that are not known yet */
+            for(i = 0; paths[i] != NULL; i++)
+            {
+                if(!g_hash_table_contains(valid_paths, paths[i]))
+                {
+                    g_hash_table_insert(valid_paths, g_strdup(paths[i]), NULL);
+                    g_string_append_printf(contents, "%s\n", paths[i]);
+                }
+            }
+            
+            if(writable && contents->len > 0 && lseek(fd, 0, SEEK_END) != -1)
+                write_fd(fd, contents->str, contents->len);
+            
+            /* Cleanup */
+            g_string_free(contents, TRUE);
+            g_hash_table_destroy(valid_paths);
+        }
+        
+        if(fd != -1)
+            close(fd);
+        
+        g_free(valid_paths_file);
+    }
+}
+
+void closure_cache_forget_valid_paths(const gchar *target)
+{
+    gchar *valid_paths_file;
+    
+    if(closure_cache_is_enabled() && (valid_paths_file = compose_valid_paths_file(target)) != NULL)
+    {
+        int fd = open(valid_paths_file, O_RDWR);
+        
+        /* Truncate under the lock, so that a concurrent transfer does not append to a discarded file */
+        if(fd != -1)
+        {
+            if(flock(fd, LOCK_EX) == 0)
+                ftruncate(fd, 0);
+            
+            close(fd);
+        }
+        
+        g_free(valid_paths_file);
+    }
+}
+
+static guint64 determine_export_cache_size(void)
+{
+    const char *export_cache_size = getenv("DISNIX_EXPORT_CACHE_SIZE");
+    
+    if(export_cache_size == NULL)
+        return (guint64)DEFAULT_EXPORT_CACHE_SIZE * 1024 * 1024;
+    else
+        return g_ascii_strtoull(export_cache_size, NULL, 10) * 1024 * 1024;
+}
+
+typedef struct
+{
+    gchar *filename;
+    off_t size;
+    time_t mtime;
+}
+ExportEntry;
+
+static gint compare_export_entry(const ExportEntry **l, const ExportEntry **r)
+{
+    const ExportEntry *left = *l;
+    const ExportEntry *right = *r;
+    
+    if(left->mtime < right->mtime)
+        return -1;
+    else if(left->mtime > right->mtime)
+        return 1;
+    else
+        return 0;
+}
+
+static void delete_export_entry(ExportEntry *entry)
+{
+    g_free(entry->filename);
+    g_free(entry);
+}
+
+/* Removes the least recently used serialisations until the cache fits within its size limit */
+static void evict_exports(const gchar *exports_dir)
+{
+    GDir *dir = g_dir_open(exports_dir, 0, NULL);
+    
+    if(dir != NULL)
+    {
+        const gchar *name;
+        guint64 total_size = 0, max_size = determine_export_cache_size();
+        GPtrArray *entries = g_ptr_array_new_with_free_func((GDestroyNotify)delete_export_entry);
+        unsigned int i;
+        
+        while((name = g_dir_read_name(dir)) != NULL)
+        {
+            struct stat st;
+            gchar *filename;
+            
+            if(!g_str_has_suffix(name, ".closure"))
+                continue;
+            
+            filename = g_build_filename(exports_dir, name, NULL);
+            
+            if(stat(filename, &st) == 0)
+            {
+                ExportEntry *entry = g_malloc(sizeof(ExportEntry));
+                entry->filename = filename;
+                entry->size = st.st_size;
+                entry->mtime = st.st_mtime;
+                g_ptr_array_add(entries, entry);
+                total_size += st.st_size;
+            }
+            else
+                g_free(filename);
+        }
+        
+        g_ptr_array_sort(entries, (GCompareFunc)compare_export_entry);
+        
+        for(i = 0; i < entries->len && total_size > max_size; i++)
+        {
+            ExportEntry *entry = g_ptr_array_index(entries, i);
+            
+            /*
+             * Processes that still have the file opened can continue reading
+             * it. The lock file is kept, because another process may hold a
+             * lock on it, and a process that recreated it would not exclude
+             * that one
+             */
+            if(unlink(entry->filename) == 0)
+                total_size -= entry->size;
+        }
+        
+        g_ptr_array_free(entries, TRUE);
+        g_dir_close(dir);
+    }
+}
+
+static int create_export(const gchar *exports_dir, gchar *path, const gchar *export_file)
+{
+    gchar *tempfilename = g_build_filename(exports_dir, "disnix.XXXXXX", NULL);
+    int temp_fd = mkstemp(tempfilename);
+    int success = FALSE;
+    
+    if(temp_fd != -1)
+    {
+        gchar *paths[] = { path, NULL };
+        ProcReact_Status status;
+        pid_t pid = pkgmgmt_export_closure_fd(paths, temp_fd, 2);
+        int result = procreact_wait_for_boolean(pid, &status);
+        struct stat st;
+        
+        /*
+         * nix-store --export terminates its output with a 64-bit zero. Strip
+         * it, so that serialisations of individual paths can be concatenated
+         */
+        if(status == PROCREACT_STATUS_OK && result
+          && fstat(temp_fd, &st) == 0 && st.st_size >= EXPORT_TERMINATOR_SIZE
+          && ftruncate(temp_fd, st.st_size - EXPORT_TERMINATOR_SIZE) == 0
+          && rename(tempfilename, export_file) == 0)
+            success = TRUE;
+        else
+            unlink(tempfilename);
+        
+        close(temp_fd);
+    }
+    
+    g_free(tempfilename);
+    return success;
+}
+
+static int open_export(const gchar *exports_dir, gchar *path)
+{
+    gchar *basename = g_path_get_basename(path);
+    gchar *export_file = g_strconcat(exports_dir, "/", basename, ".closure", NULL);
+    gchar *lock_file = g_strconcat(exports_dir, "/", basename, ".lock", NULL);
+    int lock_fd = open(lock_file, O_CREAT | O_RDWR, 0644);
+    int export_fd = -1;
+    
+    /* The lock ensures that a path is exported once, while concurrent processes wait for the result */
+    if(lock_fd != -1 && flock(lock_fd, LOCK_EX) == 0)
+    {
+        export_fd = open(export_file, O_RDONLY);
+        
+        if(export_fd == -1)
+        {
+            if(create_export(exports_dir, path, export_file))
+                export_fd = open(export_file, O_RDONLY);
+            
+            close(lock_fd);
+            lock_fd = -1;
+            
+            evict_exports(exports_dir);
+        }
+        else
+            utimes(export_file, NULL); /* Mark the serialisation as recently used */
+    }
+    
+    if(lock_fd != -1)
+        close(lock_fd);
+    
+    g_free(basename);
+    g_free(export_file);
+    g_free(lock_file);
+    
+    return export_fd;
+}
+
+static int copy_fd(int input_fd, int output_fd)
+{
+    char buffer[BUFFER_SIZE];
+    ssize_t bytes_read;
+    
+    while((bytes_read = read(input_fd, buffer, BUFFER_SIZE)) > 0)
+    {
+        ssize_t offset = 0;
+        
+        while(offset < bytes_read)
+        {
+            ssize_t bytes_written = write(output_fd, buffer + offset, bytes_read - offset);
+            
+            if(bytes_written == -1)
+                return FALSE;
+            
+            offset += bytes_written;
+        }
+    }
+    
+    return (bytes_read == 0);
+}
+
+pid_t closure_cache_export_closure_fd(gchar **paths, int closure_fd)
+{
+    gchar *exports_dir;
+    pid_t pid;
+    
+    if(!closure_cache_is_enabled() || (exports_dir = open_cache_dir("exports")) == NULL)
+        return pkgmgmt_export_closure_fd(paths, closure_fd, 2);
+    
+    pid = fork();
+    
+    if(pid == 0)
+    {
+        unsigned int i;
+        char terminator[EXPORT_TERMINATOR_SIZE];
+        
+        for(i = 0; paths[i] != NULL; i++)
+        {
+            int export_fd = open_export(exports_dir, paths[i]);
+            
+            if(export_fd == -1)
+            {
+                g_printerr("Cannot export: %s\n", paths[i]);
+                _exit(1);
+            }
+            
+            if(!copy_fd(export_fd, closure_fd))
+                _exit(1);
+            
+            close(export_fd);
+        }
+        
+        /* Terminate the stream in the same way as nix-store --export */
+        memset(terminator, '\0', EXPORT_TERMINATOR_SIZE);
+        _exit(write(closure_fd, terminator, EXPORT_TERMINATOR_SIZE) != EXPORT_TERMINATOR_SIZE);
+    }
+    
+    g_free(exports_dir);
+    return pid;
+}
@@ -0,0 +1,113 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __DISNIX_CLOSURE_CACHE_H
+#define __DISNIX_CLOSURE_CACHE_H
+#include <sys/types.h>
+#include <glib.h>
+#include <procreact_future.h>
+
+/*
+ * The closure cache is a persistent cache on the coordinator machine that
+ * records the requisites of Nix store paths and the paths that are known to be
+ * valid on each target machine. Because store paths are immutable, the
+ * requisites never change. The knowledge about valid paths on a target is
+ * tied to the target's garbage collection generation marker and discarded as
+ * soon as the marker changes.
+ *
+ * The marker only changes when garbage is collected through the Disnix
+ * service. Garbage that is collected by other means, such as nix.gc.automatic
+ * on NixOS or running nix-collect-garbage directly, goes unnoticed and the
+ * cache still considers the deleted paths valid. Therefore, the requested
+ * paths themselves are always checked on the target, and a transfer that
+ * fails is retried after forgetting the valid paths of the target.
+ *
+ * Moreover, it keeps the serialisations of individual store paths, so that a
+ * store path that must be sent to many targets only gets exported once. The
+ * size of the serialisations is bounded by $DISNIX_EXPORT_CACHE_SIZE
+ * (in MiB, defaults to 1024) and the least recently used ones are discarded
+ * first.
+ *
+ * The cache resides in $DISNIX_CACHE_DIR, defaulting to the disnix
+ * subdirectory of the user's cache directory. It can be disabled by setting
+ * the DISNIX_NO_CACHE environment variable.
+ */
+
+/** Pointer to a function that queries the requisites of a collection of store paths */
+typedef ProcReact_Future (*closure_cache_query_requisites_function) (gchar **paths, void *data);
+
+/**
+ * Checks whether the closure cache is enabled.
+ *
+ * @return TRUE if the cache is enabled, else FALSE
+ */
+int closure_cache_is_enabled(void);
+
+/**
+ * Determines the union of the requisites of the given store paths. Requisites
+ * of paths that are not in the cache are retrieved with the provided query
+ * function and memorized.
+ *
+ * @param paths NULL-terminated array of Nix store paths
+ * @param query_requisites Function that queries the requisites of store paths
+ * @param data Pointer to arbitrary data passed to the query function
+ * @return A NULL-terminated array of requisites that can be freed with g_strfreev() or NULL if the query failed
+ */
+gchar **closure_cache_query_requisites(gchar **paths, closure_cache_query_requisites_function query_requisites, void *data);
+
+/**
+ * Filters out the paths that are known to be valid on a target machine.
+ *
+ * @param target Key that uniquely identifies the target machine
+ * @param gc_generation Current garbage collection generation marker of the target
+ * @param paths NULL-terminated array of Nix store paths
+ * @return A NULL-terminated array of the paths whose validity is unknown that can be freed with g_strfreev()
+ */
+gchar **closure_cache_filter_valid_paths(const gchar *target, const gchar *gc_generation, gchar **paths);
+
+/**
+ * Records that the given paths are valid on a target machine.
+ *
+ * @param target Key that uniquely identifies the target machine
+ * @param gc_generation Current garbage collection generation marker of the target
+ * @param paths NULL-terminated array of Nix store paths
+ */
+void closure_cache_add_valid_paths(const gchar *target, const gchar *gc_generation, gchar **paths);
+
+/**
+ * Discards all paths that are known to be valid on a target machine, for
+ * example because garbage has been collected without changing its marker.
+ *
+ * @param target Key that uniquely identifies the target machine
+ */
+void closure_cache_forget_valid_paths(const gchar *target);
+
+/**
+ * Writes the serialisation of the given store paths to a file descriptor. The
+ * outcome is identical to nix-store --export, but each individual store path
+ * is exported only once and reused by subsequent invocations, including
+ * invocations by other processes running concurrently.
+ *
+ * @param paths NULL-terminated array of Nix store paths in the order in which they must be imported
+ * @param closure_fd File descriptor to which the serialisation is written
+ * @return PID of the process writing the serialisation
+ */
+pid_t closure_cache_export_closure_fd(gchar **paths, int closure_fd);
+
+#endif
@@ -0,0 +1,510 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "copy-closure.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <procreact_pid.h>
+#include <procreact_future.h>
+#include <package-management.h>
+#include "client-interface.h"
+#include "closure-cache.h"
+#include "transfer-statistics.h"
+
+#define RELAY_BUFFER_SIZE 65536
+#define DEFAULT_PROGRESS_INTERVAL 5
+
+typedef struct
+{
+    gchar *interface;
+    gchar *target;
+    gchar **paths;
+}
+RemoteTarget;
+
+static char **retrieve_paths(ProcReact_Future future)
+{
+    ProcReact_Status status;
+    char **result = procreact_future_get(&future, &status);
+    
+    if(status == PROCREACT_STATUS_OK)
+        return result;
+    else
+    {
+        procreact_free_string_array(result);
+        return NULL;
+    }
+}
+
+static ProcReact_Future query_local_requisites(gchar **paths, void *data)
+{
+    return pkgmgmt_query_requisites(paths, 2);
+}
+
+static ProcReact_Future query_remote_requisites(gchar **paths, void *data)
+{
+    RemoteTarget *remote_target = (RemoteTarget*)data;
+    return exec_query_requisites_of_paths(remote_target->interface, remote_target->target, paths);
+}
+
+/* Maps targets to the garbage collection generation markers that have been queried up front, or to an empty string if they do not provide one */
+static GHashTable *gc_generation_table = NULL;
+
+void remember_gc_generation(const gchar *target, const gchar *gc_generation)
+{
+    if(gc_generation_table == NULL)
+        gc_generation_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    
+    g_hash_table_insert(gc_generation_table, g_strdup(target), g_strdup(gc_generation == NULL ? "" : gc_generation));
+}
+
+static gchar *query_gc_generation(gchar *interface, gchar *target)
+{
+    char **result;
+    gchar *gc_generation = NULL;
+    
+    if(!closure_cache_is_enabled())
+        return NULL;
+    
+    /* Use the marker that the coordinator has queried before forking the transfers, if any */
+    if(gc_generation_table != NULL && (gc_generation = g_hash_table_lookup(gc_generation_table, target)) != NULL)
+        return (gc_generation[0] == '\0') ? NULL : g_strdup(gc_generation);
+    
+    /* Targets running an older Disnix service do not provide a marker, in which case their valid paths are not cached */
+    result = retrieve_paths(exec_query_gc_generation(interface, target));
+    
+    if(result != NULL && result[0] != NULL)
+        gc_generation = g_strdup(result[0]);
+    
+    procreact_free_string_array(result);
+    return gc_generation;
+}
+
+static int create_stream_pipe(int pipefd[2])
+{
+    if(pipe(pipefd) == -1)
+        return FALSE;
+    else
+    {
+        /* Prevent the processes executed on both ends from inheriting the other end, so that the import side observes the end of the stream */
+        fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+        fcntl(pipefd[1], F_SETFD, FD_CLOEXEC);
+        return TRUE;
+    }
+}
+
+static int wait_for_stream(pid_t export_pid, pid_t import_pid)
+{
+    ProcReact_Status export_status, import_status;
+    int import_result = procreact_wait_for_boolean(import_pid, &import_status);
+    int export_result;
+    
+    /* If the import side fails, the export side may block forever on a full pipe */
+    if(import_status != PROCREACT_STATUS_OK || !import_result)
+        kill(export_pid, SIGTERM);
+    
+    export_result = procreact_wait_for_boolean(export_pid, &export_status);
+    
+    return (export_status == PROCREACT_STATUS_OK && export_result && import_status == PROCREACT_STATUS_OK && import_result);
+}
+
+static guint64 query_total_size(gchar **paths)
+{
+    char **sizes = retrieve_paths(pkgmgmt_query_sizes(paths, 2));
+    guint64 total_size = 0;
+    
+    if(sizes != NULL)
+    {
+        unsigned int i;
+        
+        for(i = 0; sizes[i] != NULL; i++)
+            total_size += g_ascii_strtoull(sizes[i], NULL, 10);
+    }
+    
+    procreact_free_string_array(sizes);
+    return total_size;
+}
+
+static gint64 read_progress_interval(void)
+{
+    char *progress_interval = getenv("DISNIX_PROGRESS_INTERVAL");
+    
+    if(progress_interval == NULL)
+        return DEFAULT_PROGRESS_INTERVAL * G_USEC_PER_SEC;
+    else
+        return atoi(progress_interval) * G_USEC_PER_SEC;
+}
+
+static void print_progress(const gchar *target, const gchar *action, guint64 transferred, guint64 total_size, gint64 elapsed, guint64 rate)
+{
+    gchar *transferred_str = transfer_statistics_format_size(transferred);
+    gchar *rate_str = transfer_statistics_format_size(rate);
+    
+    if(total_size == 0)
+        g_printerr("[target: %s]: %s %s, %s/s, elapsed: %" G_GINT64_FORMAT "s\n", target, action, transferred_str, rate_str, elapsed / G_USEC_PER_SEC);
+    else
+    {
+        guint64 remaining = (total_size > transferred) ? total_size - transferred : 0;
+        gchar *total_size_str = transfer_statistics_format_size(total_size);
+        gchar *remaining_str = transfer_statistics_format_size(remaining);
+        
+        if(rate > 0)
+            g_printerr("[target: %s]: %s %s of %s, %s/s, %s remaining, elapsed: %" G_GINT64_FORMAT "s, ETA: %" G_GUINT64_FORMAT "s\n", target, action, transferred_str, total_size_str, rate_str, remaining_str, elapsed / G_USEC_PER_SEC, remaining / rate);
+        else
+            g_printerr("[target: %s]: %s %s of %s, %s/s, %s remaining, elapsed: %" G_GINT64_FORMAT "s\n", target, action, transferred_str, total_size_str, rate_str, remaining_str, elapsed / G_USEC_PER_SEC);
+        
+        g_free(total_size_str);
+        g_free(remaining_str);
+    }
+    
+    g_free(transferred_str);
+    g_free(rate_str);
+}
+
+static int write_fully(int fd, const gchar *buffer, ssize_t length)
+{
+    while(length > 0)
+    {
+        ssize_t bytes_written = write(fd, buffer, length);
+        
+        if(bytes_written == -1)
+        {
+            if(errno != EINTR)
+                return FALSE;
+        }
+        else
+        {
+            buffer += bytes_written;
+            length -= bytes_written;
+        }
+    }
+    
+    return TRUE;
+}
+
+/*
+ * Relays the closure serialisation from the export side to the import side,
+ * while counting the bytes and periodically reporting the progress. Progress
+ * is also reported if the stream stalls, so that slow links can be spotted.
+ */
+static int relay_stream(int export_fd, int import_fd, const gchar *target, const gchar *action, guint64 total_size)
+{
+    gchar buffer[RELAY_BUFFER_SIZE];
+    gint64 progress_interval = read_progress_interval();
+    gint64 start_time = g_get_monotonic_time();
+    gint64 real_start_time = g_get_real_time();
+    gint64 last_report = start_time;
+    guint64 transferred = 0, last_transferred = 0;
+    struct pollfd export_pollfd = { export_fd, POLLIN, 0 };
+    int success = TRUE;
+    void (*previous_handler)(int);
+    
+    /* A failing import must not kill this process, but result in a write error */
+    previous_handler = signal(SIGPIPE, SIG_IGN);
+    
+    while(TRUE)
+    {
+        gint64 now = g_get_monotonic_time();
+        int timeout = (progress_interval > 0) ? MAX(0, (last_report + progress_interval - now) / 1000) : -1;
+        int status = poll(&export_pollfd, 1, timeout);
+        
+        if(status == -1 && errno != EINTR)
+        {
+            success = FALSE;
+            break;
+        }
+        else if(status > 0)
+        {
+            ssize_t bytes_read = read(export_fd, buffer, RELAY_BUFFER_SIZE);
+            
+            if(bytes_read == 0)
+                break; /* End of the stream */
+            else if(bytes_read == -1)
+            {
+                if(errno != EINTR)
+                {
+                    success = FALSE;
+                    break;
+                }
+            }
+            else if(write_fully(import_fd, buffer, bytes_read))
+                transferred += bytes_read;
+            else
+            {
+                success = FALSE;
+                break;
+            }
+        }
+        
+        now = g_get_monotonic_time();
+        
+        if(progress_interval > 0 && now - last_report >= progress_interval)
+        {
+            guint64 rate = (transferred - last_transferred) * G_USEC_PER_SEC / (now - last_report);
+            print_progress(target, action, transferred, total_size, now - start_time, rate);
+            last_report = now;
+            last_transferred = transferred;
+        }
+    }
+    
+    signal(SIGPIPE, previous_handler);
+    
+    if(success)
+    {
+        gint64 elapsed = g_get_monotonic_time() - start_time;
+        guint64 rate = (elapsed > 0) ? transferred * G_USEC_PER_SEC / elapsed : transferred;
+        gchar *transferred_str = transfer_statistics_format_size(transferred);
+        gchar *rate_str = transfer_statistics_format_size(rate);
+        
+        g_printerr("[target: %s]: %s %s in %.1fs, average: %s/s\n", target, action, transferred_str, (double)elapsed / G_USEC_PER_SEC, rate_str);
+        transfer_statistics_record(target, transferred, real_start_time, g_get_real_time());
+        
+        g_free(transferred_str);
+        g_free(rate_str);
+    }
+    
+    return success;
+}
+
+/*
+ * Connects the export and import processes through this process, which
+ * relays the stream and monitors its progress.
+ */
+static pid_t spawn_local_export(int fd, void *data)
+{
+    RemoteTarget *remote_target = (RemoteTarget*)data;
+    /* The serialisation of each path is cached, so that it is reused for other targets */
+    return closure_cache_export_closure_fd(remote_target->paths, fd);
+}
+
+static pid_t spawn_remote_import(int fd, void *data)
+{
+    RemoteTarget *remote_target = (RemoteTarget*)data;
+    return exec_import_closure_stream(remote_target->interface, remote_target->target, fd);
+}
+
+static pid_t spawn_remote_export(int fd, void *data)
+{
+    RemoteTarget *remote_target = (RemoteTarget*)data;
+    return exec_export_closure_stream(remote_target->interface, remote_target->target, remote_target->paths, fd);
+}
+
+static pid_t spawn_local_import(int fd, void *data)
+{
+    return pkgmgmt_import_closure_fd(fd, 1, 2);
+}
+
+static int transfer_stream(pid_t (*spawn_export)(int fd, void *data), pid_t (*spawn_import)(int fd, void *data), void *data, const gchar *target, const gchar *action, guint64 total_size)
+{
+    int export_pipe[2], import_pipe[2];
+    pid_t export_pid, import_pid;
+    int relay_success, stream_success;
+    
+    if(!create_stream_pipe(export_pipe))
+        return FALSE;
+    
+    if(!create_stream_pipe(import_pipe))
+    {
+        close(export_pipe[0]);
+        close(export_pipe[1]);
+        return FALSE;
+    }
+    
+    export_pid = spawn_export(export_pipe[1], data);
+    import_pid = spawn_import(import_pipe[0], data);
+    
+    close(export_pipe[1]);
+    close(import_pipe[0]);
+    
+    relay_success = relay_stream(export_pipe[0], import_pipe[1], target, action, total_size);
+    
+    /* Closing both ends lets the import side observe the end of the stream and a blocked export side fail */
+    close(export_pipe[0]);
+    close(import_pipe[1]);
+    
+    stream_success = wait_for_stream(export_pid, import_pid);
+    return (relay_success && stream_success);
+}
+
+static gchar **filter_valid_paths(const gchar *target, const gchar *gc_generation, gchar **requisites, gchar **paths)
+{
+    gchar **unknown_paths = closure_cache_filter_valid_paths(target, gc_generation, requisites);
+    GHashTable *candidate_table = g_hash_table_new(g_str_hash, g_str_equal);
+    GPtrArray *candidates = g_ptr_array_new();
+    unsigned int i;
+    
+    /* The given paths are always checked, so that garbage collected outside of Disnix cannot leave them out of the transfer */
+    for(i = 0; unknown_paths[i] != NULL; i++)
+        g_hash_table_insert(candidate_table, unknown_paths[i], NULL);
+    
+    for(i = 0; paths[i] != NULL; i++)
+        g_hash_table_insert(candidate_table, paths[i], NULL);
+    
+    /* Keep the order of the requisites, so that the paths are imported in the right order */
+    for(i = 0; requisites[i] != NULL; i++)
+    {
+        if(g_hash_table_contains(candidate_table, requisites[i]))
+            g_ptr_array_add(candidates, g_strdup(requisites[i]));
+    }
+    
+    g_ptr_array_add(candidates, NULL);
+    
+    g_hash_table_destroy(candidate_table);
+    g_strfreev(unknown_paths);
+    
+    return (gchar**)g_ptr_array_free(candidates, FALSE);
+}
+
+static int send_missing_paths(gchar *interface, gchar *target, gchar **paths, gchar **requisites, const gchar *gc_generation)
+{
+    gchar **candidates;
+    char **invalid_paths;
+    int success;
+    
+    /* Leave out the paths that are already known to be valid on the target machine */
+    if(gc_generation == NULL)
+        candidates = g_strdupv(requisites);
+    else
+        candidates = filter_valid_paths(target, gc_generation, requisites, paths);
+    
+    if(candidates[0] == NULL)
+    {
+        g_strfreev(candidates);
+        return TRUE; /* Nothing has to be checked */
+    }
+    
+    /* Ask the target machine which of the requisites are missing */
+    invalid_paths = retrieve_paths(exec_print_invalid(interface, target, candidates));
+    
+    if(invalid_paths == NULL)
+    {
+        g_printerr("[target: %s]: Cannot check which paths are missing!\n", target);
+        success = FALSE;
+    }
+    else if(invalid_paths[0] == NULL)
+        success = TRUE; /* Nothing has to be copied */
+    else
+    {
+        /*
+         * Stream the serialisation of the missing paths directly into the
+         * import operation of the target machine
+         */
+        RemoteTarget remote_target = { interface, target, invalid_paths };
+        guint64 total_size = query_total_size(invalid_paths);
+        
+        success = transfer_stream(spawn_local_export, spawn_remote_import, &remote_target, target, "Sent", total_size);
+        
+        if(!success)
+            g_printerr("[target: %s]: Cannot stream the closure!\n", target);
+    }
+    
+    /* Memorize that all candidates are now valid on the target machine */
+    if(success && gc_generation != NULL)
+        closure_cache_add_valid_paths(target, gc_generation, candidates);
+    
+    /* Cleanup */
+    g_strfreev(candidates);
+    procreact_free_string_array(invalid_paths);
+    
+    return success;
+}
+
+int copy_closure_to_sync(gchar *interface, gchar *target, gchar **paths)
+{
+    gchar **requisites, *gc_generation;
+    int success;
+    
+    /* Query the requisites of the given paths */
+    requisites = closure_cache_query_requisites(paths, query_local_requisites, NULL);
+    
+    if(requisites == NULL)
+    {
+        g_printerr("[target: %s]: Cannot query the requisites of the closure to send!\n", target);
+        return FALSE;
+    }
+    
+    /* Send the requisites that are missing on the target machine */
+    gc_generation = query_gc_generation(interface, target);
+    success = send_missing_paths(interface, target, paths, requisites, gc_generation);
+    
+    /*
+     * Garbage collected outside of Disnix does not change the generation
+     * marker, so the cache may have left out paths that no longer exist.
+     * Forget what is known about the target and check all requisites again.
+     */
+    if(!success && gc_generation != NULL)
+    {
+        g_printerr("[target: %s]: Retrying without the cached valid paths...\n", target);
+        closure_cache_forget_valid_paths(target);
+        success = send_missing_paths(interface, target, paths, requisites, NULL);
+    }
+    
+    /* Cleanup */
+    g_strfreev(requisites);
+    g_free(gc_generation);
+    
+    return success;
+}
+
+int copy_closure_from_sync(gchar *interface, gchar *target, gchar **paths)
+{
+    gchar **requisites;
+    char **invalid_paths;
+    int success;
+    RemoteTarget remote_target = { interface, target, NULL };
+    
+    /* Query the requisites of the given paths on the target machine */
+    requisites = closure_cache_query_requisites(paths, query_remote_requisites, &remote_target);
+    
+    if(requisites == NULL)
+    {
+        g_printerr("[target: %s]: Cannot query the requisites of the closure to receive!\n", target);
+        return FALSE;
+    }
+    
+    /* Check which of the requisites are missing on this machine */
+    invalid_paths = retrieve_paths(pkgmgmt_print_invalid_packages(requisites, 2));
+    
+    if(invalid_paths == NULL)
+    {
+        g_printerr("[coordinator]: Cannot check which paths are missing!\n");
+        success = FALSE;
+    }
+    else if(invalid_paths[0] == NULL)
+        success = TRUE; /* Nothing has to be copied */
+    else
+    {
+        /* Stream the serialisation of the missing paths from the target machine directly into the Nix store */
+        remote_target.paths = invalid_paths;
+        success = transfer_stream(spawn_remote_export, spawn_local_import, &remote_target, target, "Received", 0);
+        
+        if(!success)
+            g_printerr("[target: %s]: Cannot stream the closure!\n", target);
+    }
+    
+    /* Cleanup */
+    g_strfreev(requisites);
+    procreact_free_string_array(invalid_paths);
+    
+    return success;
+}
@@ -0,0 +1,60 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __DISNIX_COPY_CLOSURE_H
+#define __DISNIX_COPY_CLOSURE_H
+#include <glib.h>
+
+/**
+ * Copies the closure of the given Nix store paths to a target machine. It
+ * determines which requisites are missing on the target and streams the
+ * output of nix-store --export directly into the import operation of the
+ * client interface, without storing the serialisation in a temp file.
+ *
+ * @param interface Path to the interface executable
+ * @param target Target Address of the remote interface
+ * @param paths Nix store paths to copy (including all intra-dependencies)
+ * @return TRUE if the closure has been successfully copied, else FALSE
+ */
+int copy_closure_to_sync(gchar *interface, gchar *target, gchar **paths);
+
+/**
+ * Remembers the garbage collection generation marker of a target machine.
+ * Tools that copy many closures to the same target can query the marker once
+ * and remember it before forking the transfers, so that each transfer does
+ * not need an additional round trip to query it.
+ *
+ * @param target Target Address of the remote interface
+ * @param gc_generation Garbage collection generation marker, or NULL if the target does not provide one
+ */
+void remember_gc_generation(const gchar *target, const gchar *gc_generation);
+
+/**
+ * Copies the closure of the given Nix store paths from a target machine. It
+ * determines which requisites are missing on this machine and streams the
+ * export operation of the client interface directly into nix-store --import.
+ *
+ * @param interface Path to the interface executable
+ * @param target Target Address of the remote interface
+ * @param paths Nix store paths to copy (including all intra-dependencies)
+ * @return TRUE if the closure has been successfully copied, else FALSE
+ */
+int copy_closure_from_sync(gchar *interface, gchar *target, gchar **paths);
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "transfer-statistics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define TRANSFER_LOG_VARIABLE "DISNIX_TRANSFER_LOG"
+
+typedef struct
+{
+    gchar *target;
+    unsigned int transfers;
+    guint64 bytes;
+    gint64 first_start;
+    gint64 last_end;
+}
+TargetStatistics;
+
+gchar *transfer_statistics_start(void)
+{
+    gchar *log_path;
+    int fd = g_file_open_tmp("disnix-transfers-XXXXXX", &log_path, NULL);
+    
+    if(fd == -1)
+    {
+        g_printerr("[coordinator]: Cannot create a transfer log!\n");
+        return NULL;
+    }
+    
+    close(fd);
+    setenv(TRANSFER_LOG_VARIABLE, log_path, TRUE);
+    return log_path;
+}
+
+void transfer_statistics_record(const gchar *target, guint64 bytes, gint64 start_time, gint64 end_time)
+{
+    const char *log_path = getenv(TRANSFER_LOG_VARIABLE);
+    
+    if(log_path != NULL)
+    {
+        int fd = open(log_path, O_WRONLY | O_APPEND);
+        
+        if(fd != -1)
+        {
+            /* Records are written in a single append, so that records of concurrent processes do not interleave */
+            gchar *record = g_strdup_printf("%s\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\n", target, bytes, start_time, end_time);
+            
+            if(write(fd, record, strlen(record)) == -1)
+                g_printerr("[target: %s]: Cannot record the transfer statistics!\n", target);
+            
+            g_free(record);
+            close(fd);
+        }
+    }
+}
+
+gchar *transfer_statistics_format_size(guint64 bytes)
+{
+    if(bytes >= 1024 * 1024 * 1024)
+        return g_strdup_printf("%.1f GiB", (double)bytes / (1024 * 1024 * 1024));
+    else if(bytes >= 1024 * 1024)
+        return g_strdup_printf("%.1f MiB", (double)bytes / (1024 * 1024));
+    else if(bytes >= 1024)
+        return g_strdup_printf("%.1f KiB", (double)bytes / 1024);
+    else
+        return g_strdup_printf("%" G_GUINT64_FORMAT " B", bytes);
+}
+
+static gint compare_target_statistics(gconstpointer l, gconstpointer r)
+{
+    const TargetStatistics *left = *((TargetStatistics **)l);
+    const TargetStatistics *right = *((TargetStatistics **)r);
+    
+    return g_strcmp0(left->target, right->target);
+}
+
+static GPtrArray *aggregate_records(gchar *contents)
+{
+    GPtrArray *statistics_array = g_ptr_array_new();
+    GHashTable *statistics_table = g_hash_table_new(g_str_hash, g_str_equal);
+    gchar **records = g_strsplit(contents, "\n", 0);
+    unsigned int i;
+    
+    for(i = 0; records[i] != NULL; i++)
+    {
+        gchar **fields = g_strsplit(records[i], "\t", 4);
+        
+        if(g_strv_length(fields) == 4)
+        {
+            TargetStatistics *statistics = g_hash_table_lookup(statistics_table, fields[0]);
+            gint64 start_time = g_ascii_strtoll(fields[2], NULL, 10);
+            gint64 end_time = g_ascii_strtoll(fields[3], NULL, 10);
+            
+            if(statistics == NULL)
+            {
+                statistics = (TargetStatistics*)g_malloc0(sizeof(TargetStatistics));
+                statistics->target = g_strdup(fields[0]);
+                statistics->first_start = start_time;
+                statistics->last_end = end_time;
+                g_hash_table_insert(statistics_table, statistics->target, statistics);
+                g_ptr_array_add(statistics_array, statistics);
+            }
+            
+            statistics->transfers++;
+            statistics->bytes += g_ascii_strtoull(fields[1], NULL, 10);
+            
+            /* Transfers to the same target may run concurrently, so the rate is based on the time from the first start to the last end */
+            statistics->first_start = MIN(statistics->first_start, start_time);
+            statistics->last_end = MAX(statistics->last_end, end_time);
+        }
+        
+        g_strfreev(fields);
+    }
+    
+    g_strfreev(records);
+    g_hash_table_destroy(statistics_table);
+    
+    g_ptr_array_sort(statistics_array, compare_target_statistics);
+    return statistics_array;
+}
+
+static void print_target_statistics(const TargetStatistics *statistics)
+{
+    double seconds = (double)(statistics->last_end - statistics->first_start) / G_USEC_PER_SEC;
+    gchar *bytes = transfer_statistics_format_size(statistics->bytes);
+    gchar *rate = transfer_statistics_format_size(seconds > 0 ? statistics->bytes / seconds : statistics->bytes);
+    
+    g_printerr("%-30s %9u %12s %9.1fs %12s/s\n", statistics->target, statistics->transfers, bytes, seconds, rate);
+    
+    g_free(bytes);
+    g_free(rate);
+}
+
+void transfer_statistics_print_summary(gchar *log_path)
+{
+    gchar *contents;
+    
+    if(log_path == NULL)
+        return;
+    
+    if(g_file_get_contents(log_path, &contents, NULL, NULL))
+    {
+        GPtrArray *statistics_array = aggregate_records(contents);
+        unsigned int i;
+        
+        if(statistics_array->len > 0)
+        {
+            g_printerr("[coordinator]: Transfer summary:\n");
+            g_printerr("%-30s %9s %12s %10s %14s\n", "Target", "Transfers", "Bytes", "Elapsed", "Rate");
+            
+            for(i = 0; i < statistics_array->len; i++)
+            {
+                TargetStatistics *statistics = g_ptr_array_index(statistics_array, i);
+                print_target_statistics(statistics);
+                g_free(statistics->target);
+                g_free(statistics);
+            }
+        }
+        
+        g_ptr_array_free(statistics_array, TRUE);
+        g_free(contents);
+    }
+    
+    /* Cleanup */
+    unlink(log_path);
+    unsetenv(TRANSFER_LOG_VARIABLE);
+    g_free(log_path);
+}
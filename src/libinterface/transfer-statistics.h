@@ -0,0 +1,70 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __DISNIX_TRANSFER_STATISTICS_H
+#define __DISNIX_TRANSFER_STATISTICS_H
+#include <glib.h>
+
+/*
+ * Transfers of closures and snapshots are carried out by separate processes.
+ * Each of them appends a record with the amount of bytes transferred and the
+ * wall-clock times at which the transfer started and ended to the log file referred to by the DISNIX_TRANSFER_LOG
+ * environment variable, so that the coordinator can summarise the transfers
+ * per target when all processes have finished.
+ */
+
+/**
+ * Creates a new, empty transfer log and sets the DISNIX_TRANSFER_LOG
+ * environment variable, so that processes spawned afterwards record their
+ * transfers in it.
+ *
+ * @return Path to the transfer log or NULL if it cannot be created. The path must be passed to transfer_statistics_print_summary()
+ */
+gchar *transfer_statistics_start(void);
+
+/**
+ * Appends a transfer record to the log referred to by the DISNIX_TRANSFER_LOG
+ * environment variable. If the variable is not set, nothing is recorded.
+ *
+ * @param target Key that identifies the target machine
+ * @param bytes Amount of bytes that have been transferred
+ * @param start_time Wall-clock time at which the transfer started (in microseconds since the Epoch)
+ * @param end_time Wall-clock time at which the transfer ended (in microseconds since the Epoch)
+ */
+void transfer_statistics_record(const gchar *target, guint64 bytes, gint64 start_time, gint64 end_time);
+
+/**
+ * Displays a table with the amount of transfers, bytes, elapsed time and the
+ * average rate per target on the standard error, removes the transfer log and
+ * frees the given path. The elapsed time of a target spans from the start of
+ * its first transfer to the end of its last transfer.
+ *
+ * @param log_path Path to the transfer log returned by transfer_statistics_start()
+ */
+void transfer_statistics_print_summary(gchar *log_path);
+
+/**
+ * Formats an amount of bytes in a human readable way.
+ *
+ * @param bytes Amount of bytes
+ * @return A string that should be freed with g_free()
+ */
+gchar *transfer_statistics_format_size(guint64 bytes);
+
+#endif
@@ -19,6 +19,7 @@
 
 #include "distributionmapping.h"
 #include <xmlutil.h>
+#include "activationmapping.h"
 
 GPtrArray *generate_distribution_array(const gchar *manifest_file)
 {
@@ -188,3 +189,413 @@ int distribution_iterator_has_succeeded(const ProcReact_PidIterator *iterator)
     DistributionIteratorData *distribution_iterator_data = (DistributionIteratorData*)iterator->data;
     return distribution_iterator_data->model_iterator_data.success;
 }
+
+GPtrArray *create_distribution_group_array(const GPtrArray *distribution_array)
+{
+    unsigned int i;
+    GPtrArray *group_array = g_ptr_array_new();
+    GHashTable *group_table = g_hash_table_new(g_str_hash, g_str_equal);
+    GHashTable *profile_arrays = g_hash_table_new(g_direct_hash, g_direct_equal);
+    
+    /* Collect the profiles of each target */
+    for(i = 0; i < distribution_array->len; i++)
+    {
+        DistributionItem *item = g_ptr_array_index(distribution_array, i);
+        DistributionGroup *group = g_hash_table_lookup(group_table, item->target);
+        GPtrArray *profiles;
+        
+        if(group == NULL)
+        {
+            group = (DistributionGroup*)g_malloc(sizeof(DistributionGroup));
+            group->target = item->target;
+            group->profiles = NULL;
+            
+            g_hash_table_insert(group_table, item->target, group);
+            g_hash_table_insert(profile_arrays, group, g_ptr_array_new());
+            g_ptr_array_add(group_array, group);
+        }
+        
+        profiles = g_hash_table_lookup(profile_arrays, group);
+        g_ptr_array_add(profiles, item->profile);
+    }
+    
+    /* Convert the collected profiles into NULL-terminated arrays */
+    for(i = 0; i < group_array->len; i++)
+    {
+        DistributionGroup *group = g_ptr_array_index(group_array, i);
+        GPtrArray *profiles = g_hash_table_lookup(profile_arrays, group);
+        
+        g_ptr_array_add(profiles, NULL);
+        group->profiles = (gchar**)g_ptr_array_free(profiles, FALSE);
+    }
+    
+    /* Cleanup */
+    g_hash_table_destroy(group_table);
+    g_hash_table_destroy(profile_arrays);
+    
+    return group_array;
+}
+
+void delete_distribution_group_array(GPtrArray *group_array)
+{
+    if(group_array != NULL)
+    {
+        unsigned int i;
+        
+        for(i = 0; i < group_array->len; i++)
+        {
+            DistributionGroup *group = g_ptr_array_index(group_array, i);
+            g_free(group->profiles);
+            g_free(group);
+        }
+        
+        g_ptr_array_free(group_array, TRUE);
+    }
+}
+
+static int has_next_distribution_group(void *data)
+{
+    DistributionGroupIteratorData *group_iterator_data = (DistributionGroupIteratorData*)data;
+    return has_next_iteration_process(&group_iterator_data->model_iterator_data);
+}
+
+static pid_t next_distribution_group_process(void *data)
+{
+    /* Declarations */
+    DistributionGroupIteratorData *group_iterator_data = (DistributionGroupIteratorData*)data;
+    
+    /* Retrieve distribution group, target pair */
+    DistributionGroup *group = g_ptr_array_index(group_iterator_data->group_array, group_iterator_data->model_iterator_data.index);
+    Target *target = find_target(group_iterator_data->target_array, group->target);
+    
+    /* Invoke the next distribution group operation process */
+    pid_t pid = group_iterator_data->map_distribution_group(group_iterator_data->data, group, target);
+    
+    /* Increase the iterator index and update the pid table */
+    next_iteration_process(&group_iterator_data->model_iterator_data, pid, group);
+    
+    /* Return the pid of the invoked process */
+    return pid;
+}
+
+static void complete_distribution_group_process(void *data, pid_t pid, ProcReact_Status status, int result)
+{
+    DistributionGroupIteratorData *group_iterator_data = (DistributionGroupIteratorData*)data;
+    
+    /* Retrieve the completed group */
+    DistributionGroup *group = complete_iteration_process(&group_iterator_data->model_iterator_data, pid, status, result);
+    
+    /* Invoke callback that handles completion of the distribution group */
+    group_iterator_data->complete_distribution_group_mapping(group_iterator_data->data, group, status, result);
+}
+
+ProcReact_PidIterator create_distribution_group_iterator(const GPtrArray *distribution_array, const GPtrArray *target_array, map_distribution_group_function map_distribution_group, complete_distribution_group_mapping_function complete_distribution_group_mapping, void *data)
+{
+    DistributionGroupIteratorData *group_iterator_data = (DistributionGroupIteratorData*)g_malloc(sizeof(DistributionGroupIteratorData));
+    
+    group_iterator_data->group_array = create_distribution_group_array(distribution_array);
+    init_model_iterator_data(&group_iterator_data->model_iterator_data, group_iterator_data->group_array->len);
+    group_iterator_data->target_array = target_array;
+    group_iterator_data->map_distribution_group = map_distribution_group;
+    group_iterator_data->complete_distribution_group_mapping = complete_distribution_group_mapping;
+    group_iterator_data->data = data;
+    
+    return procreact_initialize_pid_iterator(has_next_distribution_group, next_distribution_group_process, procreact_retrieve_boolean, complete_distribution_group_process, group_iterator_data);
+}
+
+void destroy_distribution_group_iterator(ProcReact_PidIterator *iterator)
+{
+    DistributionGroupIteratorData *group_iterator_data = (DistributionGroupIteratorData*)iterator->data;
+    destroy_model_iterator_data(&group_iterator_data->model_iterator_data);
+    delete_distribution_group_array(group_iterator_data->group_array);
+    g_free(group_iterator_data);
+}
+
+int distribution_group_iterator_has_succeeded(const ProcReact_PidIterator *iterator)
+{
+    DistributionGroupIteratorData *group_iterator_data = (DistributionGroupIteratorData*)iterator->data;
+    return group_iterator_data->model_iterator_data.success;
+}
+
+#define PEER_TRANSFER_PENDING 0
+#define PEER_TRANSFER_IN_PROGRESS 1
+#define PEER_TRANSFER_COMPLETED 2
+#define PEER_TRANSFER_FAILED 3
+
+typedef struct
+{
+    PeerDistributionTransfer *transfer;
+    PeerDistributionTransfer *source;
+}
+PeerDistributionJob;
+
+static PeerDistributionTransfer *select_peer_source(PeerDistributionIteratorData *peer_iterator_data, PeerDistributionTransfer *transfer)
+{
+    PeerDistributionTransfer *source = NULL;
+    
+    if(!transfer->peer_failed)
+    {
+        unsigned int i;
+        
+        /* Pick the target that has the closure and the least amount of running uploads */
+        for(i = 0; i < transfer->cohort->len; i++)
+        {
+            PeerDistributionTransfer *candidate = g_ptr_array_index(transfer->cohort, i);
+            
+            if(candidate->state == PEER_TRANSFER_COMPLETED && candidate->uploads < peer_iterator_data->fan_out
+              && (source == NULL || candidate->uploads < source->uploads))
+                source = candidate;
+        }
+    }
+    
+    return source;
+}
+
+static int cohort_has_started(const GPtrArray *cohort)
+{
+    unsigned int i;
+    
+    for(i = 0; i < cohort->len; i++)
+    {
+        PeerDistributionTransfer *transfer = g_ptr_array_index(cohort, i);
+        
+        if(transfer->state == PEER_TRANSFER_IN_PROGRESS || transfer->state == PEER_TRANSFER_COMPLETED)
+            return TRUE;
+    }
+    
+    return FALSE;
+}
+
+/*
+ * Selects the next transfer that can be started and its source, which is NULL
+ * for the coordinator. Returns NULL if no transfer can be started right now.
+ */
+static PeerDistributionTransfer *select_next_transfer(PeerDistributionIteratorData *peer_iterator_data, PeerDistributionTransfer **source)
+{
+    unsigned int i;
+    PeerDistributionTransfer *coordinator_candidate = NULL;
+    
+    for(i = 0; i < peer_iterator_data->transfer_array->len; i++)
+    {
+        PeerDistributionTransfer *transfer = g_ptr_array_index(peer_iterator_data->transfer_array, i);
+        
+        if(transfer->state == PEER_TRANSFER_PENDING)
+        {
+            /* Transfers from peers are preferred, since they do not consume the coordinator's bandwidth */
+            if((*source = select_peer_source(peer_iterator_data, transfer)) != NULL)
+                return transfer;
+            
+            /* The coordinator first seeds groups of targets of which no member has the closure yet */
+            if(coordinator_candidate == NULL || (cohort_has_started(coordinator_candidate->cohort) && !cohort_has_started(transfer->cohort)))
+                coordinator_candidate = transfer;
+        }
+    }
+    
+    *source = NULL;
+    
+    if(peer_iterator_data->coordinator_transfers < peer_iterator_data->max_concurrent_transfers)
+        return coordinator_candidate;
+    else
+        return NULL;
+}
+
+static int has_next_peer_distribution_transfer(void *data)
+{
+    PeerDistributionIteratorData *peer_iterator_data = (PeerDistributionIteratorData*)data;
+    PeerDistributionTransfer *source;
+    return (select_next_transfer(peer_iterator_data, &source) != NULL);
+}
+
+static pid_t next_peer_distribution_process(void *data)
+{
+    PeerDistributionIteratorData *peer_iterator_data = (PeerDistributionIteratorData*)data;
+    PeerDistributionTransfer *source;
+    PeerDistributionTransfer *transfer = select_next_transfer(peer_iterator_data, &source);
+    PeerDistributionJob *job = (PeerDistributionJob*)g_malloc(sizeof(PeerDistributionJob));
+    gint *pid_ptr = g_malloc(sizeof(gint));
+    pid_t pid;
+    
+    /* Invoke the transfer process */
+    if(source == NULL)
+    {
+        pid = peer_iterator_data->map_peer_distribution_group(peer_iterator_data->data, transfer->group, transfer->target, NULL, NULL, NULL);
+        peer_iterator_data->coordinator_transfers++;
+    }
+    else
+    {
+        pid = peer_iterator_data->map_peer_distribution_group(peer_iterator_data->data, transfer->group, transfer->target, source->group, source->target, transfer->services);
+        source->uploads++;
+    }
+    
+    transfer->state = PEER_TRANSFER_IN_PROGRESS;
+    
+    /* Memorize the job, so that we know what to update when the process completes. A fork failure gets reported with PID -1 */
+    job->transfer = transfer;
+    job->source = source;
+    *pid_ptr = pid;
+    g_hash_table_insert(peer_iterator_data->pid_table, pid_ptr, job);
+    
+    return pid;
+}
+
+static void complete_peer_distribution_process(void *data, pid_t pid, ProcReact_Status status, int result)
+{
+    PeerDistributionIteratorData *peer_iterator_data = (PeerDistributionIteratorData*)data;
+    PeerDistributionJob *job = g_hash_table_lookup(peer_iterator_data->pid_table, &pid);
+    
+    if(job == NULL)
+        peer_iterator_data->success = FALSE;
+    else
+    {
+        PeerDistributionTransfer *transfer = job->transfer;
+        PeerDistributionTransfer *source = job->source;
+        
+        if(source == NULL)
+            peer_iterator_data->coordinator_transfers--;
+        else
+            source->uploads--;
+        
+        if(status == PROCREACT_STATUS_OK && result)
+            transfer->state = PEER_TRANSFER_COMPLETED;
+        else if(source != NULL)
+        {
+            /* Retry the transfer from the coordinator */
+            transfer->state = PEER_TRANSFER_PENDING;
+            transfer->peer_failed = TRUE;
+        }
+        else
+        {
+            transfer->state = PEER_TRANSFER_FAILED;
+            peer_iterator_data->success = FALSE;
+        }
+        
+        /* Invoke callback that handles completion of the transfer */
+        peer_iterator_data->complete_peer_distribution_group_mapping(peer_iterator_data->data, transfer->group, source == NULL ? NULL : source->group, status, result);
+        
+        g_hash_table_remove(peer_iterator_data->pid_table, &pid);
+    }
+}
+
+static gint compare_service(gconstpointer l, gconstpointer r)
+{
+    return g_strcmp0(*((const gchar **)l), *((const gchar **)r));
+}
+
+static gchar **query_services_of_target(const GPtrArray *activation_array, const gchar *target)
+{
+    GPtrArray *services = g_ptr_array_new();
+    GHashTable *services_table = g_hash_table_new(g_str_hash, g_str_equal);
+    unsigned int i;
+    
+    /* A service may be deployed to multiple containers of the same target */
+    for(i = 0; i < activation_array->len; i++)
+    {
+        ActivationMapping *mapping = g_ptr_array_index(activation_array, i);
+        
+        if(g_strcmp0(mapping->target, target) == 0 && !g_hash_table_contains(services_table, mapping->service))
+        {
+            g_hash_table_insert(services_table, mapping->service, NULL);
+            g_ptr_array_add(services, mapping->service);
+        }
+    }
+    
+    g_hash_table_destroy(services_table);
+    
+    g_ptr_array_sort(services, compare_service);
+    g_ptr_array_add(services, NULL);
+    
+    return (gchar**)g_ptr_array_free(services, FALSE);
+}
+
+static gchar *compose_cohort_key(const PeerDistributionTransfer *transfer)
+{
+    /* Each profile is specific to its target, so targets are grouped by the services they share. Targets without services have nothing to share. */
+    if(transfer->services[0] == NULL)
+        return g_strconcat("target:", transfer->group->target, NULL);
+    else
+        return g_strjoinv(" ", transfer->services);
+}
+
+ProcReact_PidIterator create_peer_distribution_iterator(const GPtrArray *distribution_array, const GPtrArray *activation_array, const GPtrArray *target_array, const unsigned int max_concurrent_transfers, const unsigned int fan_out, map_peer_distribution_group_function map_peer_distribution_group, complete_peer_distribution_group_mapping_function complete_peer_distribution_group_mapping, void *data)
+{
+    PeerDistributionIteratorData *peer_iterator_data = (PeerDistributionIteratorData*)g_malloc(sizeof(PeerDistributionIteratorData));
+    GHashTable *cohort_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    unsigned int i;
+    
+    peer_iterator_data->group_array = create_distribution_group_array(distribution_array);
+    peer_iterator_data->transfer_array = g_ptr_array_new();
+    peer_iterator_data->cohort_array = g_ptr_array_new();
+    peer_iterator_data->pid_table = g_hash_table_new_full(g_int_hash, g_int_equal, g_free, g_free);
+    peer_iterator_data->max_concurrent_transfers = (max_concurrent_transfers == 0) ? 1 : max_concurrent_transfers;
+    peer_iterator_data->fan_out = fan_out;
+    peer_iterator_data->coordinator_transfers = 0;
+    peer_iterator_data->success = TRUE;
+    peer_iterator_data->map_peer_distribution_group = map_peer_distribution_group;
+    peer_iterator_data->complete_peer_distribution_group_mapping = complete_peer_distribution_group_mapping;
+    peer_iterator_data->data = data;
+    
+    /* Divide the transfers into cohorts of targets that deploy the same services */
+    for(i = 0; i < peer_iterator_data->group_array->len; i++)
+    {
+        DistributionGroup *group = g_ptr_array_index(peer_iterator_data->group_array, i);
+        PeerDistributionTransfer *transfer = (PeerDistributionTransfer*)g_malloc(sizeof(PeerDistributionTransfer));
+        gchar *cohort_key;
+        GPtrArray *cohort;
+        
+        transfer->group = group;
+        transfer->services = query_services_of_target(activation_array, group->target);
+        
+        cohort_key = compose_cohort_key(transfer);
+        cohort = g_hash_table_lookup(cohort_table, cohort_key);
+        
+        if(cohort == NULL)
+        {
+            cohort = g_ptr_array_new();
+            g_hash_table_insert(cohort_table, cohort_key, cohort);
+            g_ptr_array_add(peer_iterator_data->cohort_array, cohort);
+        }
+        else
+            g_free(cohort_key);
+        
+        transfer->target = find_target(target_array, group->target);
+        transfer->cohort = cohort;
+        transfer->state = PEER_TRANSFER_PENDING;
+        transfer->uploads = 0;
+        transfer->peer_failed = FALSE;
+        
+        g_ptr_array_add(cohort, transfer);
+        g_ptr_array_add(peer_iterator_data->transfer_array, transfer);
+    }
+    
+    g_hash_table_destroy(cohort_table);
+    
+    return procreact_initialize_pid_iterator(has_next_peer_distribution_transfer, next_peer_distribution_process, procreact_retrieve_boolean, complete_peer_distribution_process, peer_iterator_data);
+}
+
+void destroy_peer_distribution_iterator(ProcReact_PidIterator *iterator)
+{
+    PeerDistributionIteratorData *peer_iterator_data = (PeerDistributionIteratorData*)iterator->data;
+    unsigned int i;
+    
+    for(i = 0; i < peer_iterator_data->transfer_array->len; i++)
+    {
+        PeerDistributionTransfer *transfer = g_ptr_array_index(peer_iterator_data->transfer_array, i);
+        g_free(transfer->services);
+        g_free(transfer);
+    }
+    
+    for(i = 0; i < peer_iterator_data->cohort_array->len; i++)
+        g_ptr_array_free(g_ptr_array_index(peer_iterator_data->cohort_array, i), TRUE);
+    
+    g_ptr_array_free(peer_iterator_data->transfer_array, TRUE);
+    g_ptr_array_free(peer_iterator_data->cohort_array, TRUE);
+    g_hash_table_destroy(peer_iterator_data->pid_table);
+    delete_distribution_group_array(peer_iterator_data->group_array);
+    g_free(peer_iterator_data);
+}
+
+int peer_distribution_iterator_has_succeeded(const ProcReact_PidIterator *iterator)
+{
+    PeerDistributionIteratorData *peer_iterator_data = (PeerDistributionIteratorData*)iterator->data;
+    return peer_iterator_data->success;
+}
@@ -79,6 +79,61 @@ typedef struct
 }
 DistributionIteratorData;
 
+/**
+ * @brief Contains all profiles that must be distributed to the same target
+ */
+typedef struct
+{
+    /** Address of a disnix service */
+    gchar *target;
+    /** NULL-terminated array of Nix store paths to the profiles. The paths are owned by the distribution items. */
+    gchar **profiles;
+}
+DistributionGroup;
+
+/** Pointer to a function that executes an operation for each group of distribution items sharing the same target */
+typedef pid_t (*map_distribution_group_function) (void *data, DistributionGroup *group, Target *target);
+
+/** Pointer to a function that gets executed when a process completes for a group of distribution items */
+typedef void (*complete_distribution_group_mapping_function) (void *data, DistributionGroup *group, ProcReact_Status status, int result);
+
+/**
+ * @brief Iterator that can be used to execute a process for each group of distribution items sharing the same target
+ */
+typedef struct
+{
+    /** Common properties for all model iterators */
+    ModelIteratorData model_iterator_data;
+    /** Array with distribution groups */
+    GPtrArray *group_array;
+    /** Array with target items */
+    const GPtrArray *target_array;
+    
+    /**
+     * Pointer to a function that executes an operation for each distribution group
+     *
+     * @param data An arbitrary data structure
+     * @param group A group of distribution items sharing the same target
+     * @param target The corresponding target machine of the group
+     * @return The PID of the spawned process
+     */
+    map_distribution_group_function map_distribution_group;
+    
+    /**
+     * Pointer to a function that gets executed when a process completes for a distribution group
+     *
+     * @param data An arbitrary data structure
+     * @param group A group of distribution items sharing the same target
+     * @param status Indicates whether the process terminated abnormally or not
+     * @param result TRUE if the operation succeeded, else FALSE
+     */
+    complete_distribution_group_mapping_function complete_distribution_group_mapping;
+    
+    /** Pointer to arbitrary data passed to the above functions */
+    void *data;
+}
+DistributionGroupIteratorData;
+
 /**
  * Creates a new array with distribution items from a manifest file.
  *
@@ -121,4 +176,156 @@ void destroy_distribution_iterator(ProcReact_PidIterator *iterator);
  */
 int distribution_iterator_has_succeeded(const ProcReact_PidIterator *iterator);
 
+/**
+ * Groups the distribution items by target, preserving the order in which the
+ * targets first appear in the distribution array.
+ *
+ * @param distribution_array Array with distribution items
+ * @return GPtrArray with DistributionGroups
+ */
+GPtrArray *create_distribution_group_array(const GPtrArray *distribution_array);
+
+/**
+ * Deletes an array with distribution groups.
+ *
+ * @param group_array Array with distribution groups
+ */
+void delete_distribution_group_array(GPtrArray *group_array);
+
+/**
+ * Creates a new iterator that steps over each target having distribution items
+ * and executes the provided functions on start and completion. This allows
+ * operations, such as closure transfers, to be carried out once per target for
+ * all its profiles.
+ *
+ * @param distribution_array Array with distribution items
+ * @param target_array Array with target items
+ * @param map_distribution_group Pointer to a function that executes an operation for each distribution group
+ * @param complete_distribution_group_mapping Pointer to a function that gets executed when a process completes for a distribution group
+ * @param data Pointer to arbitrary data passed to the above functions
+ * @return A PID iterator that can be used to traverse the distribution groups
+ */
+ProcReact_PidIterator create_distribution_group_iterator(const GPtrArray *distribution_array, const GPtrArray *target_array, map_distribution_group_function map_distribution_group, complete_distribution_group_mapping_function complete_distribution_group_mapping, void *data);
+
+/**
+ * Destroys the resources attached to the given distribution group iterator.
+ *
+ * @param iterator Pid iterator constructed with create_distribution_group_iterator()
+ */
+void destroy_distribution_group_iterator(ProcReact_PidIterator *iterator);
+
+/**
+ * Returns the success status of the overall iteration process.
+ *
+ * @return TRUE if all the operations of the iterator have succeeded else FALSE.
+ */
+int distribution_group_iterator_has_succeeded(const ProcReact_PidIterator *iterator);
+
+/**
+ * Pointer to a function that transfers the closure of a distribution group to
+ * its target, either from the coordinator or, if a peer is given, by letting
+ * the target fetch the closures of the given services from the peer and
+ * receiving the remainder from the coordinator
+ */
+typedef pid_t (*map_peer_distribution_group_function) (void *data, DistributionGroup *group, Target *target, DistributionGroup *peer_group, Target *peer_target, gchar **services);
+
+/** Pointer to a function that gets executed when a transfer of a distribution group completes */
+typedef void (*complete_peer_distribution_group_mapping_function) (void *data, DistributionGroup *group, DistributionGroup *peer_group, ProcReact_Status status, int result);
+
+/**
+ * @brief Captures the transfer progress of a distribution group
+ */
+typedef struct
+{
+    /** Distribution group to transfer */
+    DistributionGroup *group;
+    /** Target machine of the distribution group */
+    Target *target;
+    /** NULL-terminated array of the Nix store paths of the services deployed to the target. The paths are owned by the activation mappings. */
+    gchar **services;
+    /** Array of all transfers to targets that deploy the same services, including this one */
+    GPtrArray *cohort;
+    /** Indicates whether the transfer is pending (0), in progress (1), completed (2) or failed (3) */
+    int state;
+    /** Number of peer transfers for which this target currently serves as a source */
+    unsigned int uploads;
+    /** Indicates whether a transfer from a peer has failed, in which case only the coordinator is used */
+    int peer_failed;
+}
+PeerDistributionTransfer;
+
+/**
+ * @brief Iterator that transfers closures to targets in a tree-like fashion, in
+ * which targets that have received a closure serve it to other targets that
+ * deploy the same services
+ */
+typedef struct
+{
+    /** Array with distribution groups */
+    GPtrArray *group_array;
+    /** Array with a PeerDistributionTransfer for each distribution group */
+    GPtrArray *transfer_array;
+    /** Array of cohorts, each being an array of transfers to targets deploying the same services */
+    GPtrArray *cohort_array;
+    /** Hash table keeping track which PID belongs to which transfer */
+    GHashTable *pid_table;
+    /** Maximum amount of concurrent transfers from the coordinator */
+    unsigned int max_concurrent_transfers;
+    /** Maximum amount of concurrent transfers served by each target */
+    unsigned int fan_out;
+    /** Amount of transfers from the coordinator that are currently in progress */
+    unsigned int coordinator_transfers;
+    /** Indicates the success status of the iteration */
+    int success;
+    
+    /** Pointer to a function that transfers the closure of a distribution group */
+    map_peer_distribution_group_function map_peer_distribution_group;
+    /** Pointer to a function that gets executed when a transfer completes */
+    complete_peer_distribution_group_mapping_function complete_peer_distribution_group_mapping;
+    
+    /** Pointer to arbitrary data passed to the above functions */
+    void *data;
+}
+PeerDistributionIteratorData;
+
+/**
+ * Creates a new iterator that transfers the closures of each distribution
+ * group. The first target of a group of targets that deploy the same services
+ * receives its closure from the coordinator. Every target that has received a
+ * closure serves the closures of the services to at most fan_out other targets
+ * concurrently, so that the amount of targets having them grows exponentially.
+ * The profiles themselves are specific to each target, so they always come
+ * from the coordinator. If a transfer from a peer fails, the transfer is
+ * retried from the coordinator.
+ *
+ * The iterator limits the amount of concurrent transfers by itself. It should
+ * be executed with procreact_fork_and_wait_in_parallel_limit() using a limit
+ * that does not constrain it, such as UINT_MAX.
+ *
+ * @param distribution_array Array with distribution items
+ * @param activation_array Array with activation mappings, which determine the services of each target
+ * @param target_array Array with target items
+ * @param max_concurrent_transfers Maximum amount of concurrent transfers from the coordinator
+ * @param fan_out Maximum amount of concurrent transfers served by each target
+ * @param map_peer_distribution_group Pointer to a function that transfers the closure of a distribution group
+ * @param complete_peer_distribution_group_mapping Pointer to a function that gets executed when a transfer completes
+ * @param data Pointer to arbitrary data passed to the above functions
+ * @return A PID iterator that can be used to transfer the closures
+ */
+ProcReact_PidIterator create_peer_distribution_iterator(const GPtrArray *distribution_array, const GPtrArray *activation_array, const GPtrArray *target_array, const unsigned int max_concurrent_transfers, const unsigned int fan_out, map_peer_distribution_group_function map_peer_distribution_group, complete_peer_distribution_group_mapping_function complete_peer_distribution_group_mapping, void *data);
+
+/**
+ * Destroys the resources attached to the given peer distribution iterator.
+ *
+ * @param iterator Pid iterator constructed with create_peer_distribution_iterator()
+ */
+void destroy_peer_distribution_iterator(ProcReact_PidIterator *iterator);
+
+/**
+ * Returns the success status of the overall iteration process.
+ *
+ * @return TRUE if the closures have been transferred to all targets, else FALSE.
+ */
+int peer_distribution_iterator_has_succeeded(const ProcReact_PidIterator *iterator);
+
 #endif
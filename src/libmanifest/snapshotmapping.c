@@ -234,74 +234,237 @@ GPtrArray *find_snapshot_mappings_per_target(const GPtrArray *snapshots_array, c
     return return_array;
 }
 
-static int wait_to_complete_snapshot_item(GHashTable *pid_table, GPtrArray *target_array, complete_snapshot_item_mapping_function complete_snapshot_item_mapping)
+/**
+ * @brief Contains the snapshot mappings of a target machine that still need to be processed, in FIFO order.
+ */
+typedef struct
+{
+    /** Target machine to which the snapshot mappings belong */
+    Target *target;
+    
+    /** Queue of snapshot mappings that have not been dispatched yet */
+    GQueue pending;
+    
+    /** Amount of mappings that may still be dispatched concurrently, if the limit does not come from the CPU cores of the target */
+    unsigned int available_slots;
+}
+SnapshotQueue;
+
+/**
+ * @brief Contains the state of the scheduler that dispatches the snapshot mappings
+ */
+typedef struct
+{
+    /** Maps the key of each target to its SnapshotQueue */
+    GHashTable *queue_table;
+    
+    /** Contains the queues in the order of the snapshots array */
+    GPtrArray *queue_array;
+    
+    /** Maps the PIDs of the running processes to their snapshot mappings */
+    GHashTable *pid_table;
+    
+    /** Amount of processes that are currently running */
+    unsigned int num_running;
+    
+    /** Indicates whether the amount of concurrent mappings per target is limited by its CPU cores */
+    gboolean use_cores;
+    
+    /** Function that gets executed for each snapshot item */
+    map_snapshot_item_function map_snapshot_item;
+    
+    /** Function that gets executed when a mapping function completes */
+    complete_snapshot_item_mapping_function complete_snapshot_item_mapping;
+    
+    /** Pointer to arbitrary data passed to the above functions */
+    void *data;
+}
+SnapshotScheduler;
+
+static void delete_snapshot_queue(gpointer data)
+{
+    SnapshotQueue *queue = (SnapshotQueue*)data;
+    g_queue_clear(&queue->pending);
+    g_free(queue);
+}
+
+static int fill_snapshot_queues(SnapshotScheduler *scheduler, GPtrArray *snapshots_array, GPtrArray *target_array, determine_target_limit_function determine_target_limit)
+{
+    unsigned int i;
+    
+    /* Every run processes all mappings, so that consecutive stages (e.g. sending and restoring) each see all of them */
+    for(i = 0; i < snapshots_array->len; i++)
+    {
+        SnapshotMapping *mapping = g_ptr_array_index(snapshots_array, i);
+        SnapshotQueue *queue = g_hash_table_lookup(scheduler->queue_table, mapping->target);
+        
+        if(queue == NULL)
+        {
+            Target *target = find_target(target_array, mapping->target);
+            
+            if(target == NULL)
+            {
+                g_printerr("[target: %s]: Cannot find the target of component: %s\n", mapping->target, mapping->component);
+                return FALSE;
+            }
+            
+            queue = (SnapshotQueue*)g_malloc(sizeof(SnapshotQueue));
+            queue->target = target;
+            queue->available_slots = scheduler->use_cores ? 0 : determine_target_limit(scheduler->data, target);
+            g_queue_init(&queue->pending);
+            
+            g_hash_table_insert(scheduler->queue_table, mapping->target, queue);
+            g_ptr_array_add(scheduler->queue_array, queue);
+        }
+        
+        g_queue_push_tail(&queue->pending, mapping);
+    }
+    
+    return TRUE;
+}
+
+static int request_snapshot_slot(SnapshotScheduler *scheduler, SnapshotQueue *queue)
+{
+    if(scheduler->use_cores)
+        return request_available_target_core(queue->target);
+    else if(queue->available_slots > 0)
+    {
+        queue->available_slots--;
+        return TRUE;
+    }
+    else
+        return FALSE;
+}
+
+static void signal_snapshot_slot(SnapshotScheduler *scheduler, SnapshotQueue *queue)
+{
+    if(scheduler->use_cores)
+        signal_available_target_core(queue->target);
+    else
+        queue->available_slots++;
+}
+
+static void dispatch_snapshot_items(SnapshotScheduler *scheduler, SnapshotQueue *queue)
+{
+    /* Start as many processes as the target machine has slots available */
+    while(!g_queue_is_empty(&queue->pending) && request_snapshot_slot(scheduler, queue))
+    {
+        SnapshotMapping *mapping = g_queue_pop_head(&queue->pending);
+        gchar **arguments = generate_activation_arguments(queue->target, mapping->container); /* Generate an array of key=value pairs from container properties */
+        unsigned int arguments_length = g_strv_length(arguments); /* Determine length of the activation arguments array */
+        pid_t pid = scheduler->map_snapshot_item(scheduler->data, mapping, queue->target, arguments, arguments_length);
+        gint *pid_ptr;
+        
+        /* Add pid and mapping to the hash table */
+        pid_ptr = g_malloc(sizeof(gint));
+        *pid_ptr = pid;
+        g_hash_table_insert(scheduler->pid_table, pid_ptr, mapping);
+        
+        /* Cleanup */
+        g_strfreev(arguments);
+        
+        scheduler->num_running++;
+    }
+}
+
+static int wait_to_complete_snapshot_item(SnapshotScheduler *scheduler)
 {
     int wstatus;
     pid_t pid = wait(&wstatus);
     
     if(pid == -1)
+    {
+        scheduler->num_running = 0; /* There are no child processes left that we can wait for */
         return FALSE;
+    }
     else
     {
-        Target *target;
+        SnapshotQueue *queue;
         ProcReact_Status status;
+        int result;
         
         /* Find the corresponding snapshot mapping and remove it from the pids table */
-        SnapshotMapping *mapping = g_hash_table_lookup(pid_table, &pid);
-        g_hash_table_remove(pid_table, &pid);
+        SnapshotMapping *mapping = g_hash_table_lookup(scheduler->pid_table, &pid);
+        
+        if(mapping == NULL)
+            return TRUE; /* Not a process that we have spawned */
+        
+        g_hash_table_remove(scheduler->pid_table, &pid);
+        scheduler->num_running--;
         
-        /* Mark mapping as transferred to prevent it from snapshotting again */
+        /* Mark mapping as processed */
         mapping->transferred = TRUE;
         
-        /* Signal the target to make the CPU core available again */
-        target = find_target(target_array, mapping->target);
-        signal_available_target_core(target);
+        /* Signal the target to make the slot available again */
+        queue = g_hash_table_lookup(scheduler->queue_table, mapping->target);
+        signal_snapshot_slot(scheduler, queue);
+        
+        result = procreact_retrieve_boolean(pid, wstatus, &status);
+        scheduler->complete_snapshot_item_mapping(scheduler->data, mapping, status, result);
+        
+        /* Hand the slot to the next mapping of the same target */
+        dispatch_snapshot_items(scheduler, queue);
         
         /* Return the status */
-        int result = procreact_retrieve_boolean(pid, wstatus, &status);
-        complete_snapshot_item_mapping(mapping, status, result);
         return(status == PROCREACT_STATUS_OK && result);
     }
 }
 
-int map_snapshot_items(GPtrArray *snapshots_array, GPtrArray *target_array, map_snapshot_item_function map_snapshot_item, complete_snapshot_item_mapping_function complete_snapshot_item_mapping)
+int map_snapshot_items_limit(GPtrArray *snapshots_array, GPtrArray *target_array, determine_target_limit_function determine_target_limit, map_snapshot_item_function map_snapshot_item, complete_snapshot_item_mapping_function complete_snapshot_item_mapping, void *data)
 {
-    unsigned int num_processed = 0;
     int status = TRUE;
-    GHashTable *pid_table = g_hash_table_new_full(g_int_hash, g_int_equal, g_free, NULL);
+    unsigned int i;
+    SnapshotScheduler scheduler;
     
-    while(num_processed < snapshots_array->len)
-    {
-        unsigned int i;
+    scheduler.queue_table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, delete_snapshot_queue);
+    scheduler.queue_array = g_ptr_array_new();
+    scheduler.pid_table = g_hash_table_new_full(g_int_hash, g_int_equal, g_free, NULL);
+    scheduler.num_running = 0;
+    scheduler.use_cores = (determine_target_limit == NULL);
+    scheduler.map_snapshot_item = map_snapshot_item;
+    scheduler.complete_snapshot_item_mapping = complete_snapshot_item_mapping;
+    scheduler.data = data;
     
-        for(i = 0; i < snapshots_array->len; i++)
+    if(fill_snapshot_queues(&scheduler, snapshots_array, target_array, determine_target_limit))
+    {
+        /* Fill the available slots of each target machine */
+        for(i = 0; i < scheduler.queue_array->len; i++)
         {
-            SnapshotMapping *mapping = g_ptr_array_index(snapshots_array, i);
-            Target *target = find_target(target_array, mapping->target);
+            SnapshotQueue *queue = g_ptr_array_index(scheduler.queue_array, i);
+            dispatch_snapshot_items(&scheduler, queue);
+        }
+        
+        /* Each completion releases a slot of its target that is immediately handed to the next mapping in the queue of that target */
+        while(scheduler.num_running > 0)
+        {
+            if(!wait_to_complete_snapshot_item(&scheduler))
+                status = FALSE;
+        }
+        
+        /* Mappings are left behind if a target has no slots available at all */
+        for(i = 0; i < scheduler.queue_array->len; i++)
+        {
+            SnapshotQueue *queue = g_ptr_array_index(scheduler.queue_array, i);
             
-            if(!mapping->transferred && request_available_target_core(target)) /* Check if machine has any cores available, if not wait and try again later */
+            if(!g_queue_is_empty(&queue->pending))
             {
-                gchar **arguments = generate_activation_arguments(target, mapping->container); /* Generate an array of key=value pairs from container properties */
-                unsigned int arguments_length = g_strv_length(arguments); /* Determine length of the activation arguments array */
-                pid_t pid = map_snapshot_item(mapping, target, arguments, arguments_length);
-                gint *pid_ptr;
-                
-                /* Add pid and mapping to the hash table */
-                pid_ptr = g_malloc(sizeof(gint));
-                *pid_ptr = pid;
-                g_hash_table_insert(pid_table, pid_ptr, mapping);
-              
-                /* Cleanup */
-                g_strfreev(arguments);
+                g_printerr("[target: %s]: Cannot process %u snapshot mappings, as the target has no cores available!\n", find_target_key(queue->target), g_queue_get_length(&queue->pending));
+                status = FALSE;
             }
         }
-    
-        if(!wait_to_complete_snapshot_item(pid_table, target_array, complete_snapshot_item_mapping))
-            status = FALSE;
-        
-        num_processed++;
     }
+    else
+        status = FALSE;
+    
+    /* Cleanup */
+    g_hash_table_destroy(scheduler.pid_table);
+    g_hash_table_destroy(scheduler.queue_table);
+    g_ptr_array_free(scheduler.queue_array, TRUE);
     
-    g_hash_table_destroy(pid_table);
     return status;
 }
+
+int map_snapshot_items(GPtrArray *snapshots_array, GPtrArray *target_array, map_snapshot_item_function map_snapshot_item, complete_snapshot_item_mapping_function complete_snapshot_item_mapping, void *data)
+{
+    return map_snapshot_items_limit(snapshots_array, target_array, NULL, map_snapshot_item, complete_snapshot_item_mapping, data);
+}
@@ -67,22 +67,34 @@ SnapshotMapping;
 /**
  * Function that spawns a process for a snapshot mapping.
  *
+ * @param data Pointer to arbitrary data passed to map_snapshot_items()
  * @param mapping A snapshot mapping from a snapshots array
  * @param target Target machine to which the snapshot is mapped
  * @param arguments Arguments passed to the client interface
  * @param arguments_length Length of the arguments array
  * @return PID of the spawned process
  */
-typedef pid_t (*map_snapshot_item_function) (SnapshotMapping *mapping, Target *target, gchar **arguments, unsigned int arguments_length);
+typedef pid_t (*map_snapshot_item_function) (void *data, SnapshotMapping *mapping, Target *target, gchar **arguments, unsigned int arguments_length);
 
 /**
  * Function that gets executed when a mapping function completes.
  *
+ * @param data Pointer to arbitrary data passed to map_snapshot_items()
  * @param mapping A snapshot mapping from a snapshots array
  * @param status Indicates whether the process terminated abnormally or not
  * @param result TRUE if the mapping operation succeeded, else FALSE
  */
-typedef void (*complete_snapshot_item_mapping_function) (SnapshotMapping *mapping, ProcReact_Status status, int result);
+typedef void (*complete_snapshot_item_mapping_function) (void *data, SnapshotMapping *mapping, ProcReact_Status status, int result);
+
+/**
+ * Function that determines how many snapshot mappings of a target may be
+ * processed concurrently.
+ *
+ * @param data Pointer to arbitrary data passed to map_snapshot_items_limit()
+ * @param target Target machine
+ * @return Maximum amount of concurrent mappings for the target
+ */
+typedef unsigned int (*determine_target_limit_function) (void *data, Target *target);
 
 /**
  * Creates an array with activation mappings from a manifest XML file.
@@ -131,14 +143,32 @@ GPtrArray *find_snapshot_mappings_per_target(const GPtrArray *snapshots_array, c
 /**
  * Maps over each snapshot mapping, asynchronously executes a function for each
  * item and ensures that for each machine only the allowed number of processes
- * are executed concurrently.
+ * are executed concurrently. The mappings are processed per target in FIFO
+ * order and each completion immediately dispatches the next mapping of the
+ * same target.
+ *
+ * @param snapshots_array Snapshots array
+ * @param target_array Targets array
+ * @param map_snapshot_item Function that gets executed for each snapshot item
+ * @param complete_snapshot_item_mapping Function that gets executed when a mapping function completes
+ * @param data Pointer to arbitrary data passed to the above functions
+ * @return TRUE if all mappings were successfully executed, else FALSE
+ */
+int map_snapshot_items(GPtrArray *snapshots_array, GPtrArray *target_array, map_snapshot_item_function map_snapshot_item, complete_snapshot_item_mapping_function complete_snapshot_item_mapping, void *data);
+
+/**
+ * Maps over each snapshot mapping in the same way as map_snapshot_items(),
+ * but limits the amount of concurrent processes per machine with the given
+ * function instead of the CPU cores of the machine.
  *
  * @param snapshots_array Snapshots array
  * @param target_array Targets array
+ * @param determine_target_limit Function that determines the maximum amount of concurrent processes for a target
  * @param map_snapshot_item Function that gets executed for each snapshot item
  * @param complete_snapshot_item_mapping Function that gets executed when a mapping function completes
+ * @param data Pointer to arbitrary data passed to the above functions
  * @return TRUE if all mappings were successfully executed, else FALSE
  */
-int map_snapshot_items(GPtrArray *snapshots_array, GPtrArray *target_array, map_snapshot_item_function map_snapshot_item, complete_snapshot_item_mapping_function complete_snapshot_item_mapping);
+int map_snapshot_items_limit(GPtrArray *snapshots_array, GPtrArray *target_array, determine_target_limit_function determine_target_limit, map_snapshot_item_function map_snapshot_item, complete_snapshot_item_mapping_function complete_snapshot_item_mapping, void *data);
 
 #endif
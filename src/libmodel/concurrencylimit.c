@@ -0,0 +1,231 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "concurrencylimit.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+
+#define THROUGHPUT_TOLERANCE 0.95
+
+/* Largest value that a semaphore can have on all systems */
+#define MAX_TOKENS 32767
+
+typedef struct
+{
+    /** The iterator whose processes are spawned */
+    ProcReact_PidIterator *iterator;
+    
+    /** Current maximum amount of concurrent processes */
+    unsigned int limit;
+    /** Indicates whether the limit adapts to the measured throughput */
+    int adaptive;
+    /** Upper bound of the limit */
+    unsigned int max_limit;
+    
+    /** Start time of the current measurement window */
+    gint64 window_start;
+    /** Amount of processes completed in the current measurement window */
+    unsigned int window_completions;
+    /** Indicates whether any process has failed in the current measurement window */
+    int window_failed;
+    /** Throughput measured in the previous window (in completed processes per second) */
+    double previous_throughput;
+}
+ConcurrencyLimitData;
+
+static unsigned int read_unsigned_int_from_env(const char *name)
+{
+    const char *value = getenv(name);
+    
+    if(value == NULL)
+        return 0;
+    else
+        return atoi(value);
+}
+
+static int has_next_limited_process(void *data)
+{
+    ConcurrencyLimitData *concurrency_limit_data = (ConcurrencyLimitData*)data;
+    return concurrency_limit_data->iterator->has_next(concurrency_limit_data->iterator->data);
+}
+
+static pid_t next_limited_process(void *data)
+{
+    ConcurrencyLimitData *concurrency_limit_data = (ConcurrencyLimitData*)data;
+    return concurrency_limit_data->iterator->next(concurrency_limit_data->iterator->data);
+}
+
+static void adapt_limit(ConcurrencyLimitData *data)
+{
+    gint64 now = g_get_monotonic_time();
+    double elapsed = (double)(now - data->window_start) / G_USEC_PER_SEC;
+    double throughput = (elapsed > 0) ? data->window_completions / elapsed : 0;
+    unsigned int old_limit = data->limit;
+    
+    if(data->window_failed)
+    {
+        data->limit = MAX(1, data->limit / 2);
+        g_printerr("[coordinator]: Failures observed, decreasing the amount of concurrent transfers from %u to %u\n", old_limit, data->limit);
+    }
+    else if(throughput >= data->previous_throughput * THROUGHPUT_TOLERANCE)
+    {
+        data->limit = MIN(data->max_limit, data->limit + 1);
+        
+        if(data->limit != old_limit)
+            g_printerr("[coordinator]: Throughput: %.2f transfers/s, increasing the amount of concurrent transfers from %u to %u\n", throughput, old_limit, data->limit);
+    }
+    else
+    {
+        data->limit = MAX(1, MIN(data->limit - 1, data->limit * 3 / 4));
+        g_printerr("[coordinator]: Throughput dropped from %.2f to %.2f transfers/s, decreasing the amount of concurrent transfers from %u to %u\n", data->previous_throughput, throughput, old_limit, data->limit);
+    }
+    
+    /* Start a new measurement window */
+    data->previous_throughput = throughput;
+    data->window_start = now;
+    data->window_completions = 0;
+    data->window_failed = FALSE;
+}
+
+static void complete_limited_process(void *data, pid_t pid, ProcReact_Status status, int result)
+{
+    ConcurrencyLimitData *concurrency_limit_data = (ConcurrencyLimitData*)data;
+    
+    /* Propagate the completion to the actual iterator */
+    concurrency_limit_data->iterator->complete(concurrency_limit_data->iterator->data, pid, status, result);
+    
+    /* Update the throughput measurements */
+    if(concurrency_limit_data->adaptive)
+    {
+        concurrency_limit_data->window_completions++;
+        
+        if(status != PROCREACT_STATUS_OK || !result)
+            concurrency_limit_data->window_failed = TRUE;
+        
+        if(concurrency_limit_data->window_completions >= concurrency_limit_data->limit)
+            adapt_limit(concurrency_limit_data);
+    }
+}
+
+void fork_and_wait_in_parallel_with_concurrency_limit(ProcReact_PidIterator *iterator, const unsigned int max_concurrent_transfers)
+{
+    ConcurrencyLimitData data;
+    ProcReact_PidIterator limited_iterator;
+    unsigned int adaptive_max = read_unsigned_int_from_env("DISNIX_ADAPTIVE_CONCURRENCY");
+    int has_running_processes = FALSE;
+    
+    data.iterator = iterator;
+    data.limit = MAX(1, max_concurrent_transfers);
+    data.adaptive = (adaptive_max > 0);
+    data.max_limit = MAX(data.limit, adaptive_max);
+    data.window_start = g_get_monotonic_time();
+    data.window_completions = 0;
+    data.window_failed = FALSE;
+    data.previous_throughput = 0;
+    
+    limited_iterator = procreact_initialize_pid_iterator(has_next_limited_process, next_limited_process, iterator->retrieve, complete_limited_process, &data);
+    
+    /* Repeat this until all processes have been spawned and finished, taking the current limit into account */
+    while(has_running_processes || has_next_limited_process(&data))
+    {
+        while(limited_iterator.running_processes < data.limit && procreact_spawn_next_pid(&limited_iterator));
+        has_running_processes = procreact_wait_for_process_to_complete(&limited_iterator);
+    }
+}
+
+unsigned int max_concurrent_transfers_per_target(void)
+{
+    return read_unsigned_int_from_env("DISNIX_MAX_CONCURRENT_TRANSFERS_PER_TARGET");
+}
+
+int create_concurrency_tokens(ConcurrencyTokens *tokens, const unsigned int amount)
+{
+    tokens->amount = CLAMP(amount, 1, MAX_TOKENS);
+    tokens->semid = semget(IPC_PRIVATE, 1, IPC_CREAT | 0600);
+    
+    if(tokens->semid == -1)
+        return FALSE;
+    
+    if(semctl(tokens->semid, 0, SETVAL, (int)tokens->amount) == -1)
+    {
+        semctl(tokens->semid, 0, IPC_RMID);
+        return FALSE;
+    }
+    
+    tokens->owner = getpid();
+    tokens->holds_token = FALSE;
+    return TRUE;
+}
+
+static int change_tokens(ConcurrencyTokens *tokens, short amount, short flags)
+{
+    struct sembuf operation;
+    
+    operation.sem_num = 0;
+    operation.sem_op = amount;
+    operation.sem_flg = SEM_UNDO | flags; /* The kernel returns the token of a process that terminates while holding it */
+    
+    while(semop(tokens->semid, &operation, 1) == -1)
+    {
+        if(errno != EINTR)
+            return FALSE;
+    }
+    
+    return TRUE;
+}
+
+int acquire_concurrency_token(ConcurrencyTokens *tokens)
+{
+    if(tokens->holds_token)
+        return TRUE;
+    
+    /* Blocks until any holder releases its token */
+    tokens->holds_token = change_tokens(tokens, -1, 0);
+    return tokens->holds_token;
+}
+
+int try_acquire_concurrency_token(ConcurrencyTokens *tokens)
+{
+    if(tokens->holds_token)
+        return TRUE;
+    
+    tokens->holds_token = change_tokens(tokens, -1, IPC_NOWAIT);
+    return tokens->holds_token;
+}
+
+void release_concurrency_token(ConcurrencyTokens *tokens)
+{
+    if(tokens->holds_token)
+    {
+        change_tokens(tokens, 1, 0);
+        tokens->holds_token = FALSE;
+    }
+}
+
+void destroy_concurrency_tokens(ConcurrencyTokens *tokens)
+{
+    /* Forked processes share the pool, so only the process that has created it removes it */
+    if(tokens->owner == getpid())
+        semctl(tokens->semid, 0, IPC_RMID);
+}
@@ -0,0 +1,124 @@
+/*
+ * Disnix - A Nix-based distributed service deployment tool
+ * Copyright (C) 2008-2017  Sander van der Burg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef __DISNIX_CONCURRENCYLIMIT_H
+#define __DISNIX_CONCURRENCYLIMIT_H
+
+#include <sys/types.h>
+#include <glib.h>
+#include <procreact_pid_iterator.h>
+
+/**
+ * Spawns the processes of an iterator in parallel, limiting the amount of
+ * processes running concurrently, and waits for their completion.
+ *
+ * If the DISNIX_ADAPTIVE_CONCURRENCY environment variable is set to a number,
+ * the limit adapts to the measured throughput, starting at
+ * max_concurrent_transfers and ranging from 1 to the given number. The
+ * throughput is the amount of processes completed per second, regardless of
+ * the amount of data they transfer. Each time as many processes have
+ * completed as the current limit, the limit increases by one as long as the
+ * throughput does not drop. It decreases multiplicatively when the throughput
+ * drops or a process fails. The decisions are logged to the standard error.
+ *
+ * The processes are spawned in the order of the iterator. Tools that run
+ * several processes for the same target restrict them per target with a
+ * token pool per target instead (see max_concurrent_transfers_per_target()),
+ * so that a busy target never holds back the processes of other targets.
+ * Their limits are fixed and not adapted.
+ *
+ * @param iterator PID iterator
+ * @param max_concurrent_transfers Maximum amount of concurrent processes, or the initial amount in adaptive mode
+ */
+void fork_and_wait_in_parallel_with_concurrency_limit(ProcReact_PidIterator *iterator, const unsigned int max_concurrent_transfers);
+
+/**
+ * @brief Pool of tokens that limits the amount of concurrent activities across processes
+ *
+ * The tokens are the value of a System V semaphore, so that processes forked
+ * from the same parent share the pool and a waiting process gets woken up as
+ * soon as any token is released. The token of a process that gets killed
+ * returns to the pool automatically. A process can hold at most one token of a
+ * pool at the time.
+ */
+typedef struct
+{
+    /** Identifier of the semaphore whose value is the amount of available tokens */
+    int semid;
+    /** Amount of tokens in the pool */
+    unsigned int amount;
+    /** PID of the process that has created the pool */
+    pid_t owner;
+    /** Indicates whether this process holds a token */
+    int holds_token;
+}
+ConcurrencyTokens;
+
+/**
+ * Creates a pool with the given amount of tokens. The amount is at least 1 and
+ * at most 32767.
+ *
+ * @param tokens Token pool to initialize
+ * @param amount Amount of tokens in the pool
+ * @return TRUE if the pool has been created, else FALSE
+ */
+int create_concurrency_tokens(ConcurrencyTokens *tokens, const unsigned int amount);
+
+/**
+ * Acquires a token from the pool, blocking until one becomes available.
+ *
+ * @param tokens Token pool
+ * @return TRUE if a token has been acquired, else FALSE. A token that has not been acquired must not be released
+ */
+int acquire_concurrency_token(ConcurrencyTokens *tokens);
+
+/**
+ * Acquires a token from the pool if one is available, without blocking.
+ *
+ * @param tokens Token pool
+ * @return TRUE if a token has been acquired, else FALSE
+ */
+int try_acquire_concurrency_token(ConcurrencyTokens *tokens);
+
+/**
+ * Returns a previously acquired token to the pool.
+ *
+ * @param tokens Token pool
+ */
+void release_concurrency_token(ConcurrencyTokens *tokens);
+
+/**
+ * Destroys all resources allocated by the token pool. Only the process that
+ * has created the pool removes the semaphore, so that processes forked from
+ * it can safely call this function as well.
+ *
+ * @param tokens Token pool
+ */
+void destroy_concurrency_tokens(ConcurrencyTokens *tokens);
+
+/**
+ * Determines the maximum amount of concurrent transfers per target from the
+ * DISNIX_MAX_CONCURRENT_TRANSFERS_PER_TARGET environment variable.
+ *
+ * @return The maximum amount of concurrent transfers per target, or 0 for no restriction
+ */
+unsigned int max_concurrent_transfers_per_target(void);
+
+#endif
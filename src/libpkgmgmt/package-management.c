@@ -27,14 +27,38 @@
 #include <sys/types.h>
 #include <pwd.h>
 #include <errno.h>
+#include <signal.h>
 
 #define BUFFER_SIZE 1024
 #define NIX_STORE_CMD "nix-store"
 #define NIX_COLLECT_GARBAGE_CMD "nix-collect-garbage"
 #define NIX_ENV_CMD "nix-env"
+#define DISNIX_COPY_CLOSURE_CMD "disnix-copy-closure"
+#define GC_GENERATION_DIR LOCALSTATEDIR "/lib/disnix"
 
 #define RESOLVED_PATH_MAX_SIZE 4096
 
+/* An export ends with a 64-bit zero that marks the end of the stream */
+#define EXPORT_END_MARKER_SIZE 8
+
+pid_t pkgmgmt_import_closure_fd(int closure_fd, int stdout, int stderr)
+{
+    pid_t pid = fork();
+    
+    if(pid == 0)
+    {
+        char *const args[] = {NIX_STORE_CMD, "--import", NULL};
+        
+        dup2(closure_fd, 0);
+        dup2(stdout, 1);
+        dup2(stderr, 2);
+        execvp(NIX_STORE_CMD, args);
+        _exit(1);
+    }
+    
+    return pid;
+}
+
 pid_t pkgmgmt_import_closure(const char *closure, int stdout, int stderr)
 {
     int closure_fd = open(closure, O_RDONLY);
@@ -43,21 +67,222 @@ pid_t pkgmgmt_import_closure(const char *closure, int stdout, int stderr)
         return -1;
     else
     {
-        pid_t pid = fork();
+        pid_t pid = pkgmgmt_import_closure_fd(closure_fd, stdout, stderr);
+        close(closure_fd);
+        return pid;
+    }
+}
+
+static int copy_export_entries(int closure_fd, int import_fd)
+{
+    struct stat st;
+    off_t remaining;
+    gchar buffer[BUFFER_SIZE];
+    gchar end_marker[EXPORT_END_MARKER_SIZE];
+    unsigned int i;
+    
+    if(fstat(closure_fd, &st) == -1 || st.st_size < EXPORT_END_MARKER_SIZE)
+        return FALSE;
+    
+    /* Copy the entries, but not the end marker, so that the entries of the next export follow */
+    remaining = st.st_size - EXPORT_END_MARKER_SIZE;
+    
+    while(remaining > 0)
+    {
+        ssize_t bytes_read = read(closure_fd, buffer, remaining < BUFFER_SIZE ? remaining : BUFFER_SIZE);
+        
+        if(bytes_read <= 0 || write(import_fd, buffer, bytes_read) != bytes_read)
+            return FALSE;
+        
+        remaining -= bytes_read;
+    }
+    
+    /* Check that the export really ends with the end marker */
+    if(read(closure_fd, end_marker, EXPORT_END_MARKER_SIZE) != EXPORT_END_MARKER_SIZE)
+        return FALSE;
+    
+    for(i = 0; i < EXPORT_END_MARKER_SIZE; i++)
+    {
+        if(end_marker[i] != 0)
+            return FALSE;
+    }
+    
+    return TRUE;
+}
+
+static int import_concatenated_closures(gchar **closures, int stderr)
+{
+    int pipefd[2];
+    pid_t pid;
+    unsigned int i;
+    int success = TRUE;
+    ProcReact_Status status;
+    
+    if(pipe(pipefd) == -1)
+        return FALSE;
+    
+    /* Make sure that the import does not keep its own input open */
+    fcntl(pipefd[1], F_SETFD, FD_CLOEXEC);
+    
+    pid = pkgmgmt_import_closure_fd(pipefd[0], stderr, stderr);
+    close(pipefd[0]);
+    
+    if(pid == -1)
+    {
+        close(pipefd[1]);
+        return FALSE;
+    }
+    
+    /* Stream the entries of all exports into one import */
+    for(i = 0; success && closures[i] != NULL; i++)
+    {
+        int closure_fd = open(closures[i], O_RDONLY);
+        
+        if(closure_fd == -1)
+            success = FALSE;
+        else
+        {
+            success = copy_export_entries(closure_fd, pipefd[1]);
+            close(closure_fd);
+        }
+    }
+    
+    /* Terminate the stream. If an export could not be copied, the import fails because the stream is truncated */
+    if(success)
+    {
+        gchar end_marker[EXPORT_END_MARKER_SIZE] = { 0 };
+        success = (write(pipefd[1], end_marker, EXPORT_END_MARKER_SIZE) == EXPORT_END_MARKER_SIZE);
+    }
+    
+    close(pipefd[1]);
+    
+    return (procreact_wait_for_boolean(pid, &status) && success);
+}
+
+static int is_regular_file(const gchar *path)
+{
+    struct stat st;
+    return (stat(path, &st) == 0 && S_ISREG(st.st_mode));
+}
+
+static int import_closure_separately(gchar *closure, int stderr)
+{
+    ProcReact_Status status;
+    pid_t pid = pkgmgmt_import_closure(closure, stderr, stderr);
+    return (pid != -1 && procreact_wait_for_boolean(pid, &status));
+}
+
+ProcReact_Future pkgmgmt_import_closures(gchar **closures, const int *stderrs)
+{
+    ProcReact_Future future = procreact_initialize_future(procreact_create_string_array_type('\n'));
+    
+    if(future.pid == 0)
+    {
+        unsigned int i, num_of_closures = g_strv_length(closures), num_of_mergeable = 0, first_mergeable = 0;
+        gchar **mergeable_closures = (gchar**)g_malloc((num_of_closures + 1) * sizeof(gchar*));
+        int *mergeable = (int*)g_malloc(num_of_closures * sizeof(int));
+        int merged_import_succeeded = FALSE;
         
-        if(pid == 0)
+        /* A failing import should not terminate us while we are writing to it */
+        signal(SIGPIPE, SIG_IGN);
+        
+        /*
+         * Only regular files can be merged, since their size tells where the
+         * end marker is and they can be read again if the merged import fails.
+         * Other closures, such as named pipes fed by a client, are read once.
+         */
+        for(i = 0; i < num_of_closures; i++)
         {
-            char *const args[] = {NIX_STORE_CMD, "--import", NULL};
+            mergeable[i] = is_regular_file(closures[i]);
             
-            dup2(closure_fd, 0);
-            dup2(stdout, 1);
-            dup2(stderr, 2);
-            execvp(NIX_STORE_CMD, args);
-            _exit(1);
+            if(mergeable[i])
+            {
+                if(num_of_mergeable == 0)
+                    first_mergeable = i;
+                
+                mergeable_closures[num_of_mergeable] = closures[i];
+                num_of_mergeable++;
+            }
         }
         
-        return pid;
+        mergeable_closures[num_of_mergeable] = NULL;
+        
+        if(num_of_mergeable > 0)
+            merged_import_succeeded = import_concatenated_closures(mergeable_closures, stderrs[first_mergeable]);
+        
+        /* Report the outcome per closure. If the merged import failed, import each regular file separately to find out which ones fail */
+        for(i = 0; i < num_of_closures; i++)
+        {
+            int result;
+            
+            if(mergeable[i] && merged_import_succeeded)
+                result = TRUE;
+            else
+                result = import_closure_separately(closures[i], stderrs[i]);
+            
+            dprintf(future.fd, "%d\n", result);
+        }
+        
+        _exit(0);
     }
+    
+    return future;
+}
+
+pid_t pkgmgmt_export_closure_fd(gchar **derivation, int closure_fd, int stderr)
+{
+    pid_t pid = fork();
+    
+    if(pid == 0)
+    {
+        unsigned int i, derivation_length = g_strv_length(derivation);
+        gchar **args = (char**)g_malloc((3 + derivation_length) * sizeof(gchar*));
+
+        args[0] = NIX_STORE_CMD;
+        args[1] = "--export";
+
+        for(i = 0; i < derivation_length; i++)
+            args[i + 2] = derivation[i];
+
+        args[i + 2] = NULL;
+
+        dup2(closure_fd, 1);
+        dup2(stderr, 2);
+        execvp(NIX_STORE_CMD, args);
+        _exit(1);
+    }
+    
+    return pid;
+}
+
+pid_t pkgmgmt_copy_closure_from(gchar *interface, gchar *target, gchar **paths, int stdout, int stderr)
+{
+    pid_t pid = fork();
+    
+    if(pid == 0)
+    {
+        unsigned int i, paths_length = g_strv_length(paths);
+        gchar **args = (gchar**)g_malloc((7 + paths_length) * sizeof(gchar*));
+        
+        args[0] = DISNIX_COPY_CLOSURE_CMD;
+        args[1] = "--from";
+        args[2] = "--target";
+        args[3] = target;
+        args[4] = "--interface";
+        args[5] = interface;
+        
+        for(i = 0; i < paths_length; i++)
+            args[i + 6] = paths[i];
+        
+        args[i + 6] = NULL;
+        
+        dup2(stdout, 1);
+        dup2(stderr, 2);
+        execvp(DISNIX_COPY_CLOSURE_CMD, args);
+        _exit(1);
+    }
+    
+    return pid;
 }
 
 gchar *pkgmgmt_export_closure(gchar *tmpdir, gchar **derivation, int stderr, pid_t *pid, int *temp_fd)
@@ -72,27 +297,7 @@ gchar *pkgmgmt_export_closure(gchar *tmpdir, gchar **derivation, int stderr, pid
     }
     else
     {
-        *pid = fork();
-        
-        if(*pid == 0)
-        {
-            unsigned int i, derivation_length = g_strv_length(derivation);
-            gchar **args = (char**)g_malloc((3 + derivation_length) * sizeof(gchar*));
-
-            args[0] = NIX_STORE_CMD;
-            args[1] = "--export";
-
-            for(i = 0; i < derivation_length; i++)
-                args[i + 2] = derivation[i];
-
-            args[i + 2] = NULL;
-
-            dup2(*temp_fd, 1);
-            dup2(stderr, 2);
-            execvp(NIX_STORE_CMD, args);
-            _exit(1);
-        }
-        
+        *pid = pkgmgmt_export_closure_fd(derivation, *temp_fd, stderr);
         return tempfilename;
     }
 }
@@ -222,28 +427,122 @@ ProcReact_Future pkgmgmt_query_requisites(gchar **derivation, int stderr)
     return future;
 }
 
+ProcReact_Future pkgmgmt_query_outputs(gchar **derivation, int stderr)
+{
+    ProcReact_Future future = procreact_initialize_future(procreact_create_string_array_type('\n'));
+
+    if(future.pid == 0)
+    {
+        unsigned int i, derivation_size = g_strv_length(derivation);
+        char **args = (char**)g_malloc((4 + derivation_size) * sizeof(char*));
+
+        args[0] = NIX_STORE_CMD;
+        args[1] = "-q";
+        args[2] = "--outputs";
+        
+        for(i = 0; i < derivation_size; i++)
+            args[i + 3] = derivation[i];
+
+        args[i + 3] = NULL;
+
+        dup2(future.fd, 1);
+        dup2(stderr, 2);
+        execvp(NIX_STORE_CMD, args);
+        _exit(1);
+    }
+    
+    return future;
+}
+
+ProcReact_Future pkgmgmt_query_sizes(gchar **derivation, int stderr)
+{
+    ProcReact_Future future = procreact_initialize_future(procreact_create_string_array_type('\n'));
+
+    if(future.pid == 0)
+    {
+        unsigned int i, derivation_size = g_strv_length(derivation);
+        char **args = (char**)g_malloc((4 + derivation_size) * sizeof(char*));
+
+        args[0] = NIX_STORE_CMD;
+        args[1] = "-q";
+        args[2] = "--size";
+        
+        for(i = 0; i < derivation_size; i++)
+            args[i + 3] = derivation[i];
+
+        args[i + 3] = NULL;
+
+        dup2(future.fd, 1);
+        dup2(stderr, 2);
+        execvp(NIX_STORE_CMD, args);
+        _exit(1);
+    }
+    
+    return future;
+}
+
+static void bump_gc_generation(void)
+{
+    gchar *generation = g_strdup_printf("%" G_GINT64_FORMAT "-%d\n", g_get_real_time(), getpid());
+    
+    g_mkdir_with_parents(GC_GENERATION_DIR, 0755);
+    g_file_set_contents(GC_GENERATION_DIR "/gc-generation", generation, -1, NULL);
+    g_free(generation);
+}
+
+gchar *pkgmgmt_query_gc_generation(void)
+{
+    gchar *generation;
+    
+    if(g_file_get_contents(GC_GENERATION_DIR "/gc-generation", &generation, NULL, NULL))
+        return g_strstrip(generation);
+    else
+        return g_strdup("0"); /* No garbage has been collected through Disnix yet */
+}
+
 pid_t pkgmgmt_collect_garbage(int delete_old, int stdout, int stderr)
 {
     pid_t pid = fork();
     
     if(pid == 0)
     {
-        dup2(stdout, 1);
-        dup2(stderr, 2);
+        pid_t gc_pid;
+        int status;
         
-        if(delete_old)
-        {
-            char *const args[] = {NIX_COLLECT_GARBAGE_CMD, "-d", NULL};
-            execvp(NIX_COLLECT_GARBAGE_CMD, args);
-        }
-        else
+        /*
+         * Change the garbage collection generation marker before and after
+         * collecting garbage, so that coordinators know that their
+         * knowledge about valid paths on this machine is no longer accurate
+         */
+        bump_gc_generation();
+        
+        gc_pid = fork();
+        
+        if(gc_pid == 0)
         {
-            char *const args[] = {NIX_COLLECT_GARBAGE_CMD, NULL};
-            execvp(NIX_COLLECT_GARBAGE_CMD, args);
+            dup2(stdout, 1);
+            dup2(stderr, 2);
+            
+            if(delete_old)
+            {
+                char *const args[] = {NIX_COLLECT_GARBAGE_CMD, "-d", NULL};
+                execvp(NIX_COLLECT_GARBAGE_CMD, args);
+            }
+            else
+            {
+                char *const args[] = {NIX_COLLECT_GARBAGE_CMD, NULL};
+                execvp(NIX_COLLECT_GARBAGE_CMD, args);
+            }
+            
+            dprintf(stderr, "Error with executing garbage collect process\n");
+            _exit(1);
         }
         
-        dprintf(stderr, "Error with executing garbage collect process\n");
-        _exit(1);
+        if(gc_pid == -1 || waitpid(gc_pid, &status, 0) == -1)
+            _exit(1);
+        
+        bump_gc_generation();
+        _exit(!(WIFEXITED(status) && WEXITSTATUS(status) == 0));
     }
     
     return pid;
@@ -26,8 +26,16 @@
 
 pid_t pkgmgmt_import_closure(const char *closure, int stdout, int stderr);
 
+pid_t pkgmgmt_import_closure_fd(int closure_fd, int stdout, int stderr);
+
+ProcReact_Future pkgmgmt_import_closures(gchar **closures, const int *stderrs);
+
+pid_t pkgmgmt_copy_closure_from(gchar *interface, gchar *target, gchar **paths, int stdout, int stderr);
+
 gchar *pkgmgmt_export_closure(gchar *tmpdir, gchar **derivation, int stderr, pid_t *pid, int *temp_fd);
 
+pid_t pkgmgmt_export_closure_fd(gchar **derivation, int closure_fd, int stderr);
+
 ProcReact_Future pkgmgmt_print_invalid_packages(gchar **derivation, int stderr);
 
 ProcReact_Future pkgmgmt_realise(gchar **derivation, int stderr);
@@ -36,8 +44,14 @@ pid_t pkgmgmt_set_profile(gchar *profile, gchar *derivation, int stdout, int std
 
 ProcReact_Future pkgmgmt_query_requisites(gchar **derivation, int stderr);
 
+ProcReact_Future pkgmgmt_query_sizes(gchar **derivation, int stderr);
+
+ProcReact_Future pkgmgmt_query_outputs(gchar **derivation, int stderr);
+
 pid_t pkgmgmt_collect_garbage(int delete_old, int stdout, int stderr);
 
+gchar *pkgmgmt_query_gc_generation(void);
+
 ProcReact_Future pkgmgmt_instantiate(gchar *infrastructure_expr);
 
 char *pkgmgmt_instantiate_sync(gchar *infrastructure_expr);
@@ -209,6 +209,40 @@ pid_t statemgmt_clean_snapshots(gint keep, gchar *container, gchar *component, i
     return pid;
 }
 
+pid_t statemgmt_copy_snapshots_from(gchar *interface, gchar *target, gchar *container, gchar *component, int stdout, int stderr)
+{
+    pid_t pid = fork();
+    
+    if(pid == 0)
+    {
+        char *const args[] = {"disnix-copy-snapshots", "--from", "--target", target, "--interface", interface, "--container", container, "--component", component, NULL};
+        
+        dup2(stdout, 1);
+        dup2(stderr, 2);
+        execvp(args[0], args);
+        _exit(1);
+    }
+    
+    return pid;
+}
+
+pid_t statemgmt_capture_config_fd(int config_fd, int stderr)
+{
+    pid_t pid = fork();
+    
+    if(pid == 0)
+    {
+        char *const args[] = { "dysnomia-containers", "--generate-expr", NULL };
+        
+        dup2(config_fd, 1);
+        dup2(stderr, 2);
+        execvp("dysnomia-containers", args);
+        _exit(1);
+    }
+    
+    return pid;
+}
+
 gchar *statemgmt_capture_config(gchar *tmpdir, int stderr, pid_t *pid, int *temp_fd)
 {
     gchar *tempfilename = g_strconcat(tmpdir, "/disnix.XXXXXX", NULL);
@@ -225,18 +259,7 @@ gchar *statemgmt_capture_config(gchar *tmpdir, int stderr, pid_t *pid, int *temp
     else
     {
         /* Execute process capturing the config and writing it to a temp file */
-        *pid = fork();
-
-        if(*pid == 0)
-        {
-            char *const args[] = { "dysnomia-containers", "--generate-expr", NULL };
-            
-            dup2(*temp_fd, 1);
-            dup2(stderr, 2);
-            execvp("dysnomia-containers", args);
-            _exit(1);
-        }
-        
+        *pid = statemgmt_capture_config_fd(*temp_fd, stderr);
         return tempfilename;
     }
 }
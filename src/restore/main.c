@@ -60,6 +60,11 @@ static void print_usage(const char *command)
     printf("                                       is more space efficient, but slower.\n");
     printf("      --all                            Transfers all snapshot generations of the\n");
     printf("                                       target machines, not the latest\n");
+    printf("      --direct                         Lets the targets of moved components\n");
+    printf("                                       fetch the snapshots directly from the\n");
+    printf("                                       machines they were previously deployed to,\n");
+    printf("                                       instead of sending them through the\n");
+    printf("                                       coordinator\n");
     printf("      --keep=NUM                       Amount of snapshot generations to keep.\n");
     printf("                                       Defaults to: 1\n");
     printf("  -p, --profile=PROFILE                Name of the profile in which the services\n");
@@ -72,10 +77,17 @@ static void print_usage(const char *command)
     printf("                                       in most cases.\n");
     printf("  -m, --max-concurrent-transfers=NUM   Maximum amount of concurrent closure\n");
     printf("                                       transfers. Defauls to: 2\n");
+    printf("      --max-concurrent-transfers-per-target=NUM\n");
+    printf("                                       Maximum amount of snapshots transferred\n");
+    printf("                                       concurrently for the same target.\n");
+    printf("                                       Defaults to: 1\n");
     printf("  -h, --help                           Shows the usage of this command to the\n");
     printf("                                       user\n");
 
     printf("\nEnvironment:\n");
+    printf("  DISNIX_MAX_CONCURRENT_TRANSFERS_PER_TARGET\n");
+    printf("                    Default maximum amount of snapshots transferred\n");
+    printf("                    concurrently for the same target\n");
     printf("  DISNIX_PROFILE    Sets the name of the profile that stores the manifest on the\n");
     printf("                    coordinator machine and the deployed services per machine on\n");
     printf("                    each target (Defaults to: default)\n");
@@ -96,14 +108,17 @@ int main(int argc, char *argv[])
         {"depth-first", no_argument, 0, 'D'},
         {"no-upgrade", no_argument, 0, 'u'},
         {"all", no_argument, 0, 'a'},
+        {"direct", no_argument, 0, 'd'},
         {"keep", required_argument, 0, 'k'},
         {"max-concurrent-transfers", required_argument, 0, 'm'},
+        {"max-concurrent-transfers-per-target", required_argument, 0, 'T'},
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'v'},
         {0, 0, 0, 0}
     };
     
     unsigned int max_concurrent_transfers = 2;
+    unsigned int transfers_per_target = 0;
     unsigned int flags = 0;
     int keep = 1;
     char *old_manifest = NULL;
@@ -139,6 +154,9 @@ int main(int argc, char *argv[])
             case 'a':
                 flags |= FLAG_ALL;
                 break;
+            case 'd':
+                flags |= FLAG_DIRECT;
+                break;
             case 'k':
                 keep = atoi(optarg);
                 break;
@@ -151,6 +169,9 @@ int main(int argc, char *argv[])
             case 'm':
                 max_concurrent_transfers = atoi(optarg);
                 break;
+            case 'T':
+                transfers_per_target = atoi(optarg);
+                break;
             case 'h':
             case '?':
                 print_usage(argv[0]);
@@ -170,5 +191,5 @@ int main(int argc, char *argv[])
     else
         manifest_file = argv[optind];
     
-    return restore(manifest_file, max_concurrent_transfers, flags, keep, old_manifest, coordinator_profile_path, profile, container, component); /* Execute restore operation */
+    return restore(manifest_file, max_concurrent_transfers, transfers_per_target, flags, keep, old_manifest, coordinator_profile_path, profile, container, component); /* Execute restore operation */
 }
@@ -26,186 +26,258 @@
 #include <manifest.h>
 #include <snapshotmapping.h>
 #include <targets.h>
+#include <concurrencylimit.h>
+#include <transfer-statistics.h>
 
-/* Send snapshots infrastructure */
+/* Peer lookup infrastructure */
 
-typedef struct
+static gchar *compose_component_key(const SnapshotMapping *mapping)
 {
-    GPtrArray *snapshots_array;
-    unsigned int flags;
+    return g_strconcat(mapping->container, "/", mapping->component, NULL);
 }
-SendSnapshotsData;
 
-static pid_t send_snapshot_mapping(SnapshotMapping *mapping, Target *target, const unsigned int flags)
+static GHashTable *create_peer_table(GPtrArray *snapshots_array, Manifest *old_manifest)
 {
-    g_print("[target: %s]: Sending snapshots of component: %s deployed to container: %s\n", mapping->target, mapping->component, mapping->container);
-    return exec_copy_snapshots_to(target->client_interface, mapping->target, mapping->container, mapping->component, (flags & FLAG_ALL));
-}
-
-pid_t send_snapshots_to_target(void *data, Target *target)
-{
-    pid_t pid = fork();
+    GHashTable *old_mapping_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    GHashTable *peer_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    unsigned int i;
     
-    if(pid == 0)
+    /* Index the mappings of the previous configuration by container and component */
+    for(i = 0; i < old_manifest->snapshots_array->len; i++)
     {
-        SendSnapshotsData *send_snapshots_data = (SendSnapshotsData*)data;
+        SnapshotMapping *old_mapping = g_ptr_array_index(old_manifest->snapshots_array, i);
+        gchar *key = compose_component_key(old_mapping);
         
-        gchar *target_key = find_target_key(target);
-        GPtrArray *snapshots_per_target_array = find_snapshot_mappings_per_target(send_snapshots_data->snapshots_array, target_key);
-        unsigned int i;
-        int exit_status = 0;
-        ProcReact_Status status;
+        if(g_hash_table_lookup(old_mapping_table, key) == NULL)
+            g_hash_table_insert(old_mapping_table, key, old_mapping);
+        else
+            g_free(key);
+    }
+    
+    /* Map each moved component to the target that it was deployed to previously */
+    for(i = 0; i < snapshots_array->len; i++)
+    {
+        SnapshotMapping *mapping = g_ptr_array_index(snapshots_array, i);
+        gchar *key = compose_component_key(mapping);
+        SnapshotMapping *old_mapping = g_hash_table_lookup(old_mapping_table, key);
         
-        for(i = 0; i < snapshots_per_target_array->len; i++)
+        if(old_mapping != NULL)
         {
-            SnapshotMapping *mapping = g_ptr_array_index(snapshots_per_target_array, i);
-            exit_status = procreact_wait_for_exit_status(send_snapshot_mapping(mapping, target, send_snapshots_data->flags), &status);
-        
-            if(status != PROCREACT_STATUS_OK)
-            {
-                exit_status = 1;
-                break;
-            }
-            else if(exit_status != 0)
-                break;
+            Target *peer = find_target(old_manifest->target_array, old_mapping->target);
+            
+            if(peer != NULL)
+                g_hash_table_insert(peer_table, mapping, peer);
         }
-    
-        g_ptr_array_free(snapshots_per_target_array, TRUE);
         
-        exit(exit_status);
+        g_free(key);
     }
     
-    return pid;
+    g_hash_table_destroy(old_mapping_table);
+    return peer_table;
 }
 
-void complete_send_snapshots_to_target(void *data, Target *target, ProcReact_Status status, int result)
+/* Restore stages */
+
+static pid_t send_snapshot_mapping(SnapshotMapping *mapping, Target *target, const unsigned int flags, GHashTable *peer_table)
 {
-    if(status != PROCREACT_STATUS_OK || !result)
+    Target *peer = (peer_table == NULL) ? NULL : g_hash_table_lookup(peer_table, mapping);
+    
+    if(peer == NULL)
     {
-        gchar *target_key = find_target_key(target);
-        g_printerr("[target: %s]: Cannot retrieve snapshots!\n", target_key);
+        g_print("[target: %s]: Sending snapshots of component: %s deployed to container: %s\n", mapping->target, mapping->component, mapping->container);
+        return exec_copy_snapshots_to(target->client_interface, mapping->target, mapping->container, mapping->component, (flags & FLAG_ALL));
+    }
+    else
+    {
+        /* Let the target fetch the snapshot from the machine that has taken it, so that it does not pass through the coordinator */
+        gchar *peer_key = find_target_key(peer);
+        g_print("[target: %s]: Copying snapshots of component: %s deployed to container: %s directly from: %s\n", mapping->target, mapping->component, mapping->container, peer_key);
+        return exec_copy_snapshots_from_peer(target->client_interface, mapping->target, peer->client_interface, peer_key, mapping->container, mapping->component);
     }
 }
 
-static int send_snapshots(GPtrArray *snapshots_array, GPtrArray *target_array, const unsigned int max_concurrent_transfers, const unsigned int flags)
+static pid_t restore_snapshot_on_target(void *data, SnapshotMapping *mapping, Target *target, gchar **arguments, unsigned int arguments_length)
 {
-    int success;
-    SendSnapshotsData data = { snapshots_array, flags };
-    ProcReact_PidIterator iterator = create_target_iterator(target_array, send_snapshots_to_target, complete_send_snapshots_to_target, &data);
-    procreact_fork_and_wait_in_parallel_limit(&iterator, max_concurrent_transfers);
-    success = target_iterator_has_succeeded(&iterator);
+    g_print("[target: %s]: Restoring state of service: %s\n", mapping->target, mapping->component);
+    return exec_restore(target->client_interface, mapping->target, mapping->container, mapping->type, arguments, arguments_length, mapping->service);
+}
+
+static pid_t clean_snapshot_mapping(SnapshotMapping *mapping, Target *target, int keep)
+{
+    g_print("[target: %s]: Cleaning snapshots of component: %s deployed to container: %s\n", mapping->target, mapping->component, mapping->container);
+    return exec_clean_snapshots(target->client_interface, mapping->target, keep, mapping->container, mapping->component);
+}
+
+static int run_restore_stage(pid_t pid)
+{
+    ProcReact_Status status;
+    int result = procreact_wait_for_boolean(pid, &status);
+    return (status == PROCREACT_STATUS_OK && result);
+}
+
+/* Pipelined restore infrastructure */
+
+typedef struct
+{
+    /** Option flags */
+    unsigned int flags;
+    /** Amount of snapshot generations to keep */
+    int keep;
+    /** Maps moved snapshot mappings to the targets they can be copied from directly, or NULL */
+    GHashTable *peer_table;
+    /** Maximum amount of concurrent transfers per target */
+    unsigned int transfers_per_target;
+    /** Limits the amount of concurrent transfers of all targets */
+    ConcurrencyTokens transfer_tokens;
+}
+RestorePipelineData;
+
+static int create_restore_pipeline_data(RestorePipelineData *data, const unsigned int max_concurrent_transfers, const unsigned int transfers_per_target, const unsigned int flags, const int keep, GHashTable *peer_table)
+{
+    data->flags = flags;
+    data->keep = keep;
+    data->peer_table = peer_table;
+    data->transfers_per_target = transfers_per_target;
     
-    destroy_target_iterator(&iterator);
+    /* Send the snapshots of a target one at the time, unless configured otherwise */
+    if(data->transfers_per_target == 0)
+        data->transfers_per_target = max_concurrent_transfers_per_target();
+    if(data->transfers_per_target == 0)
+        data->transfers_per_target = 1;
     
-    return success;
+    return create_concurrency_tokens(&data->transfer_tokens, max_concurrent_transfers);
 }
 
-/* Restore snapshot infrastructure */
+static unsigned int determine_pipeline_limit(void *data, Target *target)
+{
+    RestorePipelineData *pipeline_data = (RestorePipelineData*)data;
+    return pipeline_data->transfers_per_target;
+}
 
-static pid_t restore_snapshot_on_target(SnapshotMapping *mapping, Target *target, gchar **arguments, unsigned int arguments_length)
+static int send_snapshot_with_transfer_token(RestorePipelineData *pipeline_data, SnapshotMapping *mapping, Target *target)
 {
-    g_print("[target: %s]: Restoring state of service: %s\n", mapping->target, mapping->component);
-    return exec_restore(target->client_interface, mapping->target, mapping->container, mapping->type, arguments, arguments_length, mapping->service);
+    int result;
+    
+    if(!acquire_concurrency_token(&pipeline_data->transfer_tokens))
+    {
+        g_printerr("[target: %s]: Cannot acquire a transfer slot!\n", mapping->target);
+        return FALSE;
+    }
+    
+    result = run_restore_stage(send_snapshot_mapping(mapping, target, pipeline_data->flags, pipeline_data->peer_table));
+    release_concurrency_token(&pipeline_data->transfer_tokens);
+    
+    return result;
+}
+
+/* Send snapshots infrastructure */
+
+static pid_t send_snapshot_mapping_in_pipeline(void *data, SnapshotMapping *mapping, Target *target, gchar **arguments, unsigned int arguments_length)
+{
+    pid_t pid = fork();
+    
+    if(pid == 0)
+    {
+        RestorePipelineData *pipeline_data = (RestorePipelineData*)data;
+        exit(!send_snapshot_with_transfer_token(pipeline_data, mapping, target));
+    }
+    
+    return pid;
 }
 
-static void complete_restore_snapshot_on_target(SnapshotMapping *mapping, ProcReact_Status status, int result)
+static void complete_send_snapshot_mapping_in_pipeline(void *data, SnapshotMapping *mapping, ProcReact_Status status, int result)
 {
     if(status != PROCREACT_STATUS_OK || !result)
-        g_printerr("[target: %s]: Cannot restore state of service: %s\n", mapping->target, mapping->component);
+        g_printerr("[target: %s]: Cannot send snapshots of component: %s\n", mapping->target, mapping->component);
 }
 
-static int restore_services(GPtrArray *snapshots_array, GPtrArray *target_array)
+static int send_snapshots(GPtrArray *snapshots_array, GPtrArray *target_array, RestorePipelineData *data)
 {
-    g_print("[coordinator]: Restoring state of services...\n");
-    return map_snapshot_items(snapshots_array, target_array, restore_snapshot_on_target, complete_restore_snapshot_on_target);
+    int success;
+    gchar *transfer_log = transfer_statistics_start();
+    
+    /*
+     * Each snapshot mapping is sent separately, so that a target with many
+     * components receives several of them at the same time. The global
+     * transfer slots are shared by the snapshots of all targets.
+     */
+    success = map_snapshot_items_limit(snapshots_array, target_array, determine_pipeline_limit, send_snapshot_mapping_in_pipeline, complete_send_snapshot_mapping_in_pipeline, data);
+    transfer_statistics_print_summary(transfer_log);
+    
+    return success;
 }
 
-/* Clean snapshot mapping infrastructure */
+/* Restore snapshot infrastructure */
 
-static pid_t clean_snapshot_mapping(SnapshotMapping *mapping, Target *target, int keep)
+static void complete_restore_snapshot_on_target(void *data, SnapshotMapping *mapping, ProcReact_Status status, int result)
 {
-    g_print("[target: %s]: Cleaning snapshots of component: %s deployed to container: %s\n", mapping->target, mapping->component, mapping->container);
-    return exec_clean_snapshots(target->client_interface, mapping->target, keep, mapping->container, mapping->component);
+    if(status != PROCREACT_STATUS_OK || !result)
+        g_printerr("[target: %s]: Cannot restore state of service: %s\n", mapping->target, mapping->component);
 }
 
-typedef struct
+static int restore_services(GPtrArray *snapshots_array, GPtrArray *target_array)
 {
-    GPtrArray *snapshots_array;
-    unsigned int flags;
-    int keep;
+    g_print("[coordinator]: Restoring state of services...\n");
+    return map_snapshot_items(snapshots_array, target_array, restore_snapshot_on_target, complete_restore_snapshot_on_target, NULL);
 }
-SendRestoreAndCleanSnapshotsData;
 
 /* Restore depth-first infrastructure */
 
-static pid_t send_restore_and_clean_snapshot_on_target(void *data, Target *target)
+static pid_t send_restore_and_clean_snapshot_mapping(void *data, SnapshotMapping *mapping, Target *target, gchar **arguments, unsigned int arguments_length)
 {
     pid_t pid = fork();
     
     if(pid == 0)
     {
-        SendRestoreAndCleanSnapshotsData *send_snapshots_data = (SendRestoreAndCleanSnapshotsData*)data;
+        RestorePipelineData *pipeline_data = (RestorePipelineData*)data;
         
-        gchar *target_key = find_target_key(target);
-        GPtrArray *snapshots_per_target_array = find_snapshot_mappings_per_target(send_snapshots_data->snapshots_array, target_key);
-        unsigned int i;
-        int exit_status = 0;
-        ProcReact_Status status;
+        if(!send_snapshot_with_transfer_token(pipeline_data, mapping, target))
+        {
+            g_printerr("[target: %s]: Cannot send snapshots of component: %s\n", mapping->target, mapping->component);
+            exit(1);
+        }
         
-        for(i = 0; i < snapshots_per_target_array->len; i++)
+        if(!run_restore_stage(restore_snapshot_on_target(NULL, mapping, target, arguments, arguments_length)))
         {
-            SnapshotMapping *mapping = g_ptr_array_index(snapshots_per_target_array, i);
-            gchar **arguments = generate_activation_arguments(target, mapping->container); /* Generate an array of key=value pairs from container properties */
-            unsigned int arguments_length = g_strv_length(arguments); /* Determine length of the activation arguments array */
-            
-            if(!procreact_wait_for_boolean(send_snapshot_mapping(mapping, target, send_snapshots_data->flags), &status) || (status != PROCREACT_STATUS_OK)
-              || !procreact_wait_for_boolean(restore_snapshot_on_target(mapping, target, arguments, arguments_length), &status) || (status != PROCREACT_STATUS_OK)
-              || !procreact_wait_for_boolean(clean_snapshot_mapping(mapping, target, send_snapshots_data->keep), &status) || (status != PROCREACT_STATUS_OK))
-            {
-                exit_status = 1;
-                g_strfreev(arguments);
-                break;
-            }
-            
-            g_strfreev(arguments);
+            g_printerr("[target: %s]: Cannot restore state of service: %s\n", mapping->target, mapping->component);
+            exit(1);
         }
-    
-        g_ptr_array_free(snapshots_per_target_array, TRUE);
         
-        exit(exit_status);
+        if(!run_restore_stage(clean_snapshot_mapping(mapping, target, pipeline_data->keep)))
+        {
+            g_printerr("[target: %s]: Cannot clean snapshots of component: %s\n", mapping->target, mapping->component);
+            exit(1);
+        }
+        
+        exit(0);
     }
     
     return pid;
 }
 
-void complete_send_restore_and_clean_snapshots_on_target(void *data, Target *target, ProcReact_Status status, int result)
+static void complete_send_restore_and_clean_snapshot_mapping(void *data, SnapshotMapping *mapping, ProcReact_Status status, int result)
 {
-    if(status != PROCREACT_STATUS_OK || !result)
-    {
-        gchar *target_key = find_target_key(target);
-        g_printerr("[target: %s]: Cannot send, restore or clean snapshots!\n", target_key);
-    }
+    /* The stages report their own failures, except abnormal terminations */
+    if(status != PROCREACT_STATUS_OK)
+        g_printerr("[target: %s]: Processing the snapshots of component: %s terminated abnormally!\n", mapping->target, mapping->component);
 }
 
-static int restore_depth_first(GPtrArray *snapshots_array, GPtrArray *target_array, const unsigned int max_concurrent_transfers, const unsigned int flags, const int keep)
+static int restore_depth_first(GPtrArray *snapshots_array, GPtrArray *target_array, RestorePipelineData *data)
 {
     int success;
-    SendRestoreAndCleanSnapshotsData data = { snapshots_array, flags, keep };
-    ProcReact_PidIterator iterator = create_target_iterator(target_array, send_restore_and_clean_snapshot_on_target, complete_send_restore_and_clean_snapshots_on_target, &data);
+    gchar *transfer_log = transfer_statistics_start();
     
     g_print("[coordinator]: Sending, restoring and cleaning snapshots...\n");
     
-    procreact_fork_and_wait_in_parallel_limit(&iterator, max_concurrent_transfers);
-    success = target_iterator_has_succeeded(&iterator);
-    
-    destroy_target_iterator(&iterator);
+    success = map_snapshot_items_limit(snapshots_array, target_array, determine_pipeline_limit, send_restore_and_clean_snapshot_mapping, complete_send_restore_and_clean_snapshot_mapping, data);
+    transfer_statistics_print_summary(transfer_log);
     
     return success;
 }
 
 /* The entire restore operation */
 
-int restore(const gchar *manifest_file, const unsigned int max_concurrent_transfers, const unsigned int flags, const int keep, const gchar *old_manifest, const gchar *coordinator_profile_path, gchar *profile, const gchar *container_filter, const gchar *component_filter)
+int restore(const gchar *manifest_file, const unsigned int max_concurrent_transfers, const unsigned int transfers_per_target, const unsigned int flags, const int keep, const gchar *old_manifest, const gchar *coordinator_profile_path, gchar *profile, const gchar *container_filter, const gchar *component_filter)
 {
     /* Generate a distribution array from the manifest file */
     Manifest *manifest = open_provided_or_previous_manifest_file(manifest_file, coordinator_profile_path, profile, MANIFEST_SNAPSHOT_FLAG, container_filter, component_filter);
@@ -219,7 +291,9 @@ int restore(const gchar *manifest_file, const unsigned int max_concurrent_transf
     {
         int exit_status;
         GPtrArray *snapshots_array;
+        GHashTable *peer_table = NULL;
         gchar *old_manifest_file;
+        RestorePipelineData data;
         
         if(old_manifest == NULL)
             old_manifest_file = determine_previous_manifest_file(coordinator_profile_path, profile);
@@ -237,27 +311,54 @@ int restore(const gchar *manifest_file, const unsigned int max_concurrent_transf
             g_printerr("[coordinator]: Snapshotting state of moved components...\n");
             snapshots_array = subtract_snapshot_mappings(manifest->snapshots_array, old_snapshots_array);
             delete_snapshots_array(old_snapshots_array);
+            
+            /* Look up the machines that have taken the snapshots of the moved components, so that the new targets can fetch them directly */
+            if(flags & FLAG_DIRECT)
+            {
+                Manifest *previous_manifest = create_manifest(old_manifest_file, MANIFEST_SNAPSHOT_FLAG, container_filter, component_filter);
+                
+                if(previous_manifest == NULL)
+                    g_printerr("[coordinator]: Cannot open the previous manifest, sending the snapshots through the coordinator\n");
+                else
+                {
+                    peer_table = create_peer_table(snapshots_array, previous_manifest);
+                    delete_manifest(previous_manifest);
+                }
+            }
         }
         
-        if(flags & FLAG_DEPTH_FIRST)
+        if(!create_restore_pipeline_data(&data, max_concurrent_transfers, transfers_per_target, flags, keep, peer_table))
         {
-            if(restore_depth_first(snapshots_array, manifest->target_array, max_concurrent_transfers, flags, keep))
-                exit_status = 0;
-            else
-                exit_status = 1;
+            g_printerr("[coordinator]: Cannot create the transfer slots!\n");
+            exit_status = 1;
         }
         else
         {
-            if(send_snapshots(snapshots_array, manifest->target_array, max_concurrent_transfers, flags) /* First, send the snapshots to the remote machines */
-              && ((flags & FLAG_TRANSFER_ONLY) || restore_services(snapshots_array, manifest->target_array))) /* Then, restore them on the remote machines */
-                exit_status = 0;
+            if(flags & FLAG_DEPTH_FIRST)
+            {
+                if(restore_depth_first(snapshots_array, manifest->target_array, &data))
+                    exit_status = 0;
+                else
+                    exit_status = 1;
+            }
             else
-                exit_status = 1;
+            {
+                if(send_snapshots(snapshots_array, manifest->target_array, &data) /* First, send the snapshots to the remote machines */
+                  && ((flags & FLAG_TRANSFER_ONLY) || restore_services(snapshots_array, manifest->target_array))) /* Then, restore them on the remote machines */
+                    exit_status = 0;
+                else
+                    exit_status = 1;
+            }
+            
+            destroy_concurrency_tokens(&data.transfer_tokens);
         }
         
         /* Cleanup */
         g_free(old_manifest_file);
         
+        if(peer_table != NULL)
+            g_hash_table_destroy(peer_table);
+        
         if(!(flags & FLAG_NO_UPGRADE) && old_manifest_file != NULL)
             g_ptr_array_free(snapshots_array, TRUE);
     
@@ -24,6 +24,7 @@
 #define FLAG_DEPTH_FIRST 0x2
 #define FLAG_ALL 0x4
 #define FLAG_NO_UPGRADE 0x8
+#define FLAG_DIRECT 0x10
 
 #include <glib.h>
 
@@ -32,6 +33,7 @@
  *
  * @param manifest_file Path to the manifest file which maps services to machines
  * @param max_concurrent_transfers Specifies the maximum amount of concurrent transfers
+ * @param transfers_per_target Maximum amount of concurrent transfers per target, 0 to use the DISNIX_MAX_CONCURRENT_TRANSFERS_PER_TARGET environment variable or else 1
  * @param keep Indicates how many snapshot generations should be kept
  * @param flags Option flags
  * @param old_manifest Manifest file representing the old deployment configuration
@@ -41,6 +43,6 @@
  * @param component_filter Snapshot operations will be restricted to the given component, NULL indicates all components
  * @return 0 if everything succeeds, else a non-zero exit status
  */
-int restore(const gchar *manifest_file, const unsigned int max_concurrent_transfers, const unsigned int flags, const int keep, const gchar *old_manifest, const gchar *coordinator_profile_path, gchar *profile, const gchar *container_filter, const gchar *component_filter);
+int restore(const gchar *manifest_file, const unsigned int max_concurrent_transfers, const unsigned int transfers_per_target, const unsigned int flags, const int keep, const gchar *old_manifest, const gchar *coordinator_profile_path, gchar *profile, const gchar *container_filter, const gchar *component_filter);
 
 #endif
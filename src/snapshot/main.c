@@ -60,6 +60,15 @@ static void print_usage(const char *command)
     printf("      --depth-first                    Snapshots components depth-first as\n");
     printf("                                       opposed to breadth-first. This approach\n");
     printf("                                       is more space efficient, but slower.\n");
+    printf("      --no-retrieve                    Takes the snapshots, but leaves them on\n");
+    printf("                                       the target machines, so that they can be\n");
+    printf("                                       fetched directly by the machines that\n");
+    printf("                                       restore them\n");
+    printf("      --disk-budget=NUM                Maximum amount of components per target\n");
+    printf("                                       of which snapshots may reside on the\n");
+    printf("                                       target before they have been retrieved\n");
+    printf("                                       and cleaned in depth-first mode.\n");
+    printf("                                       Defaults to: 2\n");
     printf("      --all                            Transfers all snapshot generations of the\n");
     printf("                                       target machines, not the latest\n");
     printf("      --keep=NUM                       Amount of snapshot generations to keep.\n");
@@ -74,10 +83,17 @@ static void print_usage(const char *command)
     printf("                                       in most cases.\n");
     printf("  -m, --max-concurrent-transfers=NUM   Maximum amount of concurrent closure\n");
     printf("                                       transfers. Defauls to: 2\n");
+    printf("      --max-concurrent-transfers-per-target=NUM\n");
+    printf("                                       Maximum amount of snapshots transferred\n");
+    printf("                                       concurrently for the same target.\n");
+    printf("                                       Defaults to: 1\n");
     printf("  -h, --help                           Shows the usage of this command to the\n");
     printf("                                       user\n");
 
     printf("\nEnvironment:\n");
+    printf("  DISNIX_MAX_CONCURRENT_TRANSFERS_PER_TARGET\n");
+    printf("                    Default maximum amount of snapshots transferred\n");
+    printf("                    concurrently for the same target\n");
     printf("  DISNIX_PROFILE    Sets the name of the profile that stores the manifest on the\n");
     printf("                    coordinator machine and the deployed services per machine on\n");
     printf("                    each target (Defaults to: default)\n");
@@ -98,16 +114,21 @@ int main(int argc, char *argv[])
         {"transfer-only", no_argument, 0, 't'},
         {"depth-first", no_argument, 0, 'D'},
         {"all", no_argument, 0, 'a'},
+        {"no-retrieve", no_argument, 0, 'n'},
         {"keep", required_argument, 0, 'k'},
+        {"disk-budget", required_argument, 0, 'B'},
         {"max-concurrent-transfers", required_argument, 0, 'm'},
+        {"max-concurrent-transfers-per-target", required_argument, 0, 'T'},
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'v'},
         {0, 0, 0, 0}
     };
     
     unsigned int max_concurrent_transfers = 2;
+    unsigned int transfers_per_target = 0;
     unsigned int flags = 0;
     int keep = 1;
+    int disk_budget = 2;
     char *manifest_file;
     char *old_manifest = NULL;
     char *profile = NULL;
@@ -141,6 +162,9 @@ int main(int argc, char *argv[])
             case 'a':
                 flags |= FLAG_ALL;
                 break;
+            case 'n':
+                flags |= FLAG_NO_RETRIEVE;
+                break;
             case 'k':
                 keep = atoi(optarg);
                 break;
@@ -150,9 +174,15 @@ int main(int argc, char *argv[])
             case 'D':
                 flags |= FLAG_DEPTH_FIRST;
                 break;
+            case 'B':
+                disk_budget = atoi(optarg);
+                break;
             case 'm':
                 max_concurrent_transfers = atoi(optarg);
                 break;
+            case 'T':
+                transfers_per_target = atoi(optarg);
+                break;
             case 'h':
             case '?':
                 print_usage(argv[0]);
@@ -167,10 +197,16 @@ int main(int argc, char *argv[])
     
     profile = check_profile_option(profile);
     
+    if(disk_budget < 1)
+    {
+        fprintf(stderr, "The disk budget must be at least 1!\n");
+        return 1;
+    }
+    
     if(optind >= argc)
         manifest_file = NULL;
     else
         manifest_file = argv[optind];
     
-    return snapshot(manifest_file, max_concurrent_transfers, flags, keep, old_manifest, coordinator_profile_path, profile, container, component); /* Execute snapshot operation */
+    return snapshot(manifest_file, max_concurrent_transfers, transfers_per_target, flags, keep, disk_budget, old_manifest, coordinator_profile_path, profile, container, component); /* Execute snapshot operation */
 }
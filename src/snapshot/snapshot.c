@@ -26,8 +26,10 @@
 #include <manifest.h>
 #include <snapshotmapping.h>
 #include <targets.h>
+#include <concurrencylimit.h>
+#include <transfer-statistics.h>
 
-/* Snapshot services infrastructure */
+/* Snapshot stages */
 
 static pid_t take_snapshot_on_target(SnapshotMapping *mapping, Target *target, gchar **arguments, unsigned int arguments_length)
 {
@@ -35,173 +37,244 @@ static pid_t take_snapshot_on_target(SnapshotMapping *mapping, Target *target, g
     return exec_snapshot(target->client_interface, mapping->target, mapping->container, mapping->type, arguments, arguments_length, mapping->service);
 }
 
-static void complete_take_snapshot_on_target(SnapshotMapping *mapping, ProcReact_Status status, int result)
+static pid_t retrieve_snapshot_mapping(SnapshotMapping *mapping, Target *target, const unsigned int flags)
 {
-    if(status != PROCREACT_STATUS_OK || !result)
-        g_printerr("[target: %s]: Cannot snapshot state of service: %s\n", mapping->target, mapping->component);
+    g_print("[target: %s]: Retrieving snapshots of component: %s deployed to container: %s\n", mapping->target, mapping->component, mapping->container);
+    return exec_copy_snapshots_from(target->client_interface, mapping->target, mapping->container, mapping->component, (flags & FLAG_ALL));
 }
 
-static int snapshot_services(GPtrArray *snapshots_array, GPtrArray *target_array)
+static pid_t clean_snapshot_mapping(SnapshotMapping *mapping, Target *target, int keep)
 {
-    return map_snapshot_items(snapshots_array, target_array, take_snapshot_on_target, complete_take_snapshot_on_target);
+    g_print("[target: %s]: Cleaning snapshots of component: %s deployed to container: %s\n", mapping->target, mapping->component, mapping->container);
+    return exec_clean_snapshots(target->client_interface, mapping->target, keep, mapping->container, mapping->component);
 }
 
-/* Retrieve snapshots infrastructure */
+/* Pipelined snapshot infrastructure */
 
 typedef struct
 {
-    GPtrArray *snapshots_array;
+    /** Option flags */
     unsigned int flags;
+    /** Amount of snapshot generations to keep */
+    int keep;
+    /** Maximum amount of components per target that are processed concurrently in depth-first mode */
+    unsigned int disk_budget;
+    /** Maximum amount of concurrent transfers per target */
+    unsigned int transfers_per_target;
+    /** Limits the amount of concurrent transfers of all pipelines */
+    ConcurrencyTokens transfer_tokens;
+    /** Maps each target to the tokens limiting its concurrent transfers */
+    GHashTable *target_transfer_tokens_table;
+    /** Maps each target to the tokens limiting its concurrent snapshot operations to its amount of CPU cores */
+    GHashTable *target_core_tokens_table;
 }
-RetrieveSnapshotsData;
+SnapshotPipelineData;
 
-static pid_t retrieve_snapshot_mapping(SnapshotMapping *mapping, Target *target, const unsigned int flags)
+static void delete_tokens(gpointer data)
 {
-    g_print("[target: %s]: Retrieving snapshots of component: %s deployed to container: %s\n", mapping->target, mapping->component, mapping->container);
-    return exec_copy_snapshots_from(target->client_interface, mapping->target, mapping->container, mapping->component, (flags & FLAG_ALL));
+    ConcurrencyTokens *tokens = (ConcurrencyTokens*)data;
+    destroy_concurrency_tokens(tokens);
+    g_free(tokens);
 }
 
-pid_t retrieve_snapshots_from_target(void *data, Target *target)
+static int add_target_tokens(GHashTable *tokens_table, gchar *target_key, const unsigned int amount)
 {
-    pid_t pid = fork();
+    ConcurrencyTokens *tokens = (ConcurrencyTokens*)g_malloc(sizeof(ConcurrencyTokens));
     
-    if(pid == 0)
+    if(create_concurrency_tokens(tokens, amount))
     {
-        RetrieveSnapshotsData *retrieve_snapshots_data = (RetrieveSnapshotsData*)data;
-        
-        gchar *target_key = find_target_key(target);
-        GPtrArray *snapshots_per_target_array = find_snapshot_mappings_per_target(retrieve_snapshots_data->snapshots_array, target_key);
-        unsigned int i;
-        int exit_status = 0;
-        ProcReact_Status status;
-        
-        for(i = 0; i < snapshots_per_target_array->len; i++)
-        {
-            SnapshotMapping *mapping = g_ptr_array_index(snapshots_per_target_array, i);
-            exit_status = procreact_wait_for_exit_status(retrieve_snapshot_mapping(mapping, target, retrieve_snapshots_data->flags), &status);
-        
-            if(status != PROCREACT_STATUS_OK)
-            {
-                exit_status = 1;
-                break;
-            }
-            else if(exit_status != 0)
-                break;
-        }
-    
-        g_ptr_array_free(snapshots_per_target_array, TRUE);
-        
-        exit(exit_status);
+        g_hash_table_insert(tokens_table, target_key, tokens);
+        return TRUE;
+    }
+    else
+    {
+        g_free(tokens);
+        return FALSE;
     }
-    
-    return pid;
 }
 
-void complete_retrieve_snapshots_from_target(void *data, Target *target, ProcReact_Status status, int result)
+static void destroy_snapshot_pipeline_data(SnapshotPipelineData *data)
 {
-    if(status != PROCREACT_STATUS_OK || !result)
-    {
-        gchar *target_key = find_target_key(target);
-        g_printerr("[target: %s]: Cannot send snapshots!\n", target_key);
-    }
+    g_hash_table_destroy(data->target_core_tokens_table);
+    g_hash_table_destroy(data->target_transfer_tokens_table);
+    destroy_concurrency_tokens(&data->transfer_tokens);
 }
 
-static int retrieve_snapshots(GPtrArray *snapshots_array, GPtrArray *target_array, const unsigned int max_concurrent_transfers, const unsigned int flags)
+static int create_snapshot_pipeline_data(SnapshotPipelineData *data, GPtrArray *snapshots_array, GPtrArray *target_array, const unsigned int max_concurrent_transfers, const unsigned int transfers_per_target, const unsigned int flags, const int keep, const unsigned int disk_budget)
 {
-    int success;
-    RetrieveSnapshotsData data = { snapshots_array, flags };
-    ProcReact_PidIterator iterator = create_target_iterator(target_array, retrieve_snapshots_from_target, complete_retrieve_snapshots_from_target, &data);
+    unsigned int i;
     
-    g_print("[coordinator]: Retrieving snapshots...\n");
+    data->flags = flags;
+    data->keep = keep;
+    data->disk_budget = disk_budget;
+    data->transfers_per_target = transfers_per_target;
     
-    procreact_fork_and_wait_in_parallel_limit(&iterator, max_concurrent_transfers);
-    success = target_iterator_has_succeeded(&iterator);
+    /* Retrieve the snapshots of a target one at the time, unless configured otherwise */
+    if(data->transfers_per_target == 0)
+        data->transfers_per_target = max_concurrent_transfers_per_target();
+    if(data->transfers_per_target == 0)
+        data->transfers_per_target = 1;
     
-    destroy_target_iterator(&iterator);
+    if(!create_concurrency_tokens(&data->transfer_tokens, max_concurrent_transfers))
+        return FALSE;
     
-    return success;
+    data->target_transfer_tokens_table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, delete_tokens);
+    data->target_core_tokens_table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, delete_tokens);
+    
+    for(i = 0; i < snapshots_array->len; i++)
+    {
+        SnapshotMapping *mapping = g_ptr_array_index(snapshots_array, i);
+        
+        if(g_hash_table_lookup(data->target_core_tokens_table, mapping->target) == NULL)
+        {
+            Target *target = find_target(target_array, mapping->target);
+            
+            if(target == NULL
+              || !add_target_tokens(data->target_core_tokens_table, mapping->target, target->num_of_cores)
+              || !add_target_tokens(data->target_transfer_tokens_table, mapping->target, data->transfers_per_target))
+            {
+                destroy_snapshot_pipeline_data(data);
+                return FALSE;
+            }
+        }
+    }
+    
+    return TRUE;
 }
 
-/* Clean snapshot mapping infrastructure */
-
-static pid_t clean_snapshot_mapping(SnapshotMapping *mapping, Target *target, int keep)
+static unsigned int determine_pipeline_limit(void *data, Target *target)
 {
-    g_print("[target: %s]: Cleaning snapshots of component: %s deployed to container: %s\n", mapping->target, mapping->component, mapping->container);
-    return exec_clean_snapshots(target->client_interface, mapping->target, keep, mapping->container, mapping->component);
+    SnapshotPipelineData *pipeline_data = (SnapshotPipelineData*)data;
+    
+    if(pipeline_data->flags & FLAG_NO_RETRIEVE)
+        return target->num_of_cores; /* Only the snapshot stage runs */
+    else if(pipeline_data->flags & FLAG_DEPTH_FIRST)
+        return pipeline_data->disk_budget; /* Bounds the amount of snapshots that reside on the target before they are cleaned */
+    else
+        return target->num_of_cores + pipeline_data->transfers_per_target; /* Keeps the snapshot and transfer stages of the target busy */
 }
 
-typedef struct
+static int run_snapshot_stage(ConcurrencyTokens *tokens, pid_t pid)
 {
-    GPtrArray *snapshots_array;
-    unsigned int flags;
-    int keep;
+    ProcReact_Status status;
+    int result = procreact_wait_for_boolean(pid, &status);
+    
+    release_concurrency_token(tokens);
+    return (status == PROCREACT_STATUS_OK && result);
 }
-TakeRetrieveAndCleanSnapshotsData;
-
-/* Snapshot depth-first infrastructure */
 
-static pid_t take_retrieve_and_clean_snapshot_on_target(void *data, Target *target)
+static pid_t snapshot_retrieve_and_clean_mapping(void *data, SnapshotMapping *mapping, Target *target, gchar **arguments, unsigned int arguments_length)
 {
     pid_t pid = fork();
     
     if(pid == 0)
     {
-        TakeRetrieveAndCleanSnapshotsData *retrieve_snapshots_data = (TakeRetrieveAndCleanSnapshotsData*)data;
+        SnapshotPipelineData *pipeline_data = (SnapshotPipelineData*)data;
+        ConcurrencyTokens *core_tokens = g_hash_table_lookup(pipeline_data->target_core_tokens_table, mapping->target);
+        ConcurrencyTokens *target_transfer_tokens = g_hash_table_lookup(pipeline_data->target_transfer_tokens_table, mapping->target);
         
-        gchar *target_key = find_target_key(target);
-        GPtrArray *snapshots_per_target_array = find_snapshot_mappings_per_target(retrieve_snapshots_data->snapshots_array, target_key);
-        unsigned int i;
-        int exit_status = 0;
-        ProcReact_Status status;
-        
-        for(i = 0; i < snapshots_per_target_array->len; i++)
+        /* Take the snapshot while occupying one of the cores of the target */
+        if(!(pipeline_data->flags & FLAG_TRANSFER_ONLY))
         {
-            SnapshotMapping *mapping = g_ptr_array_index(snapshots_per_target_array, i);
-            gchar **arguments = generate_activation_arguments(target, mapping->container); /* Generate an array of key=value pairs from container properties */
-            unsigned int arguments_length = g_strv_length(arguments); /* Determine length of the activation arguments array */
+            if(!acquire_concurrency_token(core_tokens))
+            {
+                g_printerr("[target: %s]: Cannot acquire a core of the target!\n", mapping->target);
+                exit(1);
+            }
             
-            if(!procreact_wait_for_boolean(take_snapshot_on_target(mapping, target, arguments, arguments_length), &status) || (status != PROCREACT_STATUS_OK)
-              || !procreact_wait_for_boolean(retrieve_snapshot_mapping(mapping, target, retrieve_snapshots_data->flags), &status) || (status != PROCREACT_STATUS_OK)
-              || !procreact_wait_for_boolean(clean_snapshot_mapping(mapping, target, retrieve_snapshots_data->keep), &status) || (status != PROCREACT_STATUS_OK))
+            if(!run_snapshot_stage(core_tokens, take_snapshot_on_target(mapping, target, arguments, arguments_length)))
+            {
+                g_printerr("[target: %s]: Cannot snapshot state of service: %s\n", mapping->target, mapping->component);
+                exit(1);
+            }
+        }
+        
+        /* Leave the snapshot on the target, so that the machine that restores it can fetch it directly */
+        if(pipeline_data->flags & FLAG_NO_RETRIEVE)
+            exit(0);
+        
+        /* Retrieve the snapshot. Wait for a transfer slot of the target first, so that a pipeline never holds a global slot while waiting */
+        if(!acquire_concurrency_token(target_transfer_tokens))
+        {
+            g_printerr("[target: %s]: Cannot acquire a transfer slot of the target!\n", mapping->target);
+            exit(1);
+        }
+        
+        if(!acquire_concurrency_token(&pipeline_data->transfer_tokens))
+        {
+            release_concurrency_token(target_transfer_tokens);
+            g_printerr("[target: %s]: Cannot acquire a transfer slot!\n", mapping->target);
+            exit(1);
+        }
+        
+        if(!run_snapshot_stage(&pipeline_data->transfer_tokens, retrieve_snapshot_mapping(mapping, target, pipeline_data->flags)))
+        {
+            release_concurrency_token(target_transfer_tokens);
+            g_printerr("[target: %s]: Cannot send snapshots of component: %s\n", mapping->target, mapping->component);
+            exit(1);
+        }
+        
+        release_concurrency_token(target_transfer_tokens);
+        
+        /* Clean the snapshot on the target, so that it no longer occupies disk space */
+        if(pipeline_data->flags & FLAG_DEPTH_FIRST)
+        {
+            if(!acquire_concurrency_token(core_tokens))
             {
-                exit_status = 1;
-                g_strfreev(arguments);
-                break;
+                g_printerr("[target: %s]: Cannot acquire a core of the target!\n", mapping->target);
+                exit(1);
             }
             
-            g_strfreev(arguments);
+            if(!run_snapshot_stage(core_tokens, clean_snapshot_mapping(mapping, target, pipeline_data->keep)))
+            {
+                g_printerr("[target: %s]: Cannot clean snapshots of component: %s\n", mapping->target, mapping->component);
+                exit(1);
+            }
         }
-    
-        g_ptr_array_free(snapshots_per_target_array, TRUE);
         
-        exit(exit_status);
+        exit(0);
     }
     
     return pid;
 }
 
-void complete_take_retrieve_and_clean_snapshots_on_target(void *data, Target *target, ProcReact_Status status, int result)
+static void complete_snapshot_retrieve_and_clean_mapping(void *data, SnapshotMapping *mapping, ProcReact_Status status, int result)
 {
-    if(status != PROCREACT_STATUS_OK || !result)
-    {
-        gchar *target_key = find_target_key(target);
-        g_printerr("[target: %s]: Cannot take, send or clean snapshots!\n", target_key);
-    }
+    /* The stages report their own failures, except abnormal terminations */
+    if(status != PROCREACT_STATUS_OK)
+        g_printerr("[target: %s]: Processing the snapshots of component: %s terminated abnormally!\n", mapping->target, mapping->component);
 }
 
-static int snapshot_depth_first(GPtrArray *snapshots_array, GPtrArray *target_array, const unsigned int max_concurrent_transfers, const unsigned int flags, const int keep)
+static int snapshot_in_pipelines(GPtrArray *snapshots_array, GPtrArray *target_array, const unsigned int max_concurrent_transfers, const unsigned int transfers_per_target, const unsigned int flags, const int keep, const unsigned int disk_budget)
 {
     int success;
-    TakeRetrieveAndCleanSnapshotsData data = { snapshots_array, flags, keep };
-    ProcReact_PidIterator iterator = create_target_iterator(target_array, take_retrieve_and_clean_snapshot_on_target, complete_take_retrieve_and_clean_snapshots_on_target, &data);
+    gchar *transfer_log;
+    SnapshotPipelineData data;
     
-    g_print("[coordinator]: Snapshotting, retrieving and cleaning snapshots...\n");
+    if(!create_snapshot_pipeline_data(&data, snapshots_array, target_array, max_concurrent_transfers, transfers_per_target, flags, keep, disk_budget))
+    {
+        g_printerr("[coordinator]: Cannot create the transfer slots!\n");
+        return FALSE;
+    }
     
-    procreact_fork_and_wait_in_parallel_limit(&iterator, max_concurrent_transfers);
-    success = target_iterator_has_succeeded(&iterator);
+    if(flags & FLAG_NO_RETRIEVE)
+        g_print("[coordinator]: Snapshotting without retrieving snapshots...\n");
+    else if(flags & FLAG_DEPTH_FIRST)
+        g_print("[coordinator]: Snapshotting, retrieving and cleaning snapshots...\n");
+    else
+        g_print("[coordinator]: Snapshotting and retrieving snapshots...\n");
     
-    destroy_target_iterator(&iterator);
+    /*
+     * Each component moves through its stages independently, so that the
+     * snapshot of one component overlaps with the transfer of another. The
+     * snapshot and clean stages share the CPU cores of the target and the
+     * transfer stages share the transfer slots.
+     */
+    transfer_log = transfer_statistics_start();
+    success = map_snapshot_items_limit(snapshots_array, target_array, determine_pipeline_limit, snapshot_retrieve_and_clean_mapping, complete_snapshot_retrieve_and_clean_mapping, &data);
+    transfer_statistics_print_summary(transfer_log);
     
+    destroy_snapshot_pipeline_data(&data);
     return success;
 }
 
@@ -221,7 +294,7 @@ static void cleanup(const unsigned int flags, const gchar *manifest_file, char *
 
 /* The entire snapshot operation */
 
-int snapshot(const gchar *manifest_file, const unsigned int max_concurrent_transfers, const unsigned int flags, const int keep, const gchar *old_manifest, const gchar *coordinator_profile_path, gchar *profile, const gchar *container_filter, const gchar *component_filter)
+int snapshot(const gchar *manifest_file, const unsigned int max_concurrent_transfers, const unsigned int transfers_per_target, const unsigned int flags, const int keep, const unsigned int disk_budget, const gchar *old_manifest, const gchar *coordinator_profile_path, gchar *profile, const gchar *container_filter, const gchar *component_filter)
 {
     /* Generate a distribution array from the manifest file */
     Manifest *manifest = open_provided_or_previous_manifest_file(manifest_file, coordinator_profile_path, profile, MANIFEST_SNAPSHOT_FLAG, container_filter, component_filter);
@@ -258,26 +331,10 @@ int snapshot(const gchar *manifest_file, const unsigned int max_concurrent_trans
                 snapshots_array = subtract_snapshot_mappings(old_snapshots_array, manifest->snapshots_array);
             }
         
-            if(flags & FLAG_DEPTH_FIRST)
+            if(!snapshot_in_pipelines(snapshots_array, manifest->target_array, max_concurrent_transfers, transfers_per_target, flags, keep, disk_budget))
             {
-                int exit_status;
-                
-                if(snapshot_depth_first(snapshots_array, manifest->target_array, max_concurrent_transfers, flags, keep))
-                    exit_status = 0;
-                else
-                    exit_status = 1;
-                
                 cleanup(flags, manifest_file, old_manifest_file, manifest, snapshots_array, old_snapshots_array);
-                return exit_status;
-            }
-            else
-            {
-                if((!(flags & FLAG_TRANSFER_ONLY) && !snapshot_services(snapshots_array, manifest->target_array)) /* First, take snapshots on the remote machines */
-                  || (!retrieve_snapshots(snapshots_array, manifest->target_array, max_concurrent_transfers, flags))) /* Then transfer the snapshots to the coordinator machine */
-                {
-                    cleanup(flags, manifest_file, old_manifest_file, manifest, snapshots_array, old_snapshots_array);
-                    return 1;
-                }
+                return 1;
             }
         }
         
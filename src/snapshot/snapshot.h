@@ -24,6 +24,7 @@
 #define FLAG_DEPTH_FIRST 0x2
 #define FLAG_ALL 0x4
 #define FLAG_NO_UPGRADE 0x8
+#define FLAG_NO_RETRIEVE 0x10
 
 #include <glib.h>
 
@@ -32,7 +33,9 @@
  *
  * @param manifest_file Path to the manifest file which maps services to machines
  * @param max_concurrent_transfers Specifies the maximum amount of concurrent transfers
+ * @param transfers_per_target Maximum amount of concurrent transfers per target, 0 to use the DISNIX_MAX_CONCURRENT_TRANSFERS_PER_TARGET environment variable or else 1
  * @param keep Indicates how many snapshot generations should be kept
+ * @param disk_budget Maximum amount of components per target that are processed concurrently in depth-first mode
  * @param flags Option flags
  * @param old_manifest Manifest file representing the old deployment configuration
  * @param coordinator_profile_path Path where the current deployment state is stored for future reference
@@ -41,6 +44,6 @@
  * @param component Snapshot operations will be restricted to the given component, NULL indicates all components
  * @return 0 if everything succeeds, else a non-zero exit status
  */
-int snapshot(const gchar *manifest_file, const unsigned int max_concurrent_transfers, const unsigned int flags, const int keep, const gchar *old_manifest, const gchar *coordinator_profile_path, gchar *profile, const gchar *container, const gchar *component);
+int snapshot(const gchar *manifest_file, const unsigned int max_concurrent_transfers, const unsigned int transfers_per_target, const unsigned int flags, const int keep, const unsigned int disk_budget, const gchar *old_manifest, const gchar *coordinator_profile_path, gchar *profile, const gchar *container, const gchar *component);
 
 #endif
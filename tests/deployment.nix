@@ -11,6 +11,7 @@ with import "${nixpkgs}/nixos/lib/testing.nix" { system = builtins.currentSystem
       coordinator = machine;
       testtarget1 = machine;
       testtarget2 = machine;
+      testtarget3 = machine;
     };
     testScript =
       let
@@ -28,6 +29,17 @@ with import "${nixpkgs}/nixos/lib/testing.nix" { system = builtins.currentSystem
         $testtarget2->mustSucceed("mkdir -m 700 /root/.ssh");
         $testtarget2->copyFileFromHost("key.pub", "/root/.ssh/authorized_keys");
         
+        $testtarget3->mustSucceed("mkdir -m 700 /root/.ssh");
+        $testtarget3->copyFileFromHost("key.pub", "/root/.ssh/authorized_keys");
+        
+        # The targets fetch closures from each other when peer transfers are
+        # used, so they need the key as well
+        foreach my $target ($testtarget1, $testtarget2, $testtarget3) {
+            $target->copyFileFromHost("key", "/root/.ssh/id_dsa");
+            $target->mustSucceed("chmod 600 /root/.ssh/id_dsa");
+            $target->mustSucceed("echo -e 'UserKnownHostsFile /dev/null\\nStrictHostKeyChecking no' > /root/.ssh/config");
+        }
+        
         $coordinator->mustSucceed("mkdir -m 700 /root/.ssh");
         $coordinator->copyFileFromHost("key", "/root/.ssh/id_dsa");
         $coordinator->mustSucceed("chmod 600 /root/.ssh/id_dsa");
@@ -497,5 +509,38 @@ with import "${nixpkgs}/nixos/lib/testing.nix" { system = builtins.currentSystem
         } else {
             die "We don't have any reconstructed manifests!";
         }
+        
+        # Peer distribution test. All three targets deploy the same services.
+        # The coordinator transfers one closure at the time and every target
+        # serves at most one peer at the time. Therefore, testtarget1
+        # receives its closure from the coordinator and passes the services
+        # on to testtarget2, so that they travel two hops, while testtarget3
+        # is served by the coordinator. This test should succeed.
+        
+        my $peerManifest = $coordinator->mustSucceed("${env} disnix-manifest -s ${manifestTests}/services-complete.nix -i ${manifestTests}/infrastructure-peers.nix -d ${manifestTests}/distribution-peers.nix");
+        $result = $coordinator->mustSucceed("${env} disnix-distribute --max-concurrent-transfers 1 --peer-fan-out 1 $peerManifest 2>&1");
+        
+        if($result =~ /\[target: testtarget2\]: Receiving closure of service: .* from peer: testtarget1/) {
+            print "testtarget2 has received its services from testtarget1\n";
+        } else {
+            die "testtarget2 should have received its services from testtarget1!\n";
+        }
+        
+        if($result =~ /\[target: testtarget(1|3)\]: Receiving closure of service: .* from peer/) {
+            die "testtarget1 and testtarget3 should have been served by the coordinator!\n";
+        }
+        
+        if($result =~ /falling back to the coordinator/) {
+            die "No transfer should have fallen back to the coordinator!\n";
+        }
+        
+        # The services and the profile must be present on the target that
+        # has received them from a peer.
+        
+        my @peerClosure = split('\n', $coordinator->mustSucceed("nix-store -qR $peerManifest"));
+        my @peerServices = grep(/\-testService[12]$/, @peerClosure);
+        my @peerProfile = grep(/\-testtarget2$/, @peerClosure);
+        
+        $testtarget2->mustSucceed("nix-store --check-validity @peerServices @peerProfile");
       '';
   }
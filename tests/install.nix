@@ -208,6 +208,12 @@ with import "${nixpkgs}/nixos/lib/testing.nix" { system = builtins.currentSystem
         # This test should succeed.
         $client->mustSucceed("disnix-client --import $result");
         
+        # Queued stream import test. The first stream import delays its
+        # stream, so that it occupies the import slot while two further stream
+        # imports are queued and merged. Their closures are named pipes, which
+        # must each be read once. This test should succeed and not hang.
+        $client->mustSucceed("timeout 120 sh -c '(sleep 5; cat $result) | disnix-client --import --stdin & pid1=\$!; sleep 1; cat $result | disnix-client --import --stdin & pid2=\$!; cat $result | disnix-client --import --stdin & pid3=\$!; wait \$pid1 && wait \$pid2 && wait \$pid3'");
+        
         # Lock test. This test should succeed.
         $client->mustSucceed("disnix-client --lock");
         
@@ -232,6 +238,19 @@ with import "${nixpkgs}/nixos/lib/testing.nix" { system = builtins.currentSystem
         # Deactivate the same service using the echo type. This test should succeed.
         $client->mustSucceed("disnix-client --deactivate --arguments foo=foo --arguments bar=bar --type echo @testService1");
         
+        # Batch test. The first operation fails, because its type does not
+        # exist. The second operation depends on it, so it must be skipped and
+        # reported as a failure. The trailing empty line must be ignored.
+        # The batch as a whole should fail.
+        
+        $result = $client->mustSucceed("(printf 'activate\\t@testService1\\t\\tnonexistent\\t\\tfoo=foo\\nactivate\\t@testService1\\t\\techo\\t0\\tfoo=foo\\n\\n' | disnix-client --batch; echo \"exit: \$?\") 2> /dev/null");
+        
+        if($result =~ /^0 failure$/m && $result =~ /^1 failure$/m && $result =~ /^exit: 1$/m) {
+            print "The operation depending on the failed operation has been skipped\n";
+        } else {
+            die "The operation depending on the failed operation should have been reported as failure!\n";
+        }
+        
         # Security test. First we try to invoke a Disnix operation by an
         # unprivileged user, which should fail. Then we try the same
         # command by a privileged user, which should succeed.
@@ -333,7 +352,35 @@ with import "${nixpkgs}/nixos/lib/testing.nix" { system = builtins.currentSystem
         # remotely. This test should succeed.
         $server->mustSucceed("nix-store --export \$(nix-store -qR /bin/sh) > /root/bash.closure");
         $client->mustSucceed("${env} disnix-ssh-client --target server --import --remotefile /root/bash.closure");
-        
+
+        # Stream export test. Streams the closure of the bash shell from the
+        # server directly into the Nix store of the client. This test should
+        # succeed.
+        $client->mustSucceed("${env} disnix-ssh-client --target server --export --stdout ${pkgs.bash} | nix-store --import");
+
+        # Stream import test. Streams the closure of the target2Profile
+        # directly into the Nix store of the server. This test should succeed.
+        $client->mustSucceed("nix-store --export \$(nix-store -qR @target2Profile) | ${env} disnix-ssh-client --target server --import --stdin");
+        $server->mustSucceed("nix-store --check-validity @target2Profile");
+
+        # Query GC generation test. Queries the marker that changes whenever
+        # the garbage collector runs. This test should succeed.
+        $client->mustSucceed("${env} disnix-ssh-client --target server --query-gc-generation");
+
+        # Copy from peer test. Builds a package on the client, which the
+        # server lacks, and lets the server copy its closure from the client
+        # acting as a peer. The server connects to the client with the same
+        # key pair. This test should succeed.
+        $server->copyFileFromHost("key", "/root/.ssh/id_dsa");
+        $server->mustSucceed("chmod 600 /root/.ssh/id_dsa");
+        $server->mustSucceed("echo -e 'UserKnownHostsFile /dev/null\\nStrictHostKeyChecking no' > /root/.ssh/config");
+        $client->copyFileFromHost("key.pub", "/root/.ssh/authorized_keys");
+        
+        $result = $client->mustSucceed("nix-build ${nixpkgs} -A writeTextFile --argstr name peer-test --argstr text 'Hello peer'");
+        $server->mustFail("nix-store --check-validity $result");
+        $client->mustSucceed("${env} disnix-ssh-client --target server --copy-from-peer --peer client $result");
+        $server->mustSucceed("nix-store --check-validity $result");
+
         # Set test. Adds the testtarget2 profile as only derivation into 
         # the Disnix profile. We first set the profile, then we check
         # whether the profile is part of the closure.
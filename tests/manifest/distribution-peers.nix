@@ -0,0 +1,6 @@
+{infrastructure}:
+
+{
+  testService1 = [ infrastructure.testtarget1 infrastructure.testtarget2 infrastructure.testtarget3 ]; # All targets deploy the same services
+  testService2 = [ infrastructure.testtarget1 infrastructure.testtarget2 infrastructure.testtarget3 ];
+}
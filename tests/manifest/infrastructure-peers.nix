@@ -0,0 +1,34 @@
+{
+  testtarget1 = {
+    properties = {
+      hostname = "testtarget1";
+      supportedTypes = [ "echo" "process" "wrapper" ];
+    
+      meta = {
+        description = "The first test target";
+      };
+    };
+  };
+  
+  testtarget2 = {
+    properties = {
+      hostname = "testtarget2";
+      supportedTypes = [ "echo" "process" "wrapper" ];
+    
+      meta = {
+        description = "The second test target";
+      };
+    };
+  };
+  
+  testtarget3 = {
+    properties = {
+      hostname = "testtarget3";
+      supportedTypes = [ "echo" "process" "wrapper" ];
+    
+      meta = {
+        description = "The third test target";
+      };
+    };
+  };
+}